@@ -0,0 +1,590 @@
+/*
+ * dwarview - DWARF debug info viewer
+ *
+ * Copyright (C) 2016  Namhyung Kim <namhyung@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 or later of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+/*
+ * Search entries from accelerator tables.
+ *
+ * If the file has .debug_names (DWARF 5) or .gdb_index, the names of
+ * functions and variables (and types in .debug_names) are read from the
+ * table instead of walking all DIEs.  Entries of .debug_names point to
+ * the DIEs directly, but .gdb_index only has the CU for each name, so
+ * such entries point to the CU DIE and they are resolved by
+ * accel_resolve() when needed.
+ *
+ * Tables are read in host byte order; files with the other byte order
+ * fall back to the DIE walk.
+ */
+
+#include <string.h>
+
+#include "dwarview.h"
+
+struct reader {
+	const guint8 *p;
+	const guint8 *end;
+};
+
+struct names_abbrev {
+	guint64 tag;
+	GArray *attrs;		/* pairs of DW_IDX_* and DW_FORM_* */
+};
+
+static Elf_Data *get_section(Elf *elf, const char *sec_name)
+{
+	size_t i, num_sec, strndx;
+
+	if (elf_getshdrnum(elf, &num_sec) < 0 || elf_getshdrstrndx(elf, &strndx) < 0)
+		return NULL;
+
+	for (i = 0; i < num_sec; i++) {
+		Elf_Scn *sec = elf_getscn(elf, i);
+		GElf_Shdr shdr;
+
+		if (gelf_getshdr(sec, &shdr) == NULL)
+			continue;
+
+		if (g_strcmp0(elf_strptr(elf, strndx, shdr.sh_name), sec_name))
+			continue;
+
+		/* libdw decompresses only the sections it knows */
+		if ((shdr.sh_flags & SHF_COMPRESSED) && elf_compress(sec, 0, 0) < 0)
+			return NULL;
+
+		return elf_getdata(sec, NULL);
+	}
+	return NULL;
+}
+
+static bool read_u(struct reader *r, int size, guint64 *val)
+{
+	guint8 u8;
+	guint16 u16;
+	guint32 u32;
+
+	if (r->p + size > r->end)
+		return false;
+
+	switch (size) {
+	case 1:
+		u8 = *r->p;
+		*val = u8;
+		break;
+	case 2:
+		memcpy(&u16, r->p, 2);
+		*val = u16;
+		break;
+	case 4:
+		memcpy(&u32, r->p, 4);
+		*val = u32;
+		break;
+	case 8:
+		memcpy(val, r->p, 8);
+		break;
+	default:
+		return false;
+	}
+
+	r->p += size;
+	return true;
+}
+
+static bool read_uleb(struct reader *r, guint64 *val)
+{
+	int shift = 0;
+
+	*val = 0;
+	while (r->p < r->end) {
+		guint8 b = *r->p++;
+
+		if (shift < 64)
+			*val |= (guint64)(b & 0x7f) << shift;
+		shift += 7;
+
+		if (!(b & 0x80))
+			return true;
+	}
+	return false;
+}
+
+static bool read_form(struct reader *r, guint64 form, guint64 *val)
+{
+	switch (form) {
+	case DW_FORM_flag_present:
+		*val = 1;
+		return true;
+	case DW_FORM_data1:
+	case DW_FORM_ref1:
+	case DW_FORM_flag:
+		return read_u(r, 1, val);
+	case DW_FORM_data2:
+	case DW_FORM_ref2:
+		return read_u(r, 2, val);
+	case DW_FORM_data4:
+	case DW_FORM_ref4:
+		return read_u(r, 4, val);
+	case DW_FORM_data8:
+	case DW_FORM_ref8:
+	case DW_FORM_ref_sig8:
+		return read_u(r, 8, val);
+	case DW_FORM_udata:
+	case DW_FORM_ref_udata:
+		return read_uleb(r, val);
+	default:
+		return false;
+	}
+}
+
+static int tag_kind(guint64 tag)
+{
+	switch (tag) {
+	case DW_TAG_subprogram:
+	case DW_TAG_inlined_subroutine:
+	case DW_TAG_entry_point:
+		return INDEX_FUNC;
+	case DW_TAG_variable:
+	case DW_TAG_constant:
+		return INDEX_VAR;
+	default:
+		return -1;
+	}
+}
+
+/* type names are shown as type_name() does, returns NULL if not a type */
+static char *type_entry_name(guint64 tag, const char *name)
+{
+	switch (tag) {
+	case DW_TAG_structure_type:
+		return g_strdup_printf("struct %s", name);
+	case DW_TAG_union_type:
+		return g_strdup_printf("union %s", name);
+	case DW_TAG_enumeration_type:
+		return g_strdup_printf("enum %s", name);
+	case DW_TAG_class_type:
+		return g_strdup_printf("class %s", name);
+	case DW_TAG_base_type:
+	case DW_TAG_typedef:
+		return g_strdup(name);
+	default:
+		return NULL;
+	}
+}
+
+/* either @name (owned by the entry) or @str (in the file) is set */
+static void add_entry(GArray *entries, char *name, const char *str,
+		      Dwarf_Off off, int kind)
+{
+	struct index_entry entry = {
+		.name = name,
+		.str = str,
+		.off = off,
+		.kind = kind,
+	};
+
+	g_array_append_val(entries, entry);
+}
+
+static void free_abbrev(gpointer data)
+{
+	struct names_abbrev *abbrev = data;
+
+	g_array_free(abbrev->attrs, TRUE);
+	g_free(abbrev);
+}
+
+static GHashTable *read_names_abbrevs(struct reader *r)
+{
+	GHashTable *abbrevs = g_hash_table_new_full(NULL, NULL, NULL, free_abbrev);
+	guint64 code, idx, form;
+
+	while (read_uleb(r, &code) && code != 0) {
+		struct names_abbrev *abbrev = g_malloc(sizeof(*abbrev));
+
+		abbrev->attrs = g_array_new(FALSE, FALSE, sizeof(guint64));
+		g_hash_table_insert(abbrevs, GSIZE_TO_POINTER(code), abbrev);
+
+		if (!read_uleb(r, &abbrev->tag))
+			goto bad;
+
+		while (true) {
+			if (!read_uleb(r, &idx) || !read_uleb(r, &form))
+				goto bad;
+			if (idx == 0 && form == 0)
+				break;
+
+			g_array_append_val(abbrev->attrs, idx);
+			g_array_append_val(abbrev->attrs, form);
+		}
+	}
+	return abbrevs;
+
+bad:
+	g_hash_table_destroy(abbrevs);
+	return NULL;
+}
+
+/* read a name index unit of .debug_names, returns false if it's broken */
+static bool read_names_unit(struct reader *unit, int offset_size, Elf_Data *str,
+			    GArray *entries)
+{
+	guint64 version, nr_cu, nr_ltu, nr_ftu, nr_bucket, nr_name;
+	guint64 abbrev_size, aug_size, val;
+	const guint8 *cus, *str_offs, *entry_offs, *pool;
+	struct reader r = *unit;
+	GHashTable *abbrevs;
+	guint64 i, size;
+
+	if (!read_u(&r, 2, &version) || version != 5 || !read_u(&r, 2, &val) ||
+	    !read_u(&r, 4, &nr_cu) || !read_u(&r, 4, &nr_ltu) ||
+	    !read_u(&r, 4, &nr_ftu) || !read_u(&r, 4, &nr_bucket) ||
+	    !read_u(&r, 4, &nr_name) || !read_u(&r, 4, &abbrev_size) ||
+	    !read_u(&r, 4, &aug_size))
+		return false;
+
+	/* all counts are 32-bit, it cannot overflow */
+	size = aug_size + (nr_cu + nr_ltu) * offset_size + nr_ftu * 8 +
+		nr_bucket * 4 + (nr_bucket ? nr_name * 4 : 0) +
+		nr_name * offset_size * 2 + abbrev_size;
+	if (size > (guint64)(r.end - r.p))
+		return false;
+
+	r.p += aug_size;
+	cus = r.p;
+	r.p += (nr_cu + nr_ltu) * offset_size + nr_ftu * 8;
+	r.p += nr_bucket * 4 + (nr_bucket ? nr_name * 4 : 0);
+	str_offs = r.p;
+	r.p += nr_name * offset_size;
+	entry_offs = r.p;
+	r.p += nr_name * offset_size;
+
+	abbrevs = read_names_abbrevs(&(struct reader){ r.p, r.p + abbrev_size });
+	if (abbrevs == NULL)
+		return false;
+
+	pool = r.p + abbrev_size;
+
+	for (i = 0; i < nr_name; i++) {
+		struct reader sr = { str_offs + i * offset_size, entry_offs };
+		struct reader er = { entry_offs + i * offset_size, pool };
+		guint64 str_off, entry_off, code;
+		const char *name;
+
+		if (!read_u(&sr, offset_size, &str_off) || str_off >= str->d_size ||
+		    !read_u(&er, offset_size, &entry_off) ||
+		    !memchr((const char *)str->d_buf + str_off, 0, str->d_size - str_off))
+			goto bad;
+
+		name = (const char *)str->d_buf + str_off;
+
+		/* the DIE is also indexed by its DW_AT_name (C++ or Rust) */
+		if (g_str_has_prefix(name, "_Z") || g_str_has_prefix(name, "_R"))
+			continue;
+
+		er.p = pool + entry_off;
+		er.end = unit->end;
+
+		while (read_uleb(&er, &code) && code != 0) {
+			struct names_abbrev *abbrev;
+			guint64 cu = 0, die_off = 0, cu_off;
+			bool type_unit = false;
+			char *type;
+			guint k;
+
+			abbrev = g_hash_table_lookup(abbrevs, GSIZE_TO_POINTER(code));
+			if (abbrev == NULL)
+				goto bad;
+
+			for (k = 0; k < abbrev->attrs->len; k += 2) {
+				guint64 idx = g_array_index(abbrev->attrs, guint64, k);
+				guint64 form = g_array_index(abbrev->attrs, guint64, k + 1);
+
+				if (!read_form(&er, form, &val))
+					goto bad;
+
+				if (idx == DW_IDX_compile_unit)
+					cu = val;
+				else if (idx == DW_IDX_type_unit)
+					type_unit = true;
+				else if (idx == DW_IDX_die_offset)
+					die_off = val;
+			}
+
+			if (type_unit || cu >= nr_cu)
+				continue;
+
+			sr.p = cus + cu * offset_size;
+			sr.end = cus + nr_cu * offset_size;
+			if (!read_u(&sr, offset_size, &cu_off))
+				goto bad;
+
+			/*
+			 * No type signature here, so types are merged by name.
+			 * The table has definitions only.
+			 */
+			if (tag_kind(abbrev->tag) >= 0)
+				add_entry(entries, NULL, name, cu_off + die_off,
+					  tag_kind(abbrev->tag));
+			else if ((type = type_entry_name(abbrev->tag, name)) != NULL)
+				add_entry(entries, type, NULL, cu_off + die_off, INDEX_TYPE);
+		}
+	}
+
+	g_hash_table_destroy(abbrevs);
+	return true;
+
+bad:
+	g_hash_table_destroy(abbrevs);
+	return false;
+}
+
+static bool read_debug_names(Elf_Data *names, Elf_Data *str, GArray *entries)
+{
+	struct reader r = { names->d_buf, (guint8 *)names->d_buf + names->d_size };
+
+	while (r.p < r.end) {
+		struct reader unit;
+		int offset_size = 4;
+		guint64 len;
+
+		if (!read_u(&r, 4, &len))
+			return false;
+		if (len == 0xffffffff) {
+			if (!read_u(&r, 8, &len))
+				return false;
+			offset_size = 8;
+		}
+		if (len > (guint64)(r.end - r.p))
+			return false;
+
+		unit.p = r.p;
+		unit.end = r.p + len;
+		if (!read_names_unit(&unit, offset_size, str, entries))
+			return false;
+
+		r.p = unit.end;
+	}
+	return true;
+}
+
+/* C++ names in .gdb_index are qualified, use the last component */
+static const char *base_name(const char *name)
+{
+	const char *base = name;
+	const char *p;
+	int depth = 0;
+
+	for (p = name; *p; p++) {
+		if (*p == '<' || *p == '(')
+			depth++;
+		else if ((*p == '>' || *p == ')') && depth > 0)
+			depth--;
+		else if (depth == 0 && p[0] == ':' && p[1] == ':')
+			base = p + 2;
+	}
+	return base;
+}
+
+static bool read_gdb_index(Dwarf *dwarf, Elf_Data *index, GArray *entries)
+{
+	struct reader r = { index->d_buf, (guint8 *)index->d_buf + index->d_size };
+	guint64 version, cu_list, tu_list, addr_area, symtab, shortcut, cpool;
+	const guint8 *base = index->d_buf;
+	GArray *cu_dies;
+	guint64 nr_cu, nr_slot, i;
+
+	if (!read_u(&r, 4, &version) || version < 7 || version > 9 ||
+	    !read_u(&r, 4, &cu_list) || !read_u(&r, 4, &tu_list) ||
+	    !read_u(&r, 4, &addr_area) || !read_u(&r, 4, &symtab))
+		return false;
+
+	/* version 9 adds the shortcut table (for the main function) */
+	if (version == 9 && !read_u(&r, 4, &shortcut))
+		return false;
+	if (!read_u(&r, 4, &cpool))
+		return false;
+
+	if (cu_list > tu_list || symtab > cpool || cpool > index->d_size)
+		return false;
+
+	/* convert CU header offsets to CU DIE offsets */
+	nr_cu = (tu_list - cu_list) / 16;
+	cu_dies = g_array_sized_new(FALSE, FALSE, sizeof(Dwarf_Off), nr_cu);
+
+	for (i = 0; i < nr_cu; i++) {
+		struct reader cr = { base + cu_list + i * 16, base + tu_list };
+		Dwarf_Off next, die_off;
+		guint64 off;
+		size_t sz;
+
+		if (!read_u(&cr, 8, &off) ||
+		    dwarf_nextcu(dwarf, off, &next, &sz, NULL, NULL, NULL) != 0)
+			goto bad;
+
+		die_off = off + sz;
+		g_array_append_val(cu_dies, die_off);
+	}
+
+	nr_slot = (cpool - symtab) / 8;
+	for (i = 0; i < nr_slot; i++) {
+		struct reader sr = { base + symtab + i * 8, base + cpool };
+		struct reader vr;
+		guint64 name_off, vec_off, nr_vec, val;
+		const char *name;
+		guint64 k;
+
+		if (!read_u(&sr, 4, &name_off) || !read_u(&sr, 4, &vec_off))
+			goto bad;
+
+		/* empty slot */
+		if (name_off == 0 && vec_off == 0)
+			continue;
+
+		if (cpool + name_off >= index->d_size ||
+		    !memchr(base + cpool + name_off, 0, index->d_size - cpool - name_off))
+			goto bad;
+
+		name = base_name((const char *)base + cpool + name_off);
+
+		vr.p = base + cpool + vec_off;
+		vr.end = r.end;
+		if (vr.p > vr.end || !read_u(&vr, 4, &nr_vec))
+			goto bad;
+
+		for (k = 0; k < nr_vec; k++) {
+			guint64 cu;
+			int kind;
+
+			if (!read_u(&vr, 4, &val))
+				goto bad;
+
+			/* bits 28-30 are the symbol kind, type units come after CUs */
+			cu = val & 0xffffff;
+			switch ((val >> 28) & 7) {
+			case 2:
+				kind = INDEX_VAR;
+				break;
+			case 3:
+				kind = INDEX_FUNC;
+				break;
+			default:
+				continue;
+			}
+
+			if (cu < nr_cu)
+				add_entry(entries, NULL, name,
+					  g_array_index(cu_dies, Dwarf_Off, cu), kind);
+		}
+	}
+
+	g_array_free(cu_dies, TRUE);
+	return true;
+
+bad:
+	g_array_free(cu_dies, TRUE);
+	return false;
+}
+
+static void clear_entries(GArray *entries)
+{
+	guint i;
+
+	for (i = 0; i < entries->len; i++)
+		g_free(g_array_index(entries, struct index_entry, i).name);
+	g_array_set_size(entries, 0);
+}
+
+/* release the entries returned by accel_read() */
+void accel_free(GArray *entries)
+{
+	clear_entries(entries);
+	g_array_free(entries, TRUE);
+}
+
+/* returns an array of struct index_entry, or NULL if no usable table */
+GArray *accel_read(Dwarf *dwarf)
+{
+	Elf *elf = dwarf_getelf(dwarf);
+	GArray *entries = g_array_new(FALSE, FALSE, sizeof(struct index_entry));
+	Elf_Data *names, *str, *index;
+	GElf_Ehdr ehdr;
+
+	if (gelf_getehdr(elf, &ehdr) == NULL ||
+	    ehdr.e_ident[EI_DATA] != (G_BYTE_ORDER == G_LITTLE_ENDIAN ?
+				      ELFDATA2LSB : ELFDATA2MSB))
+		goto fail;
+
+	names = get_section(elf, ".debug_names");
+	str = get_section(elf, ".debug_str");
+	if (names && str && read_debug_names(names, str, entries)) {
+		pr_dbg("accel: %u entries from .debug_names\n", entries->len);
+		return entries;
+	}
+
+	/* discard partial results */
+	clear_entries(entries);
+
+	index = get_section(elf, ".gdb_index");
+	if (index && read_gdb_index(dwarf, index, entries)) {
+		pr_dbg("accel: %u entries from .gdb_index\n", entries->len);
+		return entries;
+	}
+
+fail:
+	accel_free(entries);
+	return NULL;
+}
+
+struct find_arg {
+	const char *name;
+	Dwarf_Die *result;
+	bool found;
+	bool found_decl;
+};
+
+static int find_die(Dwarf_Die *die, int depth, void *_arg)
+{
+	struct find_arg *arg = _arg;
+
+	if (tag_kind(dwarf_tag(die)) < 0 || g_strcmp0(dwarf_diename(die), arg->name))
+		return WALK_CONTINUE;
+
+	/* prefer the definition */
+	if (!dwarf_hasattr(die, DW_AT_declaration)) {
+		*arg->result = *die;
+		arg->found = true;
+		return WALK_STOP;
+	}
+	if (!arg->found_decl) {
+		*arg->result = *die;
+		arg->found_decl = true;
+	}
+	return WALK_CONTINUE;
+}
+
+/* find the DIE for an entry from .gdb_index which has the CU DIE only */
+bool accel_resolve(Dwarf_Die *cudie, const char *name, Dwarf_Die *result)
+{
+	struct find_arg arg = {
+		.name = name,
+		.result = result,
+	};
+
+	die_walk(cudie, find_die, &arg);
+	return arg.found || arg.found_decl;
+}
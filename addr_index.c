@@ -0,0 +1,329 @@
+/*
+ * dwarview - DWARF debug info viewer
+ *
+ * Copyright (C) 2016  Namhyung Kim <namhyung@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 or later of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+/*
+ * Address to DIE lookup.
+ *
+ * The CU for an address is found by .debug_aranges, or by the address
+ * ranges of CU DIEs if it's not available.  Each CU has a table of the
+ * address ranges of subprograms, inlined subroutines and lexical blocks
+ * which is built when an address in the CU is looked up first.
+ *
+ * The ranges are sorted by start address.  As a child DIE's ranges are
+ * inside of its parent's, the innermost range containing an address is
+ * the last range starting before the address, or one of its parents.
+ */
+
+#include <stdlib.h>
+
+#include "dwarview.h"
+
+struct addr_range {
+	Dwarf_Addr start;
+	Dwarf_Addr end;
+	Dwarf_Off off;		/* the DIE */
+	gint32 parent;		/* index of the enclosing range or -1 */
+	guint32 order;		/* index before sorting */
+};
+
+struct addr_table {
+	struct addr_range *ranges;
+	guint32 nr_range;
+};
+
+struct addr_index {
+	Dwarf *dwarf;
+	struct addr_table *cus;		/* when aranges is not available */
+	GHashTable *tables;		/* CU DIE offset -> struct addr_table */
+};
+
+static bool has_range(int tag)
+{
+	switch (tag) {
+	case DW_TAG_subprogram:
+	case DW_TAG_inlined_subroutine:
+	case DW_TAG_lexical_block:
+		return true;
+	default:
+		return false;
+	}
+}
+
+/* add ranges of @die and returns index of the first one (or -1 if none) */
+static gint32 add_ranges(GArray *ranges, Dwarf_Die *die, gint32 parent, guint32 nr_parent)
+{
+	ptrdiff_t offset = 0;
+	Dwarf_Addr base, start, end;
+	gint32 first = ranges->len;
+
+	while ((offset = dwarf_ranges(die, offset, &base, &start, &end)) > 0) {
+		struct addr_range r = {
+			.start = start,
+			.end = end,
+			.off = dwarf_dieoffset(die),
+			.parent = -1,
+			.order = ranges->len,
+		};
+		guint32 i;
+
+		if (start >= end)
+			continue;
+
+		/* find the range of the parent which has this one */
+		for (i = 0; parent >= 0 && i < nr_parent; i++) {
+			struct addr_range *p = &g_array_index(ranges, struct addr_range,
+							      parent + i);
+
+			if (p->start <= start && end <= p->end) {
+				r.parent = parent + i;
+				break;
+			}
+		}
+		g_array_append_val(ranges, r);
+	}
+
+	return ranges->len > (guint)first ? first : -1;
+}
+
+/* ranges of the innermost enclosing DIE which has any */
+struct range_scope {
+	gint32 first;
+	guint32 nr;
+};
+
+struct collect_arg {
+	GArray *ranges;
+	GArray *scopes;		/* struct range_scope, indexed by depth */
+};
+
+static int collect_ranges(Dwarf_Die *die, int depth, void *_arg)
+{
+	struct collect_arg *arg = _arg;
+	struct range_scope scope;
+
+	/* the parent's scope is at depth - 1 as the walk is in pre-order */
+	scope = g_array_index(arg->scopes, struct range_scope, depth - 1);
+
+	if (has_range(dwarf_tag(die))) {
+		gint32 first = add_ranges(arg->ranges, die, scope.first, scope.nr);
+
+		if (first >= 0) {
+			scope.first = first;
+			scope.nr = arg->ranges->len - first;
+		}
+	}
+
+	if ((guint)depth >= arg->scopes->len)
+		g_array_set_size(arg->scopes, depth + 1);
+	g_array_index(arg->scopes, struct range_scope, depth) = scope;
+	return WALK_CONTINUE;
+}
+
+/* parents come first if they start at the same address */
+static int cmp_range(const void *a, const void *b)
+{
+	const struct addr_range *ra = a;
+	const struct addr_range *rb = b;
+
+	if (ra->start != rb->start)
+		return ra->start < rb->start ? -1 : 1;
+	if (ra->end != rb->end)
+		return ra->end > rb->end ? -1 : 1;
+	return ra->order < rb->order ? -1 : 1;
+}
+
+static struct addr_table *make_table(GArray *ranges)
+{
+	struct addr_table *table = g_malloc(sizeof(*table));
+	guint32 *pos = g_malloc(ranges->len * sizeof(*pos));
+	guint32 i;
+
+	qsort(ranges->data, ranges->len, sizeof(struct addr_range), cmp_range);
+
+	/* parents refer to the index before sorting */
+	for (i = 0; i < ranges->len; i++)
+		pos[g_array_index(ranges, struct addr_range, i).order] = i;
+
+	for (i = 0; i < ranges->len; i++) {
+		struct addr_range *r = &g_array_index(ranges, struct addr_range, i);
+
+		if (r->parent >= 0)
+			r->parent = pos[r->parent];
+	}
+	g_free(pos);
+
+	table->nr_range = ranges->len;
+	table->ranges = (struct addr_range *)g_array_free(ranges, FALSE);
+	return table;
+}
+
+static void free_table(gpointer data)
+{
+	struct addr_table *table = data;
+
+	g_free(table->ranges);
+	g_free(table);
+}
+
+static struct addr_table *build_cu_table(struct addr_index *idx, Dwarf_Off cu_off)
+{
+	GArray *ranges = g_array_new(FALSE, FALSE, sizeof(struct addr_range));
+	struct addr_table *table;
+	Dwarf_Die cudie;
+
+	if (dwarf_offdie(idx->dwarf, cu_off, &cudie)) {
+		struct range_scope top = { .first = -1, };
+		struct collect_arg arg = {
+			.ranges = ranges,
+			.scopes = g_array_new(FALSE, FALSE, sizeof(struct range_scope)),
+		};
+
+		g_array_append_val(arg.scopes, top);
+		die_walk(&cudie, collect_ranges, &arg);
+		g_array_free(arg.scopes, TRUE);
+	}
+
+	table = make_table(ranges);
+	pr_dbg("addr index: CU %#lx has %u ranges\n", (unsigned long)cu_off, table->nr_range);
+	return table;
+}
+
+static struct addr_table *build_cus_table(struct addr_index *idx)
+{
+	GArray *ranges = g_array_new(FALSE, FALSE, sizeof(struct addr_range));
+	Dwarf_Off off = 0;
+	Dwarf_Off next;
+	Dwarf_Die cudie;
+	size_t sz;
+
+	while (dwarf_nextcu(idx->dwarf, off, &next, &sz, NULL, NULL, NULL) == 0) {
+		if (dwarf_offdie(idx->dwarf, off + sz, &cudie))
+			add_ranges(ranges, &cudie, -1, 0);
+		off = next;
+	}
+	return make_table(ranges);
+}
+
+/* returns the innermost range which contains @addr */
+static gint32 table_lookup(struct addr_table *table, Dwarf_Addr addr)
+{
+	guint32 lo = 0;
+	guint32 hi = table->nr_range;
+	gint32 i;
+
+	/* find the last range starting at or before @addr */
+	while (lo < hi) {
+		guint32 mid = (lo + hi) / 2;
+
+		if (table->ranges[mid].start <= addr)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	for (i = (gint32)lo - 1; i >= 0; i = table->ranges[i].parent) {
+		if (addr < table->ranges[i].end)
+			return i;
+	}
+	return -1;
+}
+
+struct addr_index *addr_index_new(Dwarf *dwarf)
+{
+	struct addr_index *idx = g_malloc0(sizeof(*idx));
+
+	idx->dwarf = dwarf;
+	idx->tables = g_hash_table_new_full(g_int64_hash, g_int64_equal,
+					    g_free, free_table);
+	return idx;
+}
+
+void addr_index_free(struct addr_index *idx)
+{
+	if (idx->cus)
+		free_table(idx->cus);
+	g_hash_table_destroy(idx->tables);
+	g_free(idx);
+}
+
+/* find the CU DIE which contains @addr */
+bool addr_index_find_cu(struct addr_index *idx, Dwarf_Addr addr, Dwarf_Off *cu_off)
+{
+	Dwarf_Die cudie;
+	gint32 i;
+
+	if (dwarf_addrdie(idx->dwarf, addr, &cudie)) {
+		*cu_off = dwarf_dieoffset(&cudie);
+		return true;
+	}
+
+	/* no aranges, use the ranges in the CU DIEs */
+	if (idx->cus == NULL)
+		idx->cus = build_cus_table(idx);
+
+	i = table_lookup(idx->cus, addr);
+	if (i < 0)
+		return false;
+
+	*cu_off = idx->cus->ranges[i].off;
+	return true;
+}
+
+/*
+ * Find DIEs of subprograms, inlined subroutines and lexical blocks
+ * containing @addr.  Their offsets are saved in @chain from the
+ * outermost one (up to @max).  Returns the number of DIEs found.
+ */
+int addr_index_lookup(struct addr_index *idx, Dwarf_Addr addr,
+		      Dwarf_Off *chain, int max)
+{
+	struct addr_table *table;
+	Dwarf_Off cu_off;
+	gint32 i;
+	int nr = 0;
+	int k;
+
+	if (!addr_index_find_cu(idx, addr, &cu_off))
+		return 0;
+
+	table = g_hash_table_lookup(idx->tables, &cu_off);
+	if (table == NULL) {
+		gint64 *key = g_malloc(sizeof(*key));
+
+		*key = cu_off;
+		table = build_cu_table(idx, cu_off);
+		g_hash_table_insert(idx->tables, key, table);
+	}
+
+	for (i = table_lookup(table, addr); i >= 0; i = table->ranges[i].parent) {
+		if (nr == max)
+			break;
+		chain[nr++] = table->ranges[i].off;
+	}
+
+	/* reverse to have the outermost first */
+	for (k = 0; k < nr / 2; k++) {
+		Dwarf_Off tmp = chain[k];
+
+		chain[k] = chain[nr - 1 - k];
+		chain[nr - 1 - k] = tmp;
+	}
+	return nr;
+}
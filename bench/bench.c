@@ -0,0 +1,586 @@
+/*
+ * dwarview - DWARF debug info viewer
+ *
+ * Copyright (C) 2016  Namhyung Kim <namhyung@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 or later of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+/*
+ * Benchmark driver.
+ *
+ * It measures the main paths of dwarview on a given file without the
+ * GUI and prints the results in JSON:
+ *
+ *   walk        read all DIEs in a single thread with die_walk()
+ *   walk_recursive  same with a recursive walk, for comparison
+ *   load        build the search entries with the loader threads
+ *   name_index  sort the entries and build the trigram index
+ *   search      search latency for some patterns (glob, regex and fuzzy)
+ *   attr        render attribute values of all DIEs
+ *   names       look up tag, attribute and form names of all DIEs
+ *   expr        decode long (valid and random) DWARF expressions
+ *   lines       read line tables and resolve addresses to source lines
+ *   layout      find structs with most wasted bytes (in parallel)
+ *   export      write all DIEs as JSON and binary (in parallel, to nowhere)
+ *
+ * and the hit ratio of the type name cache.
+ *
+ * Usage: dwarview-bench <file> [<pattern>...]
+ */
+
+#define _GNU_SOURCE  /* for fopencookie() */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+
+#include "dwarview.h"
+
+#define SEARCH_REPEAT  10
+#define NAMES_REPEAT   10
+#define EXPR_REPEAT    100
+#define LINE_SAMPLES   100000
+#define LAYOUT_TOP_N   20
+
+bool dwarview_debug;
+
+static Dwarf *dwarf;
+static char *dwarf_path;
+static char *build_id;
+
+static const struct {
+	const char *pattern;
+	int mode;
+} default_patterns[] = {
+	{ "func1*", MATCH_GLOB }, { "*_1", MATCH_GLOB }, { "*inl*", MATCH_GLOB },
+	{ "*get*", MATCH_GLOB }, { "*", MATCH_GLOB }, { "no_such_name", MATCH_GLOB },
+	{ "^func[0-9]+_1$", MATCH_REGEX }, { "get.*value", MATCH_REGEX },
+	{ "fn1", MATCH_FUZZY }, { "gtvl", MATCH_FUZZY },
+};
+
+static double now(void)
+{
+	return g_get_monotonic_time() / 1e6;
+}
+
+/* the way DIEs were walked before die_walk() */
+static void walk_recursive(Dwarf_Die *die, unsigned long *nr_die)
+{
+	Dwarf_Die child;
+
+	if (dwarf_child(die, &child) != 0)
+		return;
+
+	do {
+		(*nr_die)++;
+		if (dwarf_haschildren(&child))
+			walk_recursive(&child, nr_die);
+	}
+	while (dwarf_siblingof(&child, &child) == 0);
+}
+
+static int count_die(Dwarf_Die *die, int depth, void *arg)
+{
+	unsigned long *nr_die = arg;
+
+	(*nr_die)++;
+	return WALK_CONTINUE;
+}
+
+static void bench_walk(bool recursive)
+{
+	unsigned long nr_cu = 0;
+	unsigned long nr_die = 0;
+	Dwarf_Off off = 0;
+	Dwarf_Off next;
+	Dwarf_Die cudie;
+	size_t sz;
+	double start, elapsed;
+
+	start = now();
+	while (dwarf_nextcu(dwarf, off, &next, &sz, NULL, NULL, NULL) == 0) {
+		if (dwarf_offdie(dwarf, off + sz, &cudie)) {
+			nr_cu++;
+			nr_die++;
+			if (recursive)
+				walk_recursive(&cudie, &nr_die);
+			else
+				die_walk(&cudie, count_die, &nr_die);
+		}
+		off = next;
+	}
+	elapsed = now() - start;
+
+	printf("  \"%s\": {\"nr_cu\": %lu, \"nr_die\": %lu, \"sec\": %.6f, "
+	       "\"die_per_sec\": %.0f},\n", recursive ? "walk_recursive" : "walk",
+	       nr_cu, nr_die, elapsed, elapsed > 0 ? nr_die / elapsed : 0);
+}
+
+static void bench_load(GPtrArray *items)
+{
+	struct dwarview_loader *ld;
+	struct index_batch *batch;
+	double start, elapsed;
+	guint i;
+
+	start = now();
+	ld = loader_new(dwarf, dwarf_path, die_name, false);
+
+	while (!loader_done(ld)) {
+		batch = loader_pop(ld);
+		if (batch == NULL) {
+			g_usleep(100);
+			continue;
+		}
+
+		for (i = 0; i < batch->items->len; i++) {
+			struct index_entry *entry;
+			struct search_item *item = g_malloc(sizeof(*item));
+
+			entry = &g_array_index(batch->items, struct index_entry, i);
+			item->name = entry->str ?: entry->name;
+			item->off = entry->off;
+			g_ptr_array_add(items, item);
+
+			/* copied names are moved to the search items */
+			entry->name = NULL;
+		}
+		loader_free_batch(batch);
+	}
+	elapsed = now() - start;
+
+	loader_destroy(ld);
+
+	printf("  \"load\": {\"nr_entry\": %u, \"workers\": %u, \"sec\": %.6f},\n",
+	       items->len, g_get_num_processors(), elapsed);
+}
+
+static struct name_index *bench_name_index(GPtrArray *items)
+{
+	struct name_index *idx;
+	double start, elapsed;
+
+	/* the index takes the array, items are released at exit */
+	start = now();
+	idx = name_index_new(items);
+	elapsed = now() - start;
+
+	printf("  \"name_index\": {\"sec\": %.6f},\n", elapsed);
+	return idx;
+}
+
+static void bench_search(struct name_index *idx, const char *pattern, int mode,
+			 bool last)
+{
+	static const char *mode_names[] = { "glob", "regex", "fuzzy" };
+	struct name_query *query = name_query_new(pattern, mode);
+	guint matched = 0;
+	double start, elapsed;
+	int k;
+
+	if (query == NULL)
+		return;
+
+	start = now();
+	for (k = 0; k < SEARCH_REPEAT; k++) {
+		GPtrArray *result = name_index_search(idx, query, NULL, NULL);
+
+		matched = result->len;
+		g_ptr_array_free(result, TRUE);
+	}
+	elapsed = (now() - start) / SEARCH_REPEAT;
+
+	printf("    {\"pattern\": \"%s\", \"mode\": \"%s\", \"matched\": %u, "
+	       "\"usec\": %.1f}%s\n", pattern, mode_names[mode], matched,
+	       elapsed * 1e6, last ? "" : ",");
+	name_query_free(query);
+}
+
+struct attr_count {
+	Dwarf_Die *diep;
+	unsigned long nr_die;
+	unsigned long nr_attr;
+};
+
+static int attr_callback(Dwarf_Attribute *attr, void *_arg)
+{
+	struct attr_count *arg = _arg;
+	unsigned long raw_value;
+
+	g_free(attr_value(arg->diep, attr, &raw_value));
+	arg->nr_attr++;
+	return DWARF_CB_OK;
+}
+
+static int render_attrs(Dwarf_Die *die, int depth, void *_arg)
+{
+	struct attr_count *arg = _arg;
+
+	arg->nr_die++;
+	arg->diep = die;
+	dwarf_getattrs(die, attr_callback, arg, 0);
+	return WALK_CONTINUE;
+}
+
+static void bench_attr(void)
+{
+	struct attr_count arg = {};
+	Dwarf_Off off = 0;
+	Dwarf_Off next;
+	Dwarf_Die cudie;
+	size_t sz;
+	double start, elapsed;
+
+	start = now();
+	while (dwarf_nextcu(dwarf, off, &next, &sz, NULL, NULL, NULL) == 0) {
+		if (dwarf_offdie(dwarf, off + sz, &cudie))
+			die_walk(&cudie, render_attrs, &arg);
+		off = next;
+	}
+	elapsed = now() - start;
+
+	printf("  \"attr\": {\"nr_die\": %lu, \"nr_attr\": %lu, \"sec\": %.6f},\n",
+	       arg.nr_die, arg.nr_attr, elapsed);
+}
+
+struct name_codes {
+	GArray *tags;
+	GArray *attrs;		/* (attr << 16) | form */
+};
+
+static int add_attr_code(Dwarf_Attribute *attr, void *arg)
+{
+	struct name_codes *codes = arg;
+	unsigned code = (dwarf_whatattr(attr) << 16) | dwarf_whatform(attr);
+
+	g_array_append_val(codes->attrs, code);
+	return DWARF_CB_OK;
+}
+
+static int add_name_codes(Dwarf_Die *die, int depth, void *arg)
+{
+	struct name_codes *codes = arg;
+	unsigned tag = dwarf_tag(die);
+
+	g_array_append_val(codes->tags, tag);
+	dwarf_getattrs(die, add_attr_code, codes, 0);
+	return WALK_CONTINUE;
+}
+
+/* only the name lookups, with the codes in the file order */
+static void bench_names(void)
+{
+	struct name_codes codes;
+	Dwarf_Off off = 0;
+	Dwarf_Off next;
+	Dwarf_Die cudie;
+	size_t sz;
+	unsigned long nr_unknown = 0;
+	unsigned long nr_lookup;
+	double start, elapsed;
+	guint i;
+	int n;
+
+	codes.tags = g_array_new(FALSE, FALSE, sizeof(unsigned));
+	codes.attrs = g_array_new(FALSE, FALSE, sizeof(unsigned));
+
+	while (dwarf_nextcu(dwarf, off, &next, &sz, NULL, NULL, NULL) == 0) {
+		if (dwarf_offdie(dwarf, off + sz, &cudie)) {
+			unsigned tag = dwarf_tag(&cudie);
+
+			g_array_append_val(codes.tags, tag);
+			die_walk(&cudie, add_name_codes, &codes);
+		}
+		off = next;
+	}
+
+	start = now();
+	for (n = 0; n < NAMES_REPEAT; n++) {
+		for (i = 0; i < codes.tags->len; i++) {
+			if (!strcmp(dwarview_tag_name(g_array_index(codes.tags, unsigned, i)), "unknown"))
+				nr_unknown++;
+		}
+		for (i = 0; i < codes.attrs->len; i++) {
+			unsigned code = g_array_index(codes.attrs, unsigned, i);
+
+			if (!strcmp(dwarview_attr_name(code >> 16), "unknown"))
+				nr_unknown++;
+			if (!strcmp(dwarview_form_name(code & 0xffff), "unknown"))
+				nr_unknown++;
+		}
+	}
+	elapsed = (now() - start) / NAMES_REPEAT;
+
+	nr_lookup = codes.tags->len + 2 * codes.attrs->len;
+	printf("  \"names\": {\"nr_lookup\": %lu, \"unknown\": %lu, \"sec\": %.6f, "
+	       "\"nsec_per_lookup\": %.2f},\n", nr_lookup, nr_unknown / NAMES_REPEAT,
+	       elapsed, nr_lookup ? elapsed * 1e9 / nr_lookup : 0);
+
+	g_array_free(codes.tags, TRUE);
+	g_array_free(codes.attrs, TRUE);
+}
+
+/* common operations with operands of different encodings */
+static const unsigned char expr_pattern[] = {
+	0x77, 0x78,			/* breg7 -8 */
+	0x91, 0xec, 0x7e,		/* fbreg -148 */
+	0x03, 1, 2, 3, 4, 5, 6, 7, 8,	/* addr */
+	0x23, 0x80, 0x01,		/* plus_uconst 128 */
+	0x56, 0x35, 0x9f,		/* reg6, lit5, stack_value */
+	0x92, 0x0c, 0x10,		/* bregx r12 +16 */
+	0x93, 0x08,			/* piece 8 */
+	0xa3, 0x01, 0x55,		/* entry_value { reg5 } */
+};
+
+static guint32 xorshift(guint32 *state)
+{
+	*state ^= *state << 13;
+	*state ^= *state >> 17;
+	*state ^= *state << 5;
+	return *state;
+}
+
+/* the time per byte should not grow with the size */
+static void bench_expr(void)
+{
+	static const size_t sizes[] = { 1024, 4096, 16384, 65536 };
+	struct expr_ctx ctx = {
+		.machine = EM_X86_64,
+		.addr_size = 8,
+		.offset_size = 4,
+	};
+	unsigned char *data = g_malloc(sizes[ARRAY_SIZE(sizes) - 1]);
+	guint32 seed = 1;
+	unsigned i, k;
+	int n;
+
+	printf("  \"expr\": [\n");
+	for (k = 0; k < 2; k++) {
+		bool random = k == 1;
+
+		for (i = 0; i < ARRAY_SIZE(sizes); i++) {
+			GString *out = g_string_new(NULL);
+			double start, elapsed;
+			size_t j;
+
+			for (j = 0; j < sizes[i]; j++) {
+				if (random)
+					data[j] = xorshift(&seed);
+				else
+					data[j] = expr_pattern[j % sizeof(expr_pattern)];
+			}
+
+			start = now();
+			for (n = 0; n < EXPR_REPEAT; n++) {
+				g_string_truncate(out, 0);
+				expr_print(&ctx, data, sizes[i], out);
+			}
+			elapsed = (now() - start) / EXPR_REPEAT;
+
+			printf("    {\"input\": \"%s\", \"bytes\": %zu, \"output\": %zu, "
+			       "\"usec\": %.1f, \"nsec_per_byte\": %.2f}%s\n",
+			       random ? "random" : "valid", sizes[i], out->len,
+			       elapsed * 1e6, elapsed * 1e9 / sizes[i],
+			       (random && i + 1 == ARRAY_SIZE(sizes)) ? "" : ",");
+			g_string_free(out, TRUE);
+		}
+	}
+	printf("  ],\n");
+
+	g_free(data);
+}
+
+/* like resolving samples of a profile, addresses are from the line tables */
+static void bench_lines(void)
+{
+	struct addr_index *addrs = addr_index_new(dwarf);
+	struct line_index *idx = line_index_new(dwarf, addrs);
+	GArray *samples = g_array_new(FALSE, FALSE, sizeof(Dwarf_Addr));
+	Dwarf_Off off = 0;
+	Dwarf_Off next;
+	size_t sz;
+	guint32 seed = 1;
+	unsigned long nr_row = 0;
+	unsigned long nr_found = 0;
+	double start, build, lookup;
+	guint i;
+
+	start = now();
+	while (dwarf_nextcu(dwarf, off, &next, &sz, NULL, NULL, NULL) == 0) {
+		const struct line_info *rows;
+		guint nr;
+
+		rows = line_index_cu(idx, off + sz, &nr);
+		for (i = 0; i < nr; i++) {
+			if (!rows[i].end_sequence)
+				g_array_append_val(samples, rows[i].addr);
+		}
+		nr_row += nr;
+		off = next;
+	}
+	build = now() - start;
+
+	start = now();
+	for (i = 0; samples->len && i < LINE_SAMPLES; i++) {
+		Dwarf_Addr addr = g_array_index(samples, Dwarf_Addr,
+						xorshift(&seed) % samples->len);
+
+		if (line_index_lookup(idx, addr + xorshift(&seed) % 4))
+			nr_found++;
+	}
+	lookup = now() - start;
+
+	printf("  \"lines\": {\"nr_row\": %lu, \"build_sec\": %.6f, \"nr_lookup\": %u, "
+	       "\"found\": %lu, \"lookup_sec\": %.6f},\n",
+	       nr_row, build, i, nr_found, lookup);
+
+	g_array_free(samples, TRUE);
+	line_index_free(idx);
+	addr_index_free(addrs);
+}
+
+static void bench_layout(void)
+{
+	struct layout_summary *top = NULL;
+	GPtrArray *result;
+	double start, elapsed;
+
+	start = now();
+	result = layout_report(dwarf_path, LAYOUT_TOP_N, NULL);
+	elapsed = now() - start;
+
+	if (result == NULL)
+		return;
+
+	if (result->len)
+		top = g_ptr_array_index(result, 0);
+
+	printf("  \"layout\": {\"nr_struct\": %u, \"max_wasted\": %lu, \"sec\": %.6f},\n",
+	       result->len, top ? (unsigned long)top->wasted : 0, elapsed);
+
+	g_ptr_array_free(result, TRUE);
+}
+
+/* fopencookie() writer which only counts the bytes */
+static ssize_t count_write(void *cookie, const char *buf, size_t size)
+{
+	*(guint64 *)cookie += size;
+	return size;
+}
+
+static void bench_export(enum export_format format, const char *name, bool last)
+{
+	cookie_io_functions_t io = {
+		.write = count_write,
+	};
+	guint64 bytes = 0;
+	guint64 nr_die = 0;
+	double start, elapsed;
+	FILE *out;
+	int ret;
+
+	out = fopencookie(&bytes, "w", io);
+	if (out == NULL)
+		return;
+	setvbuf(out, NULL, _IOFBF, 1024 * 1024);
+
+	start = now();
+	ret = export_dies(dwarf_path, format, out, &nr_die);
+	elapsed = now() - start;
+	fclose(out);
+
+	printf("    {\"format\": \"%s\", \"ok\": %s, \"nr_die\": %" G_GUINT64_FORMAT
+	       ", \"bytes\": %" G_GUINT64_FORMAT ", \"sec\": %.6f, \"mb_per_sec\": %.1f}%s\n",
+	       name, ret == 0 ? "true" : "false", nr_die, bytes, elapsed,
+	       elapsed > 0 ? bytes / elapsed / (1024 * 1024) : 0.0, last ? "" : ",");
+}
+
+static void print_type_cache(void)
+{
+	guint64 hit, miss;
+
+	type_name_stats(&hit, &miss);
+	printf("  \"type_name_cache\": {\"hit\": %" G_GUINT64_FORMAT ", \"miss\": %"
+	       G_GUINT64_FORMAT "},\n", hit, miss);
+}
+
+int main(int argc, char *argv[])
+{
+	GPtrArray *items;
+	struct name_index *idx;
+	struct rusage ru;
+	int err, i;
+
+	if (argc < 2) {
+		fprintf(stderr, "Usage: dwarview-bench <file> [<pattern>...]\n");
+		return 1;
+	}
+
+	if (getenv("DWARVIEW_DEBUG"))
+		dwarview_debug = true;
+
+	err = dwarview_open(argv[1], &dwarf, &dwarf_path, &build_id);
+	if (err) {
+		fprintf(stderr, "dwarview-bench: %s: %s\n", argv[1], dwarf_errmsg(err));
+		return 1;
+	}
+
+	setup_demangler();
+
+	printf("{\n");
+	printf("  \"file\": \"%s\",\n", argv[1]);
+
+	bench_walk(false);
+	bench_walk(true);
+
+	items = g_ptr_array_new();
+	bench_load(items);
+
+	idx = bench_name_index(items);
+	printf("  \"search\": [\n");
+	if (argc > 2) {
+		for (i = 2; i < argc; i++)
+			bench_search(idx, argv[i], MATCH_GLOB, i + 1 == argc);
+	}
+	else {
+		for (i = 0; i < (int)ARRAY_SIZE(default_patterns); i++)
+			bench_search(idx, default_patterns[i].pattern, default_patterns[i].mode,
+				     i + 1 == ARRAY_SIZE(default_patterns));
+	}
+	printf("  ],\n");
+
+	bench_attr();
+	bench_names();
+	bench_expr();
+	bench_lines();
+	bench_layout();
+
+	printf("  \"export\": [\n");
+	bench_export(EXPORT_JSON, "json", false);
+	bench_export(EXPORT_BINARY, "binary", true);
+	printf("  ],\n");
+
+	print_type_cache();
+
+	getrusage(RUSAGE_SELF, &ru);
+	printf("  \"peak_rss_kb\": %ld\n", ru.ru_maxrss);
+	printf("}\n");
+
+	name_index_free(idx);
+	finish_demangler();
+	return 0;
+}
@@ -0,0 +1,71 @@
+#!/usr/bin/env python3
+#
+# Generate C++ sources for the benchmark corpus.
+#
+# Each source file becomes a compile unit with the given number of
+# functions, structs, inline functions and template instances so that
+# the resulting debug info has a known shape.
+#
+import argparse
+import os
+
+
+def gen_cu(n, args):
+    out = []
+    out.append('// generated by gen-corpus.py, do not edit')
+    out.append('namespace ns%d {' % n)
+
+    for i in range(args.structs):
+        out.append('struct S%d_%d {' % (n, i))
+        out.append('\tint a;')
+        out.append('\tlong b;')
+        out.append('\tchar c[%d];' % (i % 8 + 1))
+        out.append('\tstruct S%d_%d *next;' % (n, i))
+        out.append('};')
+
+    for i in range(args.templates):
+        out.append('template <typename T> struct Box%d_%d {' % (n, i))
+        out.append('\tT v;')
+        out.append('\tT get() const { return v + %d; }' % i)
+        out.append('};')
+
+    for i in range(args.inlines):
+        out.append('static inline __attribute__((always_inline)) int inl%d_%d(int x)' % (n, i))
+        out.append('{ return x * %d + %d; }' % (i + 2, n))
+
+    for i in range(args.funcs):
+        body = ['int r = x;']
+        if args.inlines:
+            body.append('r += inl%d_%d(r);' % (n, i % args.inlines))
+        if args.templates:
+            t = i % args.templates
+            body.append('r += Box%d_%d<%s>{%s}.get();' %
+                        (n, t, 'long' if i % 2 else 'int', 'r'))
+        if args.structs:
+            s = i % args.structs
+            body.append('S%d_%d s%d = {}; s%d.a = r; r += s%d.a;' % (n, s, s, s, s))
+        out.append('int func%d_%d(int x)' % (n, i))
+        out.append('{ %s return r; }' % ' '.join(body))
+
+    out.append('}')
+    return '\n'.join(out) + '\n'
+
+
+def main():
+    p = argparse.ArgumentParser(description='generate benchmark corpus sources')
+    p.add_argument('-o', '--outdir', required=True)
+    p.add_argument('--cus', type=int, default=100)
+    p.add_argument('--funcs', type=int, default=50)
+    p.add_argument('--structs', type=int, default=20)
+    p.add_argument('--inlines', type=int, default=10)
+    p.add_argument('--templates', type=int, default=5)
+    args = p.parse_args()
+
+    os.makedirs(args.outdir, exist_ok=True)
+    for n in range(args.cus):
+        with open(os.path.join(args.outdir, 'cu%04d.cc' % n), 'w') as f:
+            f.write(gen_cu(n, args))
+
+
+if __name__ == '__main__':
+    main()
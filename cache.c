@@ -0,0 +1,282 @@
+/*
+ * dwarview - DWARF debug info viewer
+ *
+ * Copyright (C) 2016  Namhyung Kim <namhyung@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 or later of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * On-disk cache of the search index.
+ *
+ * The cache lives in $XDG_CACHE_HOME/dwarview/<build-id> and has the
+ * following layout (in host byte order) so that it can be used
+ * directly after mmap:
+ *
+ *   struct cache_header
+ *   struct cache_cu     [nr_cu]
+ *   struct cache_entry  [nr_entry]
+ *   char                strtab[strtab_size]
+ *
+ * Bump CACHE_VERSION whenever the layout or the contents change.
+ */
+
+#include <string.h>
+#include <unistd.h>
+#include <glib/gstdio.h>
+
+#include "dwarview.h"
+
+#define CACHE_MAGIC    "DWVCACHE"
+#define CACHE_VERSION  2
+#define CACHE_ENDIAN   0x01020304
+
+struct cache_header {
+	char magic[8];
+	guint32 version;
+	guint32 endian;
+	guint64 debug_info_size;
+	guint32 nr_cu;
+	guint32 nr_entry;
+	guint64 strtab_size;
+};
+
+struct cache_cu {
+	guint64 off;		/* offset of the CU DIE */
+};
+
+struct cache_entry {
+	guint64 off;		/* offset of the DIE */
+	guint32 name;		/* offset in the strtab */
+	guint32 kind;		/* enum index_kind */
+	guint64 sig;		/* type signature for INDEX_TYPE */
+};
+
+struct index_cache {
+	GMappedFile *file;
+	const struct cache_header *hdr;
+	const struct cache_cu *cus;
+	const struct cache_entry *entries;
+	const char *strtab;
+};
+
+static char *cache_filename(const char *build_id)
+{
+	return g_build_filename(g_get_user_cache_dir(), "dwarview", build_id, NULL);
+}
+
+struct index_cache *index_cache_open(const char *build_id, size_t debug_info_size)
+{
+	struct index_cache *cache;
+	const struct cache_header *hdr;
+	GMappedFile *file;
+	char *filename;
+	size_t size, need;
+	guint32 i;
+
+	filename = cache_filename(build_id);
+	file = g_mapped_file_new(filename, FALSE, NULL);
+	g_free(filename);
+
+	if (file == NULL)
+		return NULL;
+
+	size = g_mapped_file_get_length(file);
+	hdr = (void *)g_mapped_file_get_contents(file);
+
+	if (size < sizeof(*hdr) ||
+	    memcmp(hdr->magic, CACHE_MAGIC, sizeof(hdr->magic)) ||
+	    hdr->version != CACHE_VERSION || hdr->endian != CACHE_ENDIAN ||
+	    hdr->debug_info_size != debug_info_size)
+		goto bad;
+
+	need = sizeof(*hdr) + hdr->nr_cu * sizeof(struct cache_cu) +
+		hdr->nr_entry * sizeof(struct cache_entry) + hdr->strtab_size;
+	if (size != need || hdr->strtab_size == 0)
+		goto bad;
+
+	cache = g_malloc(sizeof(*cache));
+	cache->file = file;
+	cache->hdr = hdr;
+	cache->cus = (void *)(hdr + 1);
+	cache->entries = (void *)(cache->cus + hdr->nr_cu);
+	cache->strtab = (void *)(cache->entries + hdr->nr_entry);
+
+	/* the strtab should be terminated and names should be in it */
+	if (cache->strtab[hdr->strtab_size - 1] != '\0')
+		goto bad_free;
+
+	for (i = 0; i < hdr->nr_entry; i++) {
+		if (cache->entries[i].name >= hdr->strtab_size)
+			goto bad_free;
+	}
+
+	pr_dbg("cache: %s: %u CUs, %u entries\n", build_id, hdr->nr_cu, hdr->nr_entry);
+	return cache;
+
+bad_free:
+	g_free(cache);
+bad:
+	pr_dbg("cache: %s: ignore stale or broken cache\n", build_id);
+	g_mapped_file_unref(file);
+	return NULL;
+}
+
+void index_cache_close(struct index_cache *cache)
+{
+	g_mapped_file_unref(cache->file);
+	g_free(cache);
+}
+
+/* returns the CU DIE offsets, they have the same layout as Dwarf_Off */
+const Dwarf_Off *index_cache_cus(struct index_cache *cache, guint *nr_cu)
+{
+	G_STATIC_ASSERT(sizeof(struct cache_cu) == sizeof(Dwarf_Off));
+
+	*nr_cu = cache->hdr->nr_cu;
+	return (const Dwarf_Off *)cache->cus;
+}
+
+guint index_cache_nr_entry(struct index_cache *cache)
+{
+	return cache->hdr->nr_entry;
+}
+
+const char *index_cache_entry(struct index_cache *cache, guint idx,
+			      Dwarf_Off *off, int *kind, guint64 *sig)
+{
+	const struct cache_entry *entry = &cache->entries[idx];
+
+	*off = entry->off;
+	*kind = entry->kind;
+	*sig = entry->sig;
+	return cache->strtab + entry->name;
+}
+
+static void add_entry(GArray *entries, GString *strtab, const char *name,
+		      Dwarf_Off off, int kind, guint64 sig)
+{
+	struct cache_entry entry = {
+		.off = off,
+		.name = strtab->len,
+		.kind = kind,
+		.sig = sig,
+	};
+
+	g_string_append_len(strtab, name, strlen(name) + 1);
+	g_array_append_val(entries, entry);
+}
+
+static void add_entries(GArray *entries, GString *strtab, GArray *items, int kind)
+{
+	guint i;
+
+	for (i = 0; i < items->len; i++) {
+		struct search_item *item = &g_array_index(items, struct search_item, i);
+
+		add_entry(entries, strtab, item->name, item->off, kind, 0);
+	}
+}
+
+struct type_arg {
+	GArray *entries;
+	GString *strtab;
+};
+
+static void add_type(const char *name, guint64 sig, Dwarf_Off off, void *_arg)
+{
+	struct type_arg *arg = _arg;
+
+	add_entry(arg->entries, arg->strtab, name, off, INDEX_TYPE, sig);
+}
+
+/* write to a temp file and rename it so readers never see a partial file */
+bool index_cache_save(const char *build_id, size_t debug_info_size, Dwarf *dwarf,
+		      GArray *funcs, GArray *vars, struct type_index *types)
+{
+	struct cache_header hdr = {
+		.magic = CACHE_MAGIC,
+		.version = CACHE_VERSION,
+		.endian = CACHE_ENDIAN,
+		.debug_info_size = debug_info_size,
+	};
+	GArray *cus = g_array_new(FALSE, FALSE, sizeof(struct cache_cu));
+	GArray *entries = g_array_new(FALSE, FALSE, sizeof(struct cache_entry));
+	GString *strtab = g_string_new(NULL);
+	struct type_arg type_arg = {
+		.entries = entries,
+		.strtab = strtab,
+	};
+	char *filename, *dirname, *tmpname;
+	bool ret = false;
+	Dwarf_Off off = 0;
+	Dwarf_Off next;
+	size_t sz;
+	FILE *fp;
+
+	while (dwarf_nextcu(dwarf, off, &next, &sz, NULL, NULL, NULL) == 0) {
+		struct cache_cu cu = { .off = off + sz };
+
+		g_array_append_val(cus, cu);
+		off = next;
+	}
+
+	add_entries(entries, strtab, funcs, INDEX_FUNC);
+	add_entries(entries, strtab, vars, INDEX_VAR);
+	type_index_foreach(types, add_type, &type_arg);
+	g_string_append_c(strtab, '\0');
+
+	/* entries point to strtab with 32-bit offsets */
+	if (strtab->len > G_MAXUINT32)
+		goto out;
+
+	hdr.nr_cu = cus->len;
+	hdr.nr_entry = entries->len;
+	hdr.strtab_size = strtab->len;
+
+	dirname = g_build_filename(g_get_user_cache_dir(), "dwarview", NULL);
+	g_mkdir_with_parents(dirname, 0755);
+	g_free(dirname);
+
+	filename = cache_filename(build_id);
+	tmpname = g_strdup_printf("%s.%d", filename, getpid());
+
+	fp = fopen(tmpname, "wb");
+	if (fp) {
+		ret = fwrite(&hdr, sizeof(hdr), 1, fp) == 1 &&
+			fwrite(cus->data, sizeof(struct cache_cu), cus->len, fp) == cus->len &&
+			fwrite(entries->data, sizeof(struct cache_entry),
+			       entries->len, fp) == entries->len &&
+			fwrite(strtab->str, 1, strtab->len, fp) == strtab->len;
+
+		if (fclose(fp) != 0)
+			ret = false;
+
+		if (ret && g_rename(tmpname, filename) < 0)
+			ret = false;
+		if (!ret)
+			g_unlink(tmpname);
+	}
+
+	pr_dbg("cache: %s: %s %u CUs, %u entries\n", build_id,
+	       ret ? "saved" : "failed to save", cus->len, entries->len);
+
+	g_free(tmpname);
+	g_free(filename);
+out:
+	g_array_free(cus, TRUE);
+	g_array_free(entries, TRUE);
+	g_string_free(strtab, TRUE);
+	return ret;
+}
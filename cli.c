@@ -0,0 +1,894 @@
+/*
+ * dwarview - DWARF debug info viewer
+ *
+ * Copyright (C) 2016  Namhyung Kim <namhyung@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 or later of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+/*
+ * Command line mode.
+ *
+ * It is used when the program is invoked as 'dwarview-cli' or with the
+ * --batch option.  GTK is not initialized so it can run without a
+ * display.  Results are printed as soon as they are found, either as
+ * tab-separated text or as JSON (one object per line), and nothing is
+ * kept for the whole debug info so memory usage depends on the query.
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "dwarview.h"
+
+struct cli {
+	Dwarf *dwarf;
+	char *path;
+	char *build_id;
+	bool json;
+
+	GPatternSpec *patt;
+	GHashTable *seen;
+	struct type_index *types;
+	unsigned long nr_result;
+};
+
+static void usage(void)
+{
+	fprintf(stderr,
+		"Usage: dwarview --batch [--json] <file> <command> [<arg>]\n"
+		"       dwarview-cli [--json] <file> <command> [<arg>]\n"
+		"\n"
+		"Commands:\n"
+		"  cu-list             list compile units\n"
+		"  find-func PATTERN   find functions by name (glob pattern)\n"
+		"  die OFFSET          show attributes of the DIE at OFFSET\n"
+		"  type NAME           find types by name (glob pattern), once for all\n"
+		"                      CUs which have the same definition\n"
+		"  addr ADDR...        find functions and blocks containing ADDR\n"
+		"                      (read addresses from stdin if ADDR is '-')\n"
+		"  line ADDR...        find source lines of ADDR (or stdin if '-')\n"
+		"  line-addr FILE:LINE find addresses of a source line\n"
+		"  layout NAME         show the layout of structs by name (glob pattern)\n"
+		"  holes [N]           show N structs with most wasted bytes (default: 20)\n"
+		"  export [OUTFILE]    write all DIEs to OUTFILE (default: stdout)\n"
+		"                      as JSON lines with --json, or in binary\n"
+		"\n"
+		"Exit status is 0 if any result was found, 1 if not and 2 on error.\n");
+}
+
+bool cli_requested(int argc, char *argv[])
+{
+	const char *prog = strrchr(argv[0], '/');
+
+	prog = prog ? prog + 1 : argv[0];
+	if (!strcmp(prog, "dwarview-cli"))
+		return true;
+
+	return argc > 1 && !strcmp(argv[1], "--batch");
+}
+
+static void print_json_string(const char *str)
+{
+	const unsigned char *s = (const unsigned char *)(str ?: "");
+
+	putchar('"');
+	for (; *s; s++) {
+		switch (*s) {
+		case '"':
+			fputs("\\\"", stdout);
+			break;
+		case '\\':
+			fputs("\\\\", stdout);
+			break;
+		case '\n':
+			fputs("\\n", stdout);
+			break;
+		case '\t':
+			fputs("\\t", stdout);
+			break;
+		default:
+			if (*s < 0x20)
+				printf("\\u%04x", *s);
+			else
+				putchar(*s);
+			break;
+		}
+	}
+	putchar('"');
+}
+
+/* print "key":"value" with a leading comma unless it's the first one */
+static void print_json_field(const char *key, const char *value, bool first)
+{
+	printf("%s\"%s\":", first ? "" : ",", key);
+	print_json_string(value);
+}
+
+/* die_location() returns " in FILE:LINE" for the GUI */
+static const char *strip_location(const char *loc)
+{
+	if (g_str_has_prefix(loc, " in "))
+		loc += 4;
+	return loc;
+}
+
+static void walk_all(struct cli *cli, die_visit_fn visit)
+{
+	Dwarf_Off off = 0;
+	Dwarf_Off next;
+	Dwarf_Die cudie;
+	size_t sz;
+
+	while (dwarf_nextcu(cli->dwarf, off, &next, &sz, NULL, NULL, NULL) == 0) {
+		if (dwarf_offdie(cli->dwarf, off + sz, &cudie))
+			die_walk(&cudie, visit, cli);
+		off = next;
+	}
+}
+
+static const char *die_string(Dwarf_Die *die, unsigned int name)
+{
+	Dwarf_Attribute attr;
+
+	if (dwarf_attr(die, name, &attr) == NULL)
+		return NULL;
+	return dwarf_formstring(&attr);
+}
+
+static int cmd_cu_list(struct cli *cli)
+{
+	Dwarf_Off off = 0;
+	Dwarf_Off next;
+	Dwarf_Die cudie;
+	size_t sz;
+
+	while (dwarf_nextcu(cli->dwarf, off, &next, &sz, NULL, NULL, NULL) == 0) {
+		const char *lang = "";
+		Dwarf_Attribute attr;
+		Dwarf_Word code;
+
+		if (dwarf_offdie(cli->dwarf, off + sz, &cudie) == NULL)
+			goto next;
+
+		if (dwarf_attr(&cudie, DW_AT_language, &attr) &&
+		    dwarf_formudata(&attr, &code) == 0)
+			lang = dwarview_language_name(code);
+
+		if (cli->json) {
+			printf("{\"offset\":%lu", (unsigned long)(off + sz));
+			print_json_field("name", dwarf_diename(&cudie), false);
+			print_json_field("language", lang, false);
+			print_json_field("producer", die_string(&cudie, DW_AT_producer), false);
+			printf("}\n");
+		}
+		else {
+			printf("%#lx\t%s\t%s\t%s\n", (unsigned long)(off + sz),
+			       dwarf_diename(&cudie) ?: "", lang,
+			       die_string(&cudie, DW_AT_producer) ?: "");
+		}
+
+		cli->nr_result++;
+next:
+		off = next;
+	}
+	return 0;
+}
+
+static void print_func(struct cli *cli, Dwarf_Die *die, const char *name)
+{
+	char *loc = die_location(die);
+
+	if (cli->json) {
+		printf("{\"offset\":%lu", (unsigned long)dwarf_dieoffset(die));
+		print_json_field("tag", dwarview_tag_name(dwarf_tag(die)), false);
+		print_json_field("name", name, false);
+		print_json_field("location", strip_location(loc), false);
+		printf("}\n");
+	}
+	else {
+		printf("%#lx\t%s\t%s\t%s\n", (unsigned long)dwarf_dieoffset(die),
+		       dwarview_tag_name(dwarf_tag(die)), name, strip_location(loc));
+	}
+
+	g_free(loc);
+	cli->nr_result++;
+}
+
+static int visit_func(Dwarf_Die *die, int depth, void *arg)
+{
+	struct cli *cli = arg;
+	gchar *name;
+
+	switch (dwarf_tag(die)) {
+	case DW_TAG_subprogram:
+	case DW_TAG_inlined_subroutine:
+	case DW_TAG_entry_point:
+		break;
+	default:
+		return WALK_CONTINUE;
+	}
+
+	name = die_name(die);
+	if (g_pattern_match_string(cli->patt, name))
+		print_func(cli, die, name);
+	g_free(name);
+	return WALK_CONTINUE;
+}
+
+/* use the search index in the cache if the GUI has built it */
+static bool find_func_cached(struct cli *cli)
+{
+	struct index_cache *cache;
+	Elf_Data *data;
+	guint i;
+
+	if (cli->build_id == NULL)
+		return false;
+
+	data = get_elf_secdata(dwarf_getelf(cli->dwarf), ".debug_info");
+	if (data == NULL)
+		return false;
+
+	cache = index_cache_open(cli->build_id, data->d_size);
+	if (cache == NULL)
+		return false;
+
+	for (i = 0; i < index_cache_nr_entry(cache); i++) {
+		const char *name;
+		Dwarf_Off off;
+		Dwarf_Die die;
+		guint64 sig;
+		int kind;
+
+		name = index_cache_entry(cache, i, &off, &kind, &sig);
+		if (kind != INDEX_FUNC || !g_pattern_match_string(cli->patt, name))
+			continue;
+
+		/* entries from .gdb_index point to the CU */
+		if (dwarf_offdie(cli->dwarf, off, &die) &&
+		    (dwarf_tag(&die) != DW_TAG_compile_unit ||
+		     accel_resolve(&die, name, &die)))
+			print_func(cli, &die, name);
+	}
+
+	index_cache_close(cache);
+	return true;
+}
+
+/* use .debug_names or .gdb_index in the file */
+static bool find_func_accel(struct cli *cli)
+{
+	GArray *entries = accel_read(cli->dwarf);
+	guint i;
+
+	if (entries == NULL)
+		return false;
+
+	for (i = 0; i < entries->len; i++) {
+		struct index_entry *entry = &g_array_index(entries, struct index_entry, i);
+		const char *name = entry->name ?: entry->str;
+		Dwarf_Die die;
+
+		if (entry->kind == INDEX_FUNC && g_pattern_match_string(cli->patt, name) &&
+		    dwarf_offdie(cli->dwarf, entry->off, &die)) {
+			if (dwarf_tag(&die) != DW_TAG_compile_unit ||
+			    accel_resolve(&die, name, &die))
+				print_func(cli, &die, name);
+		}
+	}
+
+	accel_free(entries);
+	return true;
+}
+
+static int cmd_find_func(struct cli *cli, const char *pattern)
+{
+	cli->patt = g_pattern_spec_new(pattern);
+
+	if (!find_func_cached(cli) && !find_func_accel(cli))
+		walk_all(cli, visit_func);
+
+	g_pattern_spec_free(cli->patt);
+	return 0;
+}
+
+static int visit_type(Dwarf_Die *die, int depth, void *arg)
+{
+	struct cli *cli = arg;
+	const char *name;
+
+	switch (dwarf_tag(die)) {
+	case DW_TAG_base_type:
+	case DW_TAG_typedef:
+	case DW_TAG_structure_type:
+	case DW_TAG_union_type:
+	case DW_TAG_enumeration_type:
+	case DW_TAG_class_type:
+	case DW_TAG_interface_type:
+		break;
+	default:
+		return WALK_CONTINUE;
+	}
+
+	name = dwarf_diename(die);
+	if (name == NULL || !g_pattern_match_string(cli->patt, name))
+		return WALK_CONTINUE;
+
+	/* the same type is in many CUs, merge them like the type search */
+	type_index_add(cli->types, name, type_signature(die), dwarf_dieoffset(die));
+	return WALK_CONTINUE;
+}
+
+static int cmp_item_off(const void *a, const void *b)
+{
+	const struct search_item *item_a = *(const struct search_item **)a;
+	const struct search_item *item_b = *(const struct search_item **)b;
+
+	return item_a->off < item_b->off ? -1 : item_a->off > item_b->off;
+}
+
+/* copies are added in the order of CUs, so the same CU is adjacent */
+static guint count_cus(struct cli *cli, GArray *copies)
+{
+	Dwarf_Off last = -1;
+	guint nr = 0;
+	guint i;
+
+	for (i = 0; i < copies->len; i++) {
+		Dwarf_Die die, cudie;
+
+		if (dwarf_offdie(cli->dwarf, g_array_index(copies, Dwarf_Off, i), &die) == NULL ||
+		    dwarf_diecu(&die, &cudie, NULL, NULL) == NULL)
+			continue;
+		if (dwarf_dieoffset(&cudie) == last)
+			continue;
+
+		last = dwarf_dieoffset(&cudie);
+		nr++;
+	}
+	return nr;
+}
+
+static void print_type(struct cli *cli, struct search_item *item)
+{
+	Dwarf_Die die;
+	const char *type;
+	char *loc;
+	Dwarf_Word size = 0;
+	guint nr_cu;
+
+	if (dwarf_offdie(cli->dwarf, item->off, &die) == NULL)
+		return;
+
+	type = type_name(&die);
+	loc = die_location(&die);
+	nr_cu = count_cus(cli, type_index_copies(item));
+
+	/* typedefs don't have the size */
+	if (dwarf_hasattr(&die, DW_AT_byte_size)) {
+		Dwarf_Attribute attr;
+
+		dwarf_attr(&die, DW_AT_byte_size, &attr);
+		dwarf_formudata(&attr, &size);
+	}
+
+	if (cli->json) {
+		printf("{\"offset\":%lu", (unsigned long)item->off);
+		print_json_field("tag", dwarview_tag_name(dwarf_tag(&die)), false);
+		print_json_field("name", type, false);
+		printf(",\"size\":%lu", (unsigned long)size);
+		print_json_field("location", strip_location(loc), false);
+		printf(",\"cus\":%u}\n", nr_cu);
+	}
+	else {
+		printf("%#lx\t%s\t%s\t%lu\t%s\t%u\n", (unsigned long)item->off,
+		       dwarview_tag_name(dwarf_tag(&die)), type,
+		       (unsigned long)size, strip_location(loc), nr_cu);
+	}
+
+	g_free(loc);
+	cli->nr_result++;
+}
+
+static int cmd_type(struct cli *cli, const char *pattern)
+{
+	GPtrArray *items;
+	guint i;
+
+	cli->patt = g_pattern_spec_new(pattern);
+	cli->types = type_index_new();
+
+	walk_all(cli, visit_type);
+
+	/* print the canonical ones in the order of the file */
+	items = type_index_items(cli->types);
+	qsort(items->pdata, items->len, sizeof(gpointer), cmp_item_off);
+	for (i = 0; i < items->len; i++)
+		print_type(cli, g_ptr_array_index(items, i));
+
+	g_ptr_array_free(items, TRUE);
+	type_index_free(cli->types);
+	g_pattern_spec_free(cli->patt);
+	return 0;
+}
+
+static int visit_layout(Dwarf_Die *die, int depth, void *arg)
+{
+	struct cli *cli = arg;
+	struct struct_layout *layout;
+	struct layout_summary sum;
+	const char *name;
+	gchar *key;
+	gchar *text;
+
+	switch (dwarf_tag(die)) {
+	case DW_TAG_structure_type:
+	case DW_TAG_class_type:
+	case DW_TAG_union_type:
+		break;
+	default:
+		return WALK_CONTINUE;
+	}
+
+	name = dwarf_diename(die);
+	if (name == NULL || !g_pattern_match_string(cli->patt, name))
+		return WALK_CONTINUE;
+
+	layout = struct_layout_new(die);
+	if (layout == NULL)
+		return WALK_CONTINUE;
+
+	struct_layout_summary(layout, &sum);
+
+	/* the same struct is in many CUs */
+	key = g_strdup_printf("%d:%s:%lu", sum.tag, sum.name, (unsigned long)sum.size);
+	if (!g_hash_table_add(cli->seen, key))
+		goto out;
+
+	text = struct_layout_print(layout);
+
+	if (cli->json) {
+		printf("{\"offset\":%lu", (unsigned long)sum.off);
+		print_json_field("name", sum.name, false);
+		printf(",\"size\":%lu,\"holes\":%u,\"padding\":%lu,\"wasted\":%lu",
+		       (unsigned long)sum.size, sum.nr_holes,
+		       (unsigned long)sum.padding, (unsigned long)sum.wasted);
+		print_json_field("layout", text, false);
+		printf("}\n");
+	}
+	else {
+		printf("%s\n", text);
+	}
+
+	g_free(text);
+	cli->nr_result++;
+out:
+	struct_layout_free(layout);
+	return WALK_CONTINUE;
+}
+
+static int cmd_layout(struct cli *cli, const char *pattern)
+{
+	cli->patt = g_pattern_spec_new(pattern);
+	cli->seen = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+
+	walk_all(cli, visit_layout);
+
+	g_hash_table_destroy(cli->seen);
+	g_pattern_spec_free(cli->patt);
+	return 0;
+}
+
+#define DEFAULT_HOLES_COUNT  20
+
+static int cmd_holes(struct cli *cli, const char *count)
+{
+	GPtrArray *result;
+	unsigned long nr = DEFAULT_HOLES_COUNT;
+	char *end;
+	guint i;
+
+	if (count) {
+		nr = strtoul(count, &end, 0);
+		if (*end != '\0' || nr == 0) {
+			fprintf(stderr, "dwarview: invalid count: %s\n", count);
+			return -1;
+		}
+	}
+
+	result = layout_report(cli->path, nr, NULL);
+	if (result == NULL) {
+		fprintf(stderr, "dwarview: cannot read %s\n", cli->path);
+		return -1;
+	}
+
+	for (i = 0; i < result->len; i++) {
+		struct layout_summary *sum = g_ptr_array_index(result, i);
+
+		if (cli->json) {
+			printf("{\"offset\":%lu", (unsigned long)sum->off);
+			print_json_field("name", sum->name, false);
+			printf(",\"size\":%lu,\"wasted\":%lu,\"holes\":%u,\"padding\":%lu}\n",
+			       (unsigned long)sum->size, (unsigned long)sum->wasted,
+			       sum->nr_holes, (unsigned long)sum->padding);
+		}
+		else {
+			printf("%#lx\t%s\t%lu\t%lu\t%u\t%lu\n", (unsigned long)sum->off,
+			       sum->name, (unsigned long)sum->size, (unsigned long)sum->wasted,
+			       sum->nr_holes, (unsigned long)sum->padding);
+		}
+		cli->nr_result++;
+	}
+
+	g_ptr_array_free(result, TRUE);
+	return 0;
+}
+
+#define EXPORT_BUF_SIZE  (1024 * 1024)
+
+static int cmd_export(struct cli *cli, const char *outfile)
+{
+	enum export_format format = cli->json ? EXPORT_JSON : EXPORT_BINARY;
+	FILE *out = stdout;
+	guint64 nr_die = 0;
+	int ret;
+
+	if (outfile && strcmp(outfile, "-")) {
+		out = fopen(outfile, "wb");
+		if (out == NULL) {
+			fprintf(stderr, "dwarview: cannot open %s: %s\n", outfile, strerror(errno));
+			return -1;
+		}
+	}
+	setvbuf(out, NULL, _IOFBF, EXPORT_BUF_SIZE);
+
+	ret = export_dies(cli->path, format, out, &nr_die);
+	if (out != stdout && fclose(out) != 0)
+		ret = -1;
+
+	if (ret < 0) {
+		fprintf(stderr, "dwarview: cannot export %s to %s\n", cli->path, outfile ?: "stdout");
+		return -1;
+	}
+
+	cli->nr_result += nr_die;
+	return 0;
+}
+
+struct cli_attr_arg {
+	struct cli *cli;
+	Dwarf_Die *diep;
+	bool first;
+};
+
+static int print_attr(Dwarf_Attribute *attr, void *_arg)
+{
+	struct cli_attr_arg *arg = _arg;
+	unsigned long raw_value;
+	gchar *val_str;
+
+	val_str = attr_value(arg->diep, attr, &raw_value);
+
+	if (arg->cli->json) {
+		printf("%s{", arg->first ? "" : ",");
+		print_json_field("name", dwarview_attr_name(dwarf_whatattr(attr)), true);
+		print_json_field("form", dwarview_form_name(dwarf_whatform(attr)), false);
+		printf(",\"raw\":%lu", raw_value);
+		print_json_field("value", val_str, false);
+		printf("}");
+	}
+	else {
+		printf("  %s\t%s\t%#lx\t%s\n", dwarview_attr_name(dwarf_whatattr(attr)),
+		       dwarview_form_name(dwarf_whatform(attr)), raw_value,
+		       val_str ?: "");
+	}
+
+	arg->first = false;
+	g_free(val_str);
+	return DWARF_CB_OK;
+}
+
+static int cmd_die(struct cli *cli, const char *offset)
+{
+	struct cli_attr_arg arg = {
+		.cli = cli,
+		.first = true,
+	};
+	Dwarf_Off off;
+	Dwarf_Die die;
+	char *end;
+	gchar *name;
+
+	off = strtoul(offset, &end, 0);
+	if (*end != '\0' || dwarf_offdie(cli->dwarf, off, &die) == NULL) {
+		fprintf(stderr, "dwarview: invalid DIE offset: %s\n", offset);
+		return -1;
+	}
+
+	arg.diep = &die;
+	name = die_name(&die);
+
+	if (cli->json) {
+		printf("{\"offset\":%lu", (unsigned long)off);
+		print_json_field("tag", dwarview_tag_name(dwarf_tag(&die)), false);
+		print_json_field("name", name, false);
+		printf(",\"attrs\":[");
+		dwarf_getattrs(&die, print_attr, &arg, 0);
+		printf("]}\n");
+	}
+	else {
+		printf("%#lx\t%s\t%s\n", (unsigned long)off,
+		       dwarview_tag_name(dwarf_tag(&die)), name);
+		dwarf_getattrs(&die, print_attr, &arg, 0);
+	}
+
+	g_free(name);
+	cli->nr_result++;
+	return 0;
+}
+
+#define MAX_ADDR_CHAIN  64
+
+static void lookup_addr(struct cli *cli, struct addr_index *idx, const char *str)
+{
+	Dwarf_Off chain[MAX_ADDR_CHAIN];
+	Dwarf_Addr addr;
+	char *end;
+	bool first;
+	int i, nr;
+
+	addr = strtoull(str, &end, 16);
+	if (end == str || *end != '\0') {
+		fprintf(stderr, "dwarview: invalid address: %s\n", str);
+		return;
+	}
+
+	nr = addr_index_lookup(idx, addr, chain, MAX_ADDR_CHAIN);
+
+	if (cli->json)
+		printf("{\"addr\":%lu,\"chain\":[", (unsigned long)addr);
+
+	for (i = 0, first = true; i < nr; i++) {
+		Dwarf_Die die;
+		gchar *name;
+		char *loc;
+
+		if (dwarf_offdie(cli->dwarf, chain[i], &die) == NULL)
+			continue;
+
+		name = die_name(&die);
+		loc = die_location(&die);
+
+		if (cli->json) {
+			printf("%s{\"offset\":%lu", first ? "" : ",", (unsigned long)chain[i]);
+			print_json_field("tag", dwarview_tag_name(dwarf_tag(&die)), false);
+			print_json_field("name", name, false);
+			print_json_field("location", strip_location(loc), false);
+			printf("}");
+		}
+		else {
+			printf("%#lx\t%d\t%#lx\t%s\t%s\t%s\n", (unsigned long)addr, i,
+			       (unsigned long)chain[i], dwarview_tag_name(dwarf_tag(&die)),
+			       name, strip_location(loc));
+		}
+
+		first = false;
+		g_free(name);
+		g_free(loc);
+	}
+
+	if (cli->json)
+		printf("]}\n");
+
+	if (nr)
+		cli->nr_result++;
+}
+
+static int cmd_addr(struct cli *cli, int argc, char *argv[])
+{
+	struct addr_index *idx = addr_index_new(cli->dwarf);
+	char buf[256];
+	int i;
+
+	for (i = 0; i < argc; i++) {
+		if (strcmp(argv[i], "-")) {
+			lookup_addr(cli, idx, argv[i]);
+			continue;
+		}
+
+		while (fgets(buf, sizeof(buf), stdin)) {
+			g_strstrip(buf);
+			if (buf[0])
+				lookup_addr(cli, idx, buf);
+		}
+	}
+
+	addr_index_free(idx);
+	return 0;
+}
+
+static void print_line(struct cli *cli, Dwarf_Addr addr, const struct line_info *row)
+{
+	if (cli->json) {
+		printf("{\"addr\":%lu", (unsigned long)addr);
+		print_json_field("file", row->file, false);
+		printf(",\"line\":%u,\"column\":%u,\"view\":%u,\"is_stmt\":%s}\n",
+		       row->line, row->column, row->view, row->is_stmt ? "true" : "false");
+	}
+	else {
+		printf("%#lx\t%s\t%u\t%u\n", (unsigned long)addr, row->file ?: "",
+		       row->line, row->column);
+	}
+	cli->nr_result++;
+}
+
+static void lookup_line(struct cli *cli, struct line_index *idx, const char *str)
+{
+	const struct line_info *row;
+	Dwarf_Addr addr;
+	char *end;
+
+	addr = strtoull(str, &end, 16);
+	if (end == str || *end != '\0') {
+		fprintf(stderr, "dwarview: invalid address: %s\n", str);
+		return;
+	}
+
+	row = line_index_lookup(idx, addr);
+	if (row)
+		print_line(cli, addr, row);
+}
+
+static int cmd_line(struct cli *cli, int argc, char *argv[])
+{
+	struct addr_index *addrs = addr_index_new(cli->dwarf);
+	struct line_index *idx = line_index_new(cli->dwarf, addrs);
+	char buf[256];
+	int i;
+
+	for (i = 0; i < argc; i++) {
+		if (strcmp(argv[i], "-")) {
+			lookup_line(cli, idx, argv[i]);
+			continue;
+		}
+
+		while (fgets(buf, sizeof(buf), stdin)) {
+			g_strstrip(buf);
+			if (buf[0])
+				lookup_line(cli, idx, buf);
+		}
+	}
+
+	line_index_free(idx);
+	addr_index_free(addrs);
+	return 0;
+}
+
+static int cmd_line_addr(struct cli *cli, const char *arg)
+{
+	const char *sep = strrchr(arg, ':');
+	struct addr_index *addrs;
+	struct line_index *idx;
+	GPtrArray *rows;
+	gchar *file;
+	char *end;
+	guint32 line;
+	guint i;
+
+	if (sep == NULL || sep == arg) {
+		fprintf(stderr, "dwarview: invalid source line: %s\n", arg);
+		return -1;
+	}
+
+	line = strtoul(sep + 1, &end, 10);
+	if (end == sep + 1 || *end != '\0') {
+		fprintf(stderr, "dwarview: invalid source line: %s\n", arg);
+		return -1;
+	}
+	file = g_strndup(arg, sep - arg);
+
+	addrs = addr_index_new(cli->dwarf);
+	idx = line_index_new(cli->dwarf, addrs);
+
+	rows = line_index_addrs(idx, file, line);
+	for (i = 0; i < rows->len; i++) {
+		const struct line_info *row = g_ptr_array_index(rows, i);
+
+		print_line(cli, row->addr, row);
+	}
+
+	g_ptr_array_free(rows, TRUE);
+	line_index_free(idx);
+	addr_index_free(addrs);
+	g_free(file);
+	return 0;
+}
+
+int dwarview_cli(int argc, char *argv[])
+{
+	struct cli cli = {};
+	const char *cmd;
+	const char *cmd_arg;
+	int i = 1;
+	int err;
+	int ret;
+
+	if (i < argc && !strcmp(argv[i], "--batch"))
+		i++;
+	if (i < argc && !strcmp(argv[i], "--json")) {
+		cli.json = true;
+		i++;
+	}
+
+	if (argc - i < 2) {
+		usage();
+		return 2;
+	}
+
+	cmd = argv[i + 1];
+	cmd_arg = argv[i + 2];  /* argv[argc] is NULL */
+
+	if (strcmp(cmd, "cu-list") && strcmp(cmd, "holes") && strcmp(cmd, "export") &&
+	    cmd_arg == NULL) {
+		usage();
+		return 2;
+	}
+
+	err = dwarview_open(argv[i], &cli.dwarf, &cli.path, &cli.build_id);
+	if (err) {
+		fprintf(stderr, "dwarview: %s: %s\n", argv[i], dwarf_errmsg(err));
+		return 2;
+	}
+
+	setup_demangler();
+	demangle_set_sync(true);
+
+	if (!strcmp(cmd, "cu-list"))
+		ret = cmd_cu_list(&cli);
+	else if (!strcmp(cmd, "find-func"))
+		ret = cmd_find_func(&cli, cmd_arg);
+	else if (!strcmp(cmd, "die"))
+		ret = cmd_die(&cli, cmd_arg);
+	else if (!strcmp(cmd, "type"))
+		ret = cmd_type(&cli, cmd_arg);
+	else if (!strcmp(cmd, "addr"))
+		ret = cmd_addr(&cli, argc - i - 2, argv + i + 2);
+	else if (!strcmp(cmd, "line"))
+		ret = cmd_line(&cli, argc - i - 2, argv + i + 2);
+	else if (!strcmp(cmd, "line-addr"))
+		ret = cmd_line_addr(&cli, cmd_arg);
+	else if (!strcmp(cmd, "layout"))
+		ret = cmd_layout(&cli, cmd_arg);
+	else if (!strcmp(cmd, "holes"))
+		ret = cmd_holes(&cli, cmd_arg);
+	else if (!strcmp(cmd, "export"))
+		ret = cmd_export(&cli, cmd_arg);
+	else {
+		usage();
+		ret = -1;
+	}
+
+	finish_demangler();
+
+	fflush(stdout);
+	g_free(cli.path);
+	g_free(cli.build_id);
+
+	if (ret < 0)
+		return 2;
+	return cli.nr_result ? 0 : 1;
+}
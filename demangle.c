@@ -1,25 +1,228 @@
 /*
- * Simple demangler interface using the external `c++filt` program.
+ * Demangler interface.
+ *
+ * C++ (and legacy Rust) names are demangled in-process using
+ * __cxa_demangle() from libstdc++.  Names it cannot handle (e.g. Rust
+ * v0 symbols) are sent to the external `c++filt` program if available,
+ * in the background so that callers don't wait for it.  Results are
+ * interned in a cache so each name is demangled once.  The cache is
+ * flushed when it's full and when the file is closed.
  */
 #include <stdio.h>
+#include <stdlib.h>
 #include <unistd.h>
 #include <string.h>
 #include <stdbool.h>
+#include <pthread.h>
+#include <signal.h>
+
+#include <glib.h>
+
+/* provided by libstdc++ (see <cxxabi.h>) */
+extern char *__cxa_demangle(const char *mangled, char *buf, size_t *len, int *status);
 
 struct demangler {
 	int	in;
 	int	out;
-	bool	ok;
+	gint	ok;
+
+	GThread	*writer;
+	GThread	*reader;
 };
 
 static struct demangler d;
 
+/*
+ * Names which need c++filt are demangled asynchronously.  demangle()
+ * queues a request and returns the linkage name as is.  The writer
+ * thread sends the requests to c++filt in batches and the reader thread
+ * matches the output lines with the names in the 'sent' queue, as
+ * c++filt keeps the order of its input.
+ */
+#define DEMANGLE_BATCH  256
+
+static GAsyncQueue *requests;
+static char stop_request;
+
+static GQueue sent = G_QUEUE_INIT;
+static bool broken;		/* c++filt is gone */
+static pthread_mutex_t sent_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* mangled name -> demangled name, both are in the string chunk */
+#define DEMANGLE_CACHE_MAX  (256 * 1024)
+
+static GHashTable *cache;
+static GStringChunk *names;
+static GHashTable *pending;	/* names queued but not demangled yet */
+static bool wait_external;	/* do not return until c++filt is done */
+static pthread_mutex_t cache_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t cache_cond = PTHREAD_COND_INITIALIZER;
+
+/* called in the main loop when new results are available */
+static GSourceFunc notify_fn;
+static gpointer notify_data;
+static gint notify_queued;
+
+static gboolean run_notify(gpointer unused)
+{
+	g_atomic_int_set(&notify_queued, 0);
+	notify_fn(notify_data);
+	return G_SOURCE_REMOVE;
+}
+
+void demangle_set_notify(GSourceFunc fn, gpointer data)
+{
+	notify_fn = fn;
+	notify_data = data;
+}
+
+/* called with cache_lock held, results are copied out so it's safe to flush */
+static void clear_cache(void)
+{
+	g_hash_table_remove_all(cache);
+	g_string_chunk_clear(names);
+}
+
+/* called with cache_lock held, returns the interned @result */
+static const char *cache_insert(const char *name, const char *result)
+{
+	if (g_hash_table_size(cache) >= DEMANGLE_CACHE_MAX)
+		clear_cache();
+
+	result = g_string_chunk_insert_const(names, result);
+	g_hash_table_insert(cache, g_string_chunk_insert_const(names, name),
+			    (gpointer)result);
+	return result;
+}
+
+/* @result is NULL if c++filt failed */
+static void complete_request(char *name, const char *result)
+{
+	pthread_mutex_lock(&cache_lock);
+	cache_insert(name, result ?: name);
+
+	/* this frees @name */
+	g_hash_table_remove(pending, name);
+	if (g_hash_table_size(pending) == 0)
+		pthread_cond_broadcast(&cache_cond);
+	pthread_mutex_unlock(&cache_lock);
+
+	if (notify_fn && g_atomic_int_compare_and_exchange(&notify_queued, 0, 1))
+		g_idle_add(run_notify, NULL);
+}
+
+/* give up remaining requests, they will show the linkage names */
+static void set_broken(void)
+{
+	char *name;
+
+	g_atomic_int_set(&d.ok, 0);
+
+	pthread_mutex_lock(&sent_lock);
+	broken = true;
+	while ((name = g_queue_pop_head(&sent)) != NULL)
+		complete_request(name, NULL);
+	pthread_mutex_unlock(&sent_lock);
+}
+
+static bool write_all(int fd, const char *buf, size_t len)
+{
+	while (len > 0) {
+		ssize_t ret = write(fd, buf, len);
+
+		if (ret < 0)
+			return false;
+
+		buf += ret;
+		len -= ret;
+	}
+	return true;
+}
+
+static gpointer writer_thread(gpointer unused)
+{
+	GString *buf = g_string_new(NULL);
+	char *name;
+	int n;
+
+	while ((name = g_async_queue_pop(requests)) != &stop_request) {
+		n = 0;
+
+		pthread_mutex_lock(&sent_lock);
+		do {
+			if (broken) {
+				complete_request(name, NULL);
+				continue;
+			}
+
+			g_string_append(buf, name);
+			g_string_append_c(buf, '\n');
+			g_queue_push_tail(&sent, name);
+		}
+		while (++n < DEMANGLE_BATCH &&
+		       (name = g_async_queue_try_pop(requests)) != NULL &&
+		       name != &stop_request);
+		pthread_mutex_unlock(&sent_lock);
+
+		if (buf->len && !write_all(d.in, buf->str, buf->len))
+			set_broken();
+		g_string_truncate(buf, 0);
+
+		if (name == &stop_request)
+			break;
+	}
+
+	/* c++filt will exit after flushing the output */
+	close(d.in);
+	g_string_free(buf, TRUE);
+	return NULL;
+}
+
+static gpointer reader_thread(gpointer unused)
+{
+	GString *line = g_string_new(NULL);
+	char buf[4096];
+	ssize_t ret;
+	ssize_t i;
+
+	while ((ret = read(d.out, buf, sizeof(buf))) > 0) {
+		for (i = 0; i < ret; i++) {
+			char *name;
+
+			if (buf[i] != '\n') {
+				g_string_append_c(line, buf[i]);
+				continue;
+			}
+
+			pthread_mutex_lock(&sent_lock);
+			name = g_queue_pop_head(&sent);
+			pthread_mutex_unlock(&sent_lock);
+
+			if (name)
+				complete_request(name, line->str);
+			g_string_truncate(line, 0);
+		}
+	}
+
+	set_broken();
+	g_string_free(line, TRUE);
+	return NULL;
+}
+
 /* popen() doesn't provide bidirectional streams, do it manually */
 void setup_demangler(void)
 {
     int p1[2], p2[2];
 
-    d.ok = false;
+    cache = g_hash_table_new(g_str_hash, g_str_equal);
+    pending = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+    names = g_string_chunk_new(64 * 1024);
+    requests = g_async_queue_new();
+
+    d.ok = 0;
+
+    /* get EPIPE instead of being killed when c++filt is not there */
+    signal(SIGPIPE, SIG_IGN);
 
     if (pipe(p1) < 0 || pipe(p2) < 0)
 	    return;
@@ -37,8 +240,8 @@ void setup_demangler(void)
 	    close(p2[0]);
 	    close(p2[1]);
 
-	    execlp("c++filt", NULL);
-	    break;
+	    execlp("c++filt", "c++filt", NULL);
+	    _exit(1);
 
     default:  /* parent */
 	    d.in  = p1[1];
@@ -47,42 +250,233 @@ void setup_demangler(void)
 	    close(p1[0]);
 	    close(p2[1]);
 
-	    d.ok = true;
+	    d.ok = 1;
+	    d.writer = g_thread_new("dwarview-demangle-w", writer_thread, NULL);
+	    d.reader = g_thread_new("dwarview-demangle-r", reader_thread, NULL);
 	    break;
     }
 }
 
 void finish_demangler(void)
 {
-	if (d.ok) {
-		close(d.in);
+	if (d.writer) {
+		g_async_queue_push(requests, &stop_request);
+		g_thread_join(d.writer);
+		g_thread_join(d.reader);
 		close(d.out);
+
+		d.writer = NULL;
+		d.reader = NULL;
 	}
 
-	d.ok = false;
+	d.ok = 0;
+
+	if (cache) {
+		g_hash_table_destroy(cache);
+		g_hash_table_destroy(pending);
+		g_string_chunk_free(names);
+		g_async_queue_unref(requests);
+		cache = NULL;
+		pending = NULL;
+		names = NULL;
+		requests = NULL;
+	}
 }
 
 bool demangler_enabled(void)
 {
-	return d.ok;
+	/* the in-process demangler is always available */
+	return true;
 }
 
-int demangle(const char *input, char *output, int outlen)
+static bool is_rust_hash(const char *s)
 {
-	int ret;
-	int len = strlen(input);
-	char flush = '\n';
+	int i;
+
+	if (s[0] != 'h')
+		return false;
 
-	if (!d.ok) {
-		memcpy(output, input, len+1);
-		return 0;
+	for (i = 1; i <= 16; i++) {
+		if (!g_ascii_isxdigit(s[i]))
+			return false;
 	}
+	return s[i] == '\0';
+}
+
+/*
+ * Legacy Rust symbols are mangled as C++ names with a trailing hash
+ * (e.g. "core::fmt::write::h0123456789abcdef") and escape sequences
+ * for characters not allowed in C++ identifiers.
+ */
+static void fixup_rust_legacy(char *name)
+{
+	static const struct {
+		const char *esc;
+		char c;
+	} escapes[] = {
+		{ "$SP$", '@' }, { "$BP$", '*' }, { "$RF$", '&' },
+		{ "$LT$", '<' }, { "$GT$", '>' }, { "$LP$", '(' },
+		{ "$RP$", ')' }, { "$C$", ',' }, { "$u7e$", '~' },
+		{ "$u20$", ' ' }, { "$u27$", '\'' }, { "$u5b$", '[' },
+		{ "$u5d$", ']' }, { "$u7b$", '{' }, { "$u7d$", '}' },
+		{ "$u3b$", ';' }, { "$u2b$", '+' }, { "$u22$", '"' },
+	};
+	char *hash = strrchr(name, ':');
+	char *src, *dst;
+	unsigned i;
+
+	if (hash == NULL || hash == name || hash[-1] != ':' || !is_rust_hash(hash + 1))
+		return;
 
-	write(d.in, input, len);
-	write(d.in, &flush, 1);
+	hash[-1] = '\0';
 
-	ret = read(d.out, output, outlen);
-	output[ret - 1] = '\0';
+	for (src = dst = name; *src; ) {
+		if (src[0] == '.' && src[1] == '.') {
+			*dst++ = ':';
+			*dst++ = ':';
+			src += 2;
+			continue;
+		}
+
+		if (src[0] == '$') {
+			for (i = 0; i < G_N_ELEMENTS(escapes); i++) {
+				size_t len = strlen(escapes[i].esc);
+
+				if (!strncmp(src, escapes[i].esc, len)) {
+					*dst++ = escapes[i].c;
+					src += len;
+					break;
+				}
+			}
+			if (i < G_N_ELEMENTS(escapes))
+				continue;
+		}
+
+		*dst++ = *src++;
+	}
+	*dst = '\0';
+}
+
+/* returns a malloc-ed string or NULL */
+static char *demangle_internal(const char *input)
+{
+	char *result;
+	int status;
+
+	if (strncmp(input, "_Z", 2))
+		return NULL;
+
+	result = __cxa_demangle(input, NULL, NULL, &status);
+	if (result == NULL || status != 0) {
+		free(result);
+		return NULL;
+	}
+
+	fixup_rust_legacy(result);
+	return result;
+}
+
+/* queue @input for c++filt and return it until the result is ready */
+static int demangle_external(const char *input, char *output, int outlen)
+{
+	pthread_mutex_lock(&cache_lock);
+	if (g_atomic_int_get(&d.ok) && !g_hash_table_contains(pending, input)) {
+		char *name = g_strdup(input);
+
+		g_hash_table_add(pending, name);
+		g_async_queue_push(requests, name);
+	}
+	pthread_mutex_unlock(&cache_lock);
+
+	g_strlcpy(output, input, outlen);
+	return strlen(output);
+}
+
+/*
+ * In batch mode, nothing shows the names again when they're demangled,
+ * so wait for the result of c++filt.
+ */
+void demangle_set_sync(bool sync)
+{
+	wait_external = sync;
+}
+
+/* wait until all queued names are demangled */
+void demangle_flush(void)
+{
+	pthread_mutex_lock(&cache_lock);
+	while (g_hash_table_size(pending) > 0)
+		pthread_cond_wait(&cache_cond, &cache_lock);
+	pthread_mutex_unlock(&cache_lock);
+}
+
+/* returns true if some names are still waiting for c++filt */
+bool demangle_pending(void)
+{
+	bool ret;
+
+	pthread_mutex_lock(&cache_lock);
+	ret = pending && g_hash_table_size(pending) > 0;
+	pthread_mutex_unlock(&cache_lock);
 
 	return ret;
 }
+
+/* returns true if @name should be demangled by c++filt */
+bool demangle_external_name(const char *name)
+{
+	/* Rust v0 symbols */
+	return !strncmp(name, "_R", 2);
+}
+
+int demangle(const char *input, char *output, int outlen)
+{
+	const char *result;
+	char *str;
+
+	/* the cache can be flushed by other threads, copy it with the lock held */
+	pthread_mutex_lock(&cache_lock);
+	result = g_hash_table_lookup(cache, input);
+	if (result)
+		g_strlcpy(output, result, outlen);
+	pthread_mutex_unlock(&cache_lock);
+
+	if (result)
+		return strlen(output);
+
+	if (demangle_external_name(input)) {
+		if (!wait_external)
+			return demangle_external(input, output, outlen);
+
+		demangle_external(input, output, outlen);
+		demangle_flush();
+
+		/* not found if c++filt is not available */
+		pthread_mutex_lock(&cache_lock);
+		result = g_hash_table_lookup(cache, input) ?: input;
+		g_strlcpy(output, result, outlen);
+		pthread_mutex_unlock(&cache_lock);
+
+		return strlen(output);
+	}
+
+	/* do not hold the lock while demangling */
+	str = demangle_internal(input);
+
+	pthread_mutex_lock(&cache_lock);
+	result = cache_insert(input, str ?: input);
+	g_strlcpy(output, result, outlen);
+	pthread_mutex_unlock(&cache_lock);
+
+	free(str);
+	return strlen(output);
+}
+
+/* forget the names of the file being closed, queued ones are kept */
+void demangle_reset(void)
+{
+	pthread_mutex_lock(&cache_lock);
+	if (cache)
+		clear_cache();
+	pthread_mutex_unlock(&cache_lock);
+}
@@ -0,0 +1,785 @@
+/*
+ * dwarview - DWARF debug info viewer
+ *
+ * Copyright (C) 2016  Namhyung Kim <namhyung@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 or later of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * DIE analysis shared by the GUI and the command line mode.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <unistd.h>
+
+#include "dwarview.h"
+
+/* Dwarf FL wrappers */
+static char *debuginfo_path;	/* Currently dummy */
+
+static const Dwfl_Callbacks offline_callbacks = {
+	.find_debuginfo = dwfl_standard_find_debuginfo,
+	.debuginfo_path = &debuginfo_path,
+
+	.section_address = dwfl_offline_section_address,
+
+	/* We use this table for core files too.  */
+	.find_elf = dwfl_build_id_find_elf,
+};
+
+/*
+ * Get a Dwarf from offline image.  @debug_path is set to the file which
+ * has the debug info and @build_id to its hex string (or NULL).
+ */
+int dwarview_open(const char *path, Dwarf **dwarfp, char **debug_path, char **build_id)
+{
+	Dwarf *dwarf;
+	int fd;
+	int err;
+	Dwfl *dwfl;
+	Dwfl_Module *mod;
+	Dwarf_Addr bias;
+	const char *debugfile = NULL;
+	const unsigned char *id;
+	GElf_Addr id_vaddr;
+	int id_len;
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return errno;
+
+	dwfl = dwfl_begin(&offline_callbacks);
+	if (!dwfl)
+		goto error;
+
+	dwfl_report_begin(dwfl);
+	mod = dwfl_report_offline(dwfl, "", "", fd);
+	if (!mod)
+		goto error;
+
+	dwarf = dwfl_module_getdwarf(mod, &bias);
+	if (!dwarf)
+		goto error;
+
+	/* it's set when the debug info was found in a separate file */
+	dwfl_module_info(mod, NULL, NULL, NULL, NULL, NULL, NULL, &debugfile);
+	*debug_path = g_strdup(debugfile ?: path);
+
+	id_len = dwfl_module_build_id(mod, &id, &id_vaddr);
+	if (id_len > 0) {
+		int i;
+
+		*build_id = g_malloc(id_len * 2 + 1);
+		for (i = 0; i < id_len; i++)
+			snprintf(*build_id + i * 2, 3, "%02x", id[i]);
+	}
+	else
+		*build_id = NULL;
+
+	dwfl_report_end(dwfl, NULL, NULL);
+
+	*dwarfp = dwarf;
+	return 0;
+
+error:
+	err = dwarf_errno();
+
+	if (dwfl)
+		dwfl_end(dwfl);
+	else
+		close(fd);
+
+	if (err == 0)
+		err = 6;  /* no DWARF information */
+	return err;
+}
+
+Elf_Data *get_elf_secdata(Elf *elf, const char *sec_name)
+{
+	size_t i, num_sec, strndx;
+	Elf_Scn *sec;
+
+	elf_getshdrnum(elf, &num_sec);
+	elf_getshdrstrndx(elf, &strndx);
+
+	for (i = 0; i < num_sec; i++) {
+		char *name;
+		GElf_Shdr shdr;
+
+		sec = elf_getscn(elf, i);
+		gelf_getshdr(sec, &shdr);
+		name = elf_strptr(elf, strndx, shdr.sh_name);
+
+		if (!g_strcmp0(name, sec_name)) {
+			return elf_getdata(sec, NULL);
+		}
+	}
+	return NULL;
+}
+
+static char *print_block(Dwarf_Block *block)
+{
+	int i;
+	int len = block->length;
+	char *result = g_malloc(len * 3 + 1);
+
+	for (i = 0; i < len; i++) {
+		snprintf(&result[i * 3], 4, "%02x ", block->data[i]);
+	}
+
+	return result;
+}
+
+/*
+ * DIEs in a dwz alt file can have the same offsets as the main file.
+ * So do split units, which are told apart by their DWO ids.
+ */
+static guint64 die_cache_key(Dwarf_Die *die)
+{
+	guint64 key = dwarf_dieoffset(die);
+	guint64 unit_id;
+	uint8_t unit_type;
+
+	if (dwarf_cu_info(die->cu, NULL, &unit_type, NULL, NULL, &unit_id, NULL, NULL) == 0 &&
+	    (unit_type == DW_UT_split_compile || unit_type == DW_UT_split_type))
+		return (key ^ unit_id * 0x9E3779B97F4A7C15ULL) | 1ULL << 62;
+
+	if (dwarf_getalt(dwarf_cu_getdwarf(die->cu)) == NULL)
+		key |= 1ULL << 63;
+	return key;
+}
+
+/*
+ * Source file names of each CU, indexed by the file number.  The names
+ * are relative to DW_AT_comp_dir if they're under it.  They are read
+ * once per CU so that showing many search results from the same CUs
+ * doesn't read the file table again.  The table is flushed when it's
+ * full (a walk over all CUs would fill it otherwise) but the names are
+ * kept until the file is closed.
+ */
+#define FILE_CACHE_MAX  (4 * 1024)
+
+struct cu_files {
+	guint nr;
+	const char *names[];	/* NULL if unknown */
+};
+
+static GHashTable *file_cache;		/* CU DIE key -> struct cu_files */
+static GStringChunk *file_strings;	/* interned names */
+static GMutex file_cache_lock;
+
+static struct cu_files *read_cu_files(Dwarf_Die *cudie)
+{
+	struct cu_files *cf;
+	Dwarf_Files *files;
+	Dwarf_Attribute attr;
+	const char *comp_dir = NULL;
+	size_t comp_len = 0;
+	size_t i, nr;
+
+	if (dwarf_getsrcfiles(cudie, &files, &nr) != 0)
+		nr = 0;
+
+	if (dwarf_attr(cudie, DW_AT_comp_dir, &attr))
+		comp_dir = dwarf_formstring(&attr);
+	if (comp_dir)
+		comp_len = strlen(comp_dir);
+
+	cf = g_malloc(sizeof(*cf) + nr * sizeof(cf->names[0]));
+	cf->nr = nr;
+
+	for (i = 0; i < nr; i++) {
+		const char *path = dwarf_filesrc(files, i, NULL, NULL);
+
+		if (path && comp_len && !strncmp(path, comp_dir, comp_len)) {
+			path += comp_len;
+			while (*path == '/')
+				path++;
+		}
+
+		cf->names[i] = path ? g_string_chunk_insert_const(file_strings, path) : NULL;
+	}
+	return cf;
+}
+
+/* returns the file name of @idx in the CU of @die, or NULL */
+static const char *file_name(Dwarf_Die *die, Dwarf_Word idx)
+{
+	struct cu_files *cf;
+	const char *name;
+	Dwarf_Die cudie;
+	guint64 key;
+
+	if (dwarf_diecu(die, &cudie, NULL, NULL) == NULL)
+		return NULL;
+
+	key = die_cache_key(&cudie);
+
+	g_mutex_lock(&file_cache_lock);
+	if (file_cache == NULL) {
+		file_cache = g_hash_table_new_full(g_int64_hash, g_int64_equal, g_free, g_free);
+		file_strings = g_string_chunk_new(16 * 1024);
+	}
+
+	cf = g_hash_table_lookup(file_cache, &key);
+	if (cf == NULL) {
+		if (g_hash_table_size(file_cache) >= FILE_CACHE_MAX)
+			g_hash_table_remove_all(file_cache);
+
+		cf = read_cu_files(&cudie);
+		g_hash_table_insert(file_cache, g_memdup2(&key, sizeof(key)), cf);
+	}
+
+	/* @cf can be freed by other threads, but not the names */
+	name = idx < cf->nr ? cf->names[idx] : NULL;
+	g_mutex_unlock(&file_cache_lock);
+
+	return name;
+}
+
+/* offsets are meaningless after the file is closed */
+void file_name_reset(void)
+{
+	g_mutex_lock(&file_cache_lock);
+	if (file_cache) {
+		g_hash_table_destroy(file_cache);
+		g_string_chunk_free(file_strings);
+		file_cache = NULL;
+		file_strings = NULL;
+	}
+	g_mutex_unlock(&file_cache_lock);
+}
+
+static char *print_addr_ranges(Dwarf_Die *die)
+{
+	ptrdiff_t offset = 0;
+	Dwarf_Addr base, start, end;
+	char *result = NULL;
+
+	while ((offset = dwarf_ranges(die, offset, &base, &start, &end)) > 0) {
+		result = g_strdup_printf("%s%s[%lx,%lx)", result ?: "",
+					 result ? ", " : "", start, end);
+	}
+
+	return result;
+}
+
+char *die_location(Dwarf_Die *die)
+{
+	const char *file = NULL;
+	gint line = 0;
+
+	if (dwarf_hasattr(die, DW_AT_decl_file) || dwarf_hasattr(die, DW_AT_call_file)) {
+		Dwarf_Word file_idx;
+		Dwarf_Attribute attr;
+
+		if (dwarf_attr(die, DW_AT_decl_file, &attr) == NULL)
+			dwarf_attr(die, DW_AT_call_file, &attr);
+
+		if (dwarf_formudata(&attr, &file_idx) == 0)
+			file = file_name(die, file_idx);
+	}
+	if (dwarf_hasattr(die, DW_AT_decl_line) || dwarf_hasattr(die, DW_AT_call_line)) {
+		Dwarf_Word lineno;
+		Dwarf_Attribute attr;
+
+		if (dwarf_attr(die, DW_AT_decl_line, &attr) == NULL)
+			dwarf_attr(die, DW_AT_call_line, &attr);
+
+		dwarf_formudata(&attr, &lineno);
+		line = lineno;
+	}
+
+	return g_strdup_printf(" in %s:%d", file ?: "(unknown)", line);
+}
+
+static char *resolve_type_name(Dwarf_Die *die)
+{
+	char *type = NULL;
+	const char *name = NULL;
+	int tag = dwarf_tag(die);
+	Dwarf_Off off;
+	Dwarf_Die ref;
+	Dwarf_Attribute attr;
+
+	if (dwarf_hasattr(die, DW_AT_name))
+		name = dwarf_diename(die);
+
+	switch (tag) {
+	case DW_TAG_structure_type:
+		type = "struct";
+		break;
+	case DW_TAG_union_type:
+		type = "union";
+		break;
+	case DW_TAG_enumeration_type:
+		type = "enum";
+		break;
+	case DW_TAG_class_type:
+		type = "class";
+		break;
+	case DW_TAG_interface_type:
+		type = "interface";
+		break;
+	case DW_TAG_subroutine_type:
+		type = "function";
+		break;
+	default:
+		break;
+	}
+
+	if (type || name)
+		return g_strdup_printf("%s%s%s", type ?: "",
+				       (type && name) ? " " : "", name ?: "");
+
+	if (!dwarf_hasattr(die, DW_AT_type))
+		return g_strdup_printf("no type");
+
+	dwarf_attr(die, DW_AT_type, &attr);
+
+	switch (dwarf_whatform(&attr)) {
+	case DW_FORM_ref1:
+	case DW_FORM_ref2:
+	case DW_FORM_ref4:
+	case DW_FORM_ref8:
+	case DW_FORM_ref_udata:
+	case DW_FORM_ref_addr:
+	case DW_FORM_ref_sig8:
+	case DW_FORM_GNU_ref_alt:
+		dwarf_formref_die(&attr, &ref);
+		name = type_name(&ref);
+		break;
+	default:
+		name = "";
+		break;
+	}
+
+	switch (tag) {
+	case DW_TAG_const_type:
+		type = g_strdup_printf("const %s", name);
+		break;
+	case DW_TAG_volatile_type:
+		type = g_strdup_printf("volatile %s", name);
+		break;
+	case DW_TAG_restrict_type:
+		type = g_strdup_printf("restrict %s", name);
+		break;
+	case DW_TAG_pointer_type:
+	case DW_TAG_ptr_to_member_type:
+		type = g_strdup_printf("pointer to %s", name);
+		break;
+	case DW_TAG_reference_type:
+	case DW_TAG_rvalue_reference_type:
+		type = g_strdup_printf("reference to %s", name);
+		break;
+	case DW_TAG_array_type:
+		type = g_strdup_printf("array of %s", name);
+		break;
+	default:
+		type = g_strdup_printf("unknown type (%d)", tag);
+		break;
+	}
+
+	return type;
+}
+
+/*
+ * Resolved type names keyed by DIE offset.  Types like 'const char *'
+ * are used everywhere, so save the result instead of following the
+ * DW_AT_type chain again.  The table is shared by all threads and is
+ * flushed when it's full, but the names are interned in type_strings
+ * which is only released by type_name_reset().  It grows with the
+ * number of distinct names, not DIEs.
+ */
+#define TYPE_CACHE_MAX  (64 * 1024)
+
+static GHashTable *type_cache;
+static GStringChunk *type_strings;	/* interned names */
+static GMutex type_cache_lock;
+static guint64 type_cache_hit;
+static guint64 type_cache_miss;
+
+/* returns an interned string, valid until type_name_reset() */
+const char *type_name(Dwarf_Die *die)
+{
+	guint64 key = die_cache_key(die);
+	const char *cached;
+	char *name;
+
+	g_mutex_lock(&type_cache_lock);
+	if (type_cache == NULL) {
+		type_cache = g_hash_table_new_full(g_int64_hash, g_int64_equal, g_free, NULL);
+		type_strings = g_string_chunk_new(64 * 1024);
+	}
+
+	cached = g_hash_table_lookup(type_cache, &key);
+	if (cached) {
+		type_cache_hit++;
+		g_mutex_unlock(&type_cache_lock);
+		return cached;
+	}
+	type_cache_miss++;
+	g_mutex_unlock(&type_cache_lock);
+
+	/* it might call type_name() recursively */
+	name = resolve_type_name(die);
+
+	g_mutex_lock(&type_cache_lock);
+	if (g_hash_table_size(type_cache) >= TYPE_CACHE_MAX)
+		g_hash_table_remove_all(type_cache);
+
+	cached = g_string_chunk_insert_const(type_strings, name);
+	g_hash_table_insert(type_cache, g_memdup2(&key, sizeof(key)), (gpointer)cached);
+	g_mutex_unlock(&type_cache_lock);
+
+	g_free(name);
+	return cached;
+}
+
+void type_name_stats(guint64 *hit, guint64 *miss)
+{
+	g_mutex_lock(&type_cache_lock);
+	*hit = type_cache_hit;
+	*miss = type_cache_miss;
+	g_mutex_unlock(&type_cache_lock);
+}
+
+/* offsets are meaningless after the file is closed */
+void type_name_reset(void)
+{
+	g_mutex_lock(&type_cache_lock);
+	pr_dbg("type name cache: %" G_GUINT64_FORMAT " hits, %" G_GUINT64_FORMAT " misses\n",
+	       type_cache_hit, type_cache_miss);
+
+	if (type_cache) {
+		g_hash_table_destroy(type_cache);
+		g_string_chunk_free(type_strings);
+		type_cache = NULL;
+		type_strings = NULL;
+	}
+	type_cache_hit = 0;
+	type_cache_miss = 0;
+	g_mutex_unlock(&type_cache_lock);
+}
+
+/* attributes which can have a location list in DW_FORM_sec_offset */
+static bool is_loclist_attr(unsigned name)
+{
+	switch (name) {
+	case DW_AT_location:
+	case DW_AT_string_length:
+	case DW_AT_return_addr:
+	case DW_AT_data_member_location:
+	case DW_AT_frame_base:
+	case DW_AT_segment:
+	case DW_AT_static_link:
+	case DW_AT_use_location:
+	case DW_AT_vtable_elem_location:
+		return true;
+	default:
+		return false;
+	}
+}
+
+/* returns the value of @attr as a string, @raw_value is set to the value itself */
+gchar *attr_value(Dwarf_Die *diep, Dwarf_Attribute *attr, unsigned long *raw_value)
+{
+	unsigned name = dwarf_whatattr(attr);
+	unsigned form = dwarf_whatform(attr);
+	gpointer val_str = NULL;
+	Dwarf_Block block;
+	Dwarf_Word data;
+	Dwarf_Addr addr;
+	Dwarf_Off off;
+	Dwarf_Die die;
+
+	*raw_value = 0;
+
+	switch (form) {
+	case DW_FORM_flag:
+		*raw_value = *attr->valp;
+		val_str = g_strdup_printf("%s", *raw_value ? "True" : "False");
+		break;
+	case DW_FORM_flag_present:
+		*raw_value = 1;
+		val_str = g_strdup("True");
+		break;
+	case DW_FORM_string:
+		val_str = g_strdup(attr->valp);
+		break;
+	case DW_FORM_strp:
+	case DW_FORM_line_strp:
+	case DW_FORM_strx:
+	case DW_FORM_strx1:
+	case DW_FORM_strx2:
+	case DW_FORM_strx3:
+	case DW_FORM_strx4:
+	case DW_FORM_GNU_str_index:
+	case DW_FORM_GNU_strp_alt:
+		val_str = g_strdup(dwarf_formstring(attr));
+		break;
+	case DW_FORM_data1:
+	case DW_FORM_data2:
+	case DW_FORM_data4:
+	case DW_FORM_data8:
+	case DW_FORM_sdata:
+	case DW_FORM_udata:
+	case DW_FORM_implicit_const:
+	case DW_FORM_sec_offset:
+	case DW_FORM_loclistx:
+	case DW_FORM_rnglistx:
+		dwarf_formudata(attr, &data);
+		*raw_value = data;
+		if ((form == DW_FORM_sec_offset || form == DW_FORM_loclistx) &&
+		    is_loclist_attr(name)) {
+			struct expr_ctx ctx;
+
+			expr_ctx_init(&ctx, diep);
+			val_str = expr_print_loclist(&ctx, attr);
+			if (val_str == NULL)
+				val_str = g_strdup_printf("%#lx", *raw_value);
+		}
+		else if (name == DW_AT_decl_file || name == DW_AT_call_file) {
+			const char *file = file_name(diep, *raw_value);
+
+			if (file)
+				val_str = g_strdup(file);
+			else
+				val_str = g_strdup_printf("Unknown file: %lu", *raw_value);
+		}
+		else if (name == DW_AT_decl_line || name == DW_AT_call_line)
+			val_str = g_strdup_printf("Line %lu", *raw_value);
+		else if (name == DW_AT_inline)
+			val_str = g_strdup(dwarview_inline_name(*raw_value));
+		else if (name == DW_AT_ranges)
+			val_str = print_addr_ranges(diep) ?: g_strdup_printf("%#lx", *raw_value);
+		else if (name == DW_AT_language)
+			val_str = g_strdup(dwarview_language_name(*raw_value));
+		else
+			val_str = g_strdup_printf("%#lx", *raw_value);
+		break;
+	case DW_FORM_block1:
+	case DW_FORM_block2:
+	case DW_FORM_block4:
+	case DW_FORM_block:
+	case DW_FORM_exprloc:
+	case DW_FORM_data16:
+		dwarf_formblock(attr, &block);
+		*raw_value = block.length;
+		if (form == DW_FORM_exprloc) {
+			struct expr_ctx ctx;
+			GString *str = g_string_sized_new(block.length * 4);
+
+			expr_ctx_init(&ctx, diep);
+			expr_print(&ctx, block.data, block.length, str);
+			val_str = g_string_free(str, FALSE);
+		}
+		else
+			val_str = print_block(&block);
+		break;
+	case DW_FORM_addr:
+	case DW_FORM_addrx:
+	case DW_FORM_addrx1:
+	case DW_FORM_addrx2:
+	case DW_FORM_addrx3:
+	case DW_FORM_addrx4:
+	case DW_FORM_GNU_addr_index:
+		dwarf_formaddr(attr, &addr);
+		*raw_value = addr;
+		val_str = g_strdup_printf("%#lx", *raw_value);
+		break;
+	case DW_FORM_ref1:
+	case DW_FORM_ref2:
+	case DW_FORM_ref4:
+	case DW_FORM_ref8:
+	case DW_FORM_ref_udata:
+	case DW_FORM_ref_addr:
+	case DW_FORM_ref_sig8:
+	case DW_FORM_GNU_ref_alt:
+		dwarf_formref(attr, &off);
+		*raw_value = off;
+
+		dwarf_formref_die(attr, &die);
+
+		if (name == DW_AT_type) {
+			val_str = g_strdup_printf("%#lx (%s)", *raw_value,
+						   type_name(&die));
+		}
+		else if (dwarf_diename(&die)) {
+			val_str = g_strdup_printf("%#lx (%s)", *raw_value,
+						   dwarf_diename(&die));
+		}
+		else
+			val_str = g_strdup_printf("%#lx", *raw_value);
+		break;
+	}
+
+	return val_str;
+}
+
+/*
+ * Returns DW_AT_name of @die or its origin.  It sets @linkage instead if
+ * the linkage name comes first.
+ */
+static const char *find_name(Dwarf_Die *die, const char **linkage)
+{
+	Dwarf_Die pos = *die;
+	Dwarf_Die origin;
+	Dwarf_Attribute attr;
+
+	*linkage = NULL;
+
+	while (true) {
+		if (dwarf_attr(&pos, DW_AT_name, &attr))
+			return dwarf_formstring(&attr);
+		if (dwarf_attr(&pos, DW_AT_linkage_name, &attr)) {
+			*linkage = dwarf_formstring(&attr);
+			return NULL;
+		}
+
+		if (dwarf_attr(&pos, DW_AT_abstract_origin, &attr) == NULL &&
+		    dwarf_attr(&pos, DW_AT_specification, &attr) == NULL &&
+		    dwarf_attr(&pos, DW_AT_import, &attr) == NULL)
+			return NULL;
+
+		if (dwarf_formref_die(&attr, &origin) == NULL)
+			return NULL;
+
+		pos = origin;
+	}
+}
+
+static bool is_type_name(Dwarf_Die *die)
+{
+	switch (dwarf_tag(die)) {
+	case DW_TAG_structure_type:
+	case DW_TAG_union_type:
+	case DW_TAG_enumeration_type:
+	case DW_TAG_class_type:
+	case DW_TAG_interface_type:
+	case DW_TAG_subroutine_type:
+	case DW_TAG_const_type:
+	case DW_TAG_volatile_type:
+	case DW_TAG_restrict_type:
+	case DW_TAG_pointer_type:
+	case DW_TAG_ptr_to_member_type:
+	case DW_TAG_reference_type:
+	case DW_TAG_rvalue_reference_type:
+	case DW_TAG_array_type:
+		return true;
+	default:
+		return false;
+	}
+}
+
+gchar *die_name(Dwarf_Die *die)
+{
+	const char *name, *linkage;
+	char buf[4096];
+
+	if (is_type_name(die))
+		return g_strdup(type_name(die));
+
+	name = find_name(die, &linkage);
+	if (name)
+		return g_strdup(name);
+
+	/* use linkage name only if it can demangle the name */
+	if (linkage && demangler_enabled()) {
+		demangle(linkage, buf, sizeof(buf));
+		return g_strdup(buf);
+	}
+	return g_strdup("(no name)");
+}
+
+/*
+ * Returns the name die_name() would return if it's a string in the file
+ * as is, or NULL.  It's valid while the Dwarf handle is open.
+ */
+const char *die_name_ref(Dwarf_Die *die)
+{
+	const char *linkage;
+
+	if (is_type_name(die))
+		return NULL;
+
+	return find_name(die, &linkage);
+}
+
+static guint64 hash_mix(guint64 hash, const void *data, size_t len)
+{
+	const guint8 *p = data;
+
+	/* FNV-1a */
+	while (len--) {
+		hash ^= *p++;
+		hash *= 0x100000001b3ULL;
+	}
+	return hash;
+}
+
+static guint64 hash_str(guint64 hash, const char *str)
+{
+	/* include the terminator to separate strings */
+	return hash_mix(hash, str ?: "", strlen(str ?: "") + 1);
+}
+
+/*
+ * Signature of a type definition to find the same type in other CUs.
+ * It's computed from the tag, size and the members (name, offset and
+ * type name) so it doesn't depend on the DIE offsets.
+ */
+guint64 type_signature(Dwarf_Die *die)
+{
+	guint64 hash = 0xcbf29ce484222325ULL;
+	Dwarf_Attribute attr;
+	Dwarf_Word val;
+	Dwarf_Die child, type;
+	int tag = dwarf_tag(die);
+
+	hash = hash_mix(hash, &tag, sizeof(tag));
+
+	val = dwarf_bytesize(die);
+	hash = hash_mix(hash, &val, sizeof(val));
+
+	/* typedefs and base types don't have members */
+	if (dwarf_attr(die, DW_AT_type, &attr) && dwarf_formref_die(&attr, &type))
+		hash = hash_str(hash, type_name(&type));
+
+	if (dwarf_child(die, &child) != 0)
+		return hash;
+
+	do {
+		tag = dwarf_tag(&child);
+		hash = hash_mix(hash, &tag, sizeof(tag));
+		hash = hash_str(hash, dwarf_diename(&child));
+
+		val = 0;
+		if (dwarf_attr(&child, DW_AT_data_member_location, &attr))
+			dwarf_formudata(&attr, &val);
+		else if (dwarf_attr(&child, DW_AT_const_value, &attr))
+			dwarf_formudata(&attr, &val);
+		hash = hash_mix(hash, &val, sizeof(val));
+
+		if (dwarf_attr(&child, DW_AT_type, &attr) && dwarf_formref_die(&attr, &type))
+			hash = hash_str(hash, type_name(&type));
+	}
+	while (dwarf_siblingof(&child, &child) == 0);
+
+	return hash;
+}
@@ -0,0 +1,804 @@
+/*
+ * dwarview - DWARF debug info viewer
+ *
+ * Copyright (C) 2016  Namhyung Kim <namhyung@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 or later of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * A virtual GtkTreeModel reading DIEs from libdw on demand.
+ *
+ * Only CU headers are read when the model is created.  Children of a
+ * row are read (using dwarf_child/dwarf_siblingof) when the view asks
+ * for them for the first time, and we keep just a small record for each
+ * node.  Siblings are allocated next to each other in the node array
+ * so that a GtkTreeIter is simply the index of the node.
+ *
+ * A node takes 16 bytes and its slot in the offset index takes 8 to 16
+ * bytes, so it's 24 to 32 bytes per DIE read so far.  The number of
+ * children is not kept: they are the run of nodes with the same parent
+ * starting from the first child, and nothing else has that parent.
+ *
+ * Node offsets are unified offsets (see dwarf_files.c).  Expanding a
+ * skeleton CU shows the DIEs in its split unit, and the alternate file
+ * of dwz has a top-level node (after all CUs) for its partial units.
+ * Those files are opened only when the nodes are expanded.
+ */
+
+#include <string.h>
+
+#include "dwarview.h"
+
+#define NO_NODE  G_MAXUINT32
+
+#define PARENT_BITS  28
+#define NO_PARENT    ((1U << PARENT_BITS) - 1)	/* also the max number of nodes */
+
+enum node_kind {
+	NODE_CU,
+	NODE_META,
+	NODE_DIE,
+	NODE_ALT,
+};
+
+enum meta_kind {
+	META_FUNC,
+	META_VAR,
+	META_TYPE,
+	META_MISC,
+	NR_META,
+};
+
+static const char *meta_names[NR_META] = {
+	"functions", "variables", "types", "others",
+};
+
+struct die_node {
+	Dwarf_Off off;		/* DIE offset (CU DIE for meta nodes) */
+	guint32 parent:PARENT_BITS;	/* index of parent node or NO_PARENT */
+	guint32 kind:2;
+	guint32 meta:2;
+	guint32 child;		/* index of the first child, NO_NODE if not expanded */
+};
+
+struct _DwarviewDieModel {
+	GObject parent;
+
+	struct dwarf_files *files;
+	die_name_fn_t name_fn;
+	gint stamp;
+
+	guint32 nr_cu;		/* CU nodes come first in the array */
+	GArray *nodes;
+
+	/* open addressing table of node indices, keyed by DIE offset */
+	guint32 *index;
+	guint32 index_mask;
+	guint32 nr_index;
+};
+
+static void dwarview_die_model_tree_model_init(GtkTreeModelIface *iface);
+
+G_DEFINE_TYPE_WITH_CODE(DwarviewDieModel, dwarview_die_model, G_TYPE_OBJECT,
+			G_IMPLEMENT_INTERFACE(GTK_TYPE_TREE_MODEL,
+					      dwarview_die_model_tree_model_init))
+
+static inline struct die_node *get_node(DwarviewDieModel *model, guint32 idx)
+{
+	return &g_array_index(model->nodes, struct die_node, idx);
+}
+
+static inline guint32 iter_index(GtkTreeIter *iter)
+{
+	return GPOINTER_TO_UINT(iter->user_data);
+}
+
+static inline void set_iter(DwarviewDieModel *model, GtkTreeIter *iter, guint32 idx)
+{
+	iter->stamp = model->stamp;
+	iter->user_data = GUINT_TO_POINTER(idx);
+	iter->user_data2 = NULL;
+	iter->user_data3 = NULL;
+}
+
+/* index of the first sibling, siblings are contiguous */
+static guint32 first_sibling(DwarviewDieModel *model, guint32 idx)
+{
+	struct die_node *node = get_node(model, idx);
+
+	if (node->parent == NO_PARENT)
+		return 0;
+	return get_node(model, node->parent)->child;
+}
+
+/* number of children of an expanded node */
+static guint32 nr_children(DwarviewDieModel *model, guint32 idx)
+{
+	guint32 first = get_node(model, idx)->child;
+	guint32 lo = first;
+	guint32 hi = model->nodes->len;
+
+	while (lo < hi) {
+		guint32 mid = (lo + hi) / 2;
+
+		if (get_node(model, mid)->parent == idx)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo - first;
+}
+
+/* index of the @n-th child of an expanded node, or NO_NODE */
+static guint32 nth_child(DwarviewDieModel *model, guint32 idx, guint32 n)
+{
+	guint32 child = get_node(model, idx)->child + n;
+
+	if (child >= model->nodes->len || get_node(model, child)->parent != idx)
+		return NO_NODE;
+	return child;
+}
+
+static inline guint32 hash_offset(DwarviewDieModel *model, Dwarf_Off off)
+{
+	return (off * 0x9E3779B97F4A7C15UL) >> 32 & model->index_mask;
+}
+
+/*
+ * The offset is kept in the node already, so a slot only needs the
+ * node index.  The table is a quarter to half full, which makes it 8
+ * to 16 bytes per node.
+ */
+static void index_insert(DwarviewDieModel *model, guint32 idx)
+{
+	guint32 pos;
+
+	if ((model->nr_index + 1) * 2 > model->index_mask + 1) {
+		guint32 *old = model->index;
+		guint32 old_size = model->index_mask + 1;
+		guint32 i;
+
+		model->index_mask = old_size * 2 - 1;
+		model->index = g_malloc(old_size * 2 * sizeof(*model->index));
+		memset(model->index, 0xff, old_size * 2 * sizeof(*model->index));
+		model->nr_index = 0;
+
+		for (i = 0; i < old_size; i++) {
+			if (old[i] != NO_NODE)
+				index_insert(model, old[i]);
+		}
+		g_free(old);
+	}
+
+	pos = hash_offset(model, get_node(model, idx)->off);
+	while (model->index[pos] != NO_NODE)
+		pos = (pos + 1) & model->index_mask;
+
+	model->index[pos] = idx;
+	model->nr_index++;
+}
+
+static guint32 index_find(DwarviewDieModel *model, Dwarf_Off off)
+{
+	guint32 pos = hash_offset(model, off);
+
+	while (model->index[pos] != NO_NODE) {
+		guint32 idx = model->index[pos];
+
+		if (get_node(model, idx)->off == off)
+			return idx;
+		pos = (pos + 1) & model->index_mask;
+	}
+	return NO_NODE;
+}
+
+static int meta_of_tag(int tag)
+{
+	switch (tag) {
+	case DW_TAG_subprogram:
+	case DW_TAG_inlined_subroutine:
+	case DW_TAG_entry_point:
+		return META_FUNC;
+	case DW_TAG_base_type:
+	case DW_TAG_array_type:
+	case DW_TAG_class_type:
+	case DW_TAG_enumeration_type:
+	case DW_TAG_pointer_type:
+	case DW_TAG_reference_type:
+	case DW_TAG_string_type:
+	case DW_TAG_structure_type:
+	case DW_TAG_subroutine_type:
+	case DW_TAG_union_type:
+	case DW_TAG_set_type:
+	case DW_TAG_subrange_type:
+	case DW_TAG_const_type:
+	case DW_TAG_file_type:
+	case DW_TAG_packed_type:
+	case DW_TAG_thrown_type:
+	case DW_TAG_volatile_type:
+	case DW_TAG_restrict_type:
+	case DW_TAG_interface_type:
+	case DW_TAG_unspecified_type:
+	case DW_TAG_shared_type:
+	case DW_TAG_ptr_to_member_type:
+	case DW_TAG_rvalue_reference_type:
+	case DW_TAG_typedef:
+		return META_TYPE;
+	case DW_TAG_variable:
+		return META_VAR;
+	default:
+		return META_MISC;
+	}
+}
+
+/* add meta nodes under the CU and sort out top-level DIEs into them */
+static void expand_cu_node(DwarviewDieModel *model, guint32 idx)
+{
+	struct die_node *node = get_node(model, idx);
+	struct die_node new_node = {
+		.off = node->off,
+		.parent = idx,
+		.child = NO_NODE,
+		.kind = NODE_META,
+	};
+	GArray *group[NR_META];
+	guint32 meta_idx = model->nodes->len;
+	Dwarf_Die die, split, child;
+	int i;
+
+	node->child = meta_idx;
+
+	for (i = 0; i < NR_META; i++) {
+		new_node.meta = i;
+		g_array_append_val(model->nodes, new_node);
+		group[i] = g_array_new(FALSE, FALSE, sizeof(Dwarf_Off));
+	}
+
+	if (dwarf_files_die(model->files, new_node.off, &die) == NULL)
+		goto out;
+
+	/* show the split unit instead, as the skeleton has no children */
+	if (dwarf_files_split_unit(model->files, &die, &split))
+		die = split;
+
+	if (dwarf_child(&die, &child) == 0) {
+		do {
+			Dwarf_Off off = dwarf_files_offset(model->files, &child);
+
+			g_array_append_val(group[meta_of_tag(dwarf_tag(&child))], off);
+		}
+		while (dwarf_siblingof(&child, &child) == 0);
+	}
+
+out:
+	new_node.kind = NODE_DIE;
+	new_node.meta = 0;
+
+	for (i = 0; i < NR_META; i++) {
+		struct die_node *meta;
+		guint32 k;
+
+		new_node.parent = meta_idx + i;
+
+		meta = get_node(model, meta_idx + i);
+		meta->child = model->nodes->len;
+
+		for (k = 0; k < group[i]->len; k++) {
+			new_node.off = g_array_index(group[i], Dwarf_Off, k);
+			g_array_append_val(model->nodes, new_node);
+			index_insert(model, model->nodes->len - 1);
+		}
+		g_array_free(group[i], TRUE);
+	}
+}
+
+static void expand_die_node(DwarviewDieModel *model, guint32 idx)
+{
+	struct die_node *node = get_node(model, idx);
+	struct die_node new_node = {
+		.parent = idx,
+		.child = NO_NODE,
+		.kind = NODE_DIE,
+	};
+	guint32 first = model->nodes->len;
+	Dwarf_Die die, child;
+
+	if (dwarf_files_die(model->files, node->off, &die) &&
+	    dwarf_child(&die, &child) == 0) {
+		do {
+			new_node.off = dwarf_files_offset(model->files, &child);
+			g_array_append_val(model->nodes, new_node);
+			index_insert(model, model->nodes->len - 1);
+		}
+		while (dwarf_siblingof(&child, &child) == 0);
+	}
+
+	/* the array might be reallocated */
+	get_node(model, idx)->child = first;
+}
+
+/* add (partial) units in the alternate file */
+static void expand_alt_node(DwarviewDieModel *model, guint32 idx)
+{
+	struct die_node new_node = {
+		.parent = idx,
+		.child = NO_NODE,
+		.kind = NODE_CU,
+	};
+	Dwarf *alt = dwarf_files_alt(model->files);
+	guint32 first = model->nodes->len;
+	Dwarf_Off off = 0;
+	Dwarf_Off next;
+	size_t sz;
+
+	while (alt && dwarf_nextcu(alt, off, &next, &sz, NULL, NULL, NULL) == 0) {
+		new_node.off = die_file_off(DIE_FILE_ALT, off + sz);
+		g_array_append_val(model->nodes, new_node);
+		index_insert(model, model->nodes->len - 1);
+		off = next;
+	}
+
+	get_node(model, idx)->child = first;
+}
+
+static void expand_node(DwarviewDieModel *model, guint32 idx)
+{
+	struct die_node *node = get_node(model, idx);
+
+	if (node->child != NO_NODE)
+		return;
+
+	if (node->kind == NODE_CU)
+		expand_cu_node(model, idx);
+	else if (node->kind == NODE_ALT)
+		expand_alt_node(model, idx);
+	else
+		expand_die_node(model, idx);
+}
+
+static char *die_tag_markup(Dwarf_Die *die)
+{
+	int tag = dwarf_tag(die);
+
+	if (dwarf_hasattr(die, DW_AT_declaration) || tag == DW_TAG_imported_declaration) {
+		const char *decl = "(decl)";
+
+		if (tag == DW_TAG_imported_declaration)
+			decl = "";
+
+		return g_strdup_printf("<span foreground=\"grey\">%s %s</span>",
+				       dwarview_tag_name(tag), decl);
+	}
+
+	return g_strdup(dwarview_tag_name(tag));
+}
+
+static GtkTreeModelFlags die_model_get_flags(GtkTreeModel *tree_model)
+{
+	return GTK_TREE_MODEL_ITERS_PERSIST;
+}
+
+static gint die_model_get_n_columns(GtkTreeModel *tree_model)
+{
+	return DIE_MODEL_NR_COLUMNS;
+}
+
+static GType die_model_get_column_type(GtkTreeModel *tree_model, gint index)
+{
+	return G_TYPE_STRING;
+}
+
+static gboolean die_model_get_iter(GtkTreeModel *tree_model, GtkTreeIter *iter,
+				   GtkTreePath *path)
+{
+	DwarviewDieModel *model = DWARVIEW_DIE_MODEL(tree_model);
+	gint *indices;
+	gint depth, i;
+	guint32 idx;
+
+	indices = gtk_tree_path_get_indices_with_depth(path, &depth);
+	if (depth == 0 || indices[0] < 0 || (guint32)indices[0] >= model->nr_cu)
+		return FALSE;
+
+	idx = indices[0];
+	for (i = 1; i < depth; i++) {
+		if (indices[i] < 0)
+			return FALSE;
+
+		expand_node(model, idx);
+		idx = nth_child(model, idx, indices[i]);
+		if (idx == NO_NODE)
+			return FALSE;
+	}
+
+	set_iter(model, iter, idx);
+	return TRUE;
+}
+
+static GtkTreePath *die_model_get_path(GtkTreeModel *tree_model, GtkTreeIter *iter)
+{
+	DwarviewDieModel *model = DWARVIEW_DIE_MODEL(tree_model);
+	GtkTreePath *path = gtk_tree_path_new();
+	guint32 idx = iter_index(iter);
+
+	while (idx != NO_PARENT) {
+		gtk_tree_path_prepend_index(path, idx - first_sibling(model, idx));
+		idx = get_node(model, idx)->parent;
+	}
+
+	return path;
+}
+
+static void die_model_get_value(GtkTreeModel *tree_model, GtkTreeIter *iter,
+				gint column, GValue *value)
+{
+	DwarviewDieModel *model = DWARVIEW_DIE_MODEL(tree_model);
+	struct die_node *node = get_node(model, iter_index(iter));
+	Dwarf_Die die;
+
+	g_value_init(value, G_TYPE_STRING);
+
+	if (node->kind == NODE_META) {
+		if (column == DIE_MODEL_COL_TAG)
+			g_value_set_static_string(value, "meta");
+		else if (column == DIE_MODEL_COL_NAME)
+			g_value_set_static_string(value, meta_names[node->meta]);
+		else
+			g_value_set_static_string(value, "");
+		return;
+	}
+
+	if (node->kind == NODE_ALT) {
+		if (column == DIE_MODEL_COL_TAG)
+			g_value_set_static_string(value, "alt file");
+		else if (column == DIE_MODEL_COL_NAME)
+			g_value_set_string(value, dwarf_files_alt_name(model->files));
+		else
+			g_value_set_static_string(value, "");
+		return;
+	}
+
+	if (column == DIE_MODEL_COL_OFFSET) {
+		unsigned long off = die_local_off(node->off);
+
+		/* the file of other offsets is shown as a prefix */
+		if (die_file_of(node->off) == DIE_FILE_MAIN)
+			g_value_take_string(value, g_strdup_printf("%#lx", off));
+		else if (die_file_of(node->off) == DIE_FILE_ALT)
+			g_value_take_string(value, g_strdup_printf("alt:%#lx", off));
+		else
+			g_value_take_string(value, g_strdup_printf("dwo:%#lx", off));
+		return;
+	}
+
+	if (dwarf_files_die(model->files, node->off, &die) == NULL)
+		return;
+
+	if (column == DIE_MODEL_COL_TAG) {
+		if (node->kind == NODE_CU)
+			g_value_set_static_string(value, dwarview_tag_name(dwarf_tag(&die)));
+		else
+			g_value_take_string(value, die_tag_markup(&die));
+	}
+	else if (column == DIE_MODEL_COL_NAME) {
+		if (node->kind == NODE_CU)
+			g_value_set_string(value, dwarf_diename(&die));
+		else
+			g_value_take_string(value, model->name_fn(&die));
+	}
+}
+
+static gboolean die_model_iter_next(GtkTreeModel *tree_model, GtkTreeIter *iter)
+{
+	DwarviewDieModel *model = DWARVIEW_DIE_MODEL(tree_model);
+	guint32 idx = iter_index(iter);
+	guint32 parent = get_node(model, idx)->parent;
+
+	if (parent == NO_PARENT ? idx + 1 >= model->nr_cu :
+	    idx + 1 >= model->nodes->len || get_node(model, idx + 1)->parent != parent)
+		return FALSE;
+
+	set_iter(model, iter, idx + 1);
+	return TRUE;
+}
+
+static gboolean die_model_iter_previous(GtkTreeModel *tree_model, GtkTreeIter *iter)
+{
+	DwarviewDieModel *model = DWARVIEW_DIE_MODEL(tree_model);
+	guint32 idx = iter_index(iter);
+
+	if (idx == first_sibling(model, idx))
+		return FALSE;
+
+	set_iter(model, iter, idx - 1);
+	return TRUE;
+}
+
+static gboolean die_model_iter_nth_child(GtkTreeModel *tree_model, GtkTreeIter *iter,
+					 GtkTreeIter *parent, gint n)
+{
+	DwarviewDieModel *model = DWARVIEW_DIE_MODEL(tree_model);
+	guint32 idx;
+
+	if (n < 0)
+		return FALSE;
+
+	if (parent == NULL) {
+		if ((guint32)n >= model->nr_cu)
+			return FALSE;
+
+		set_iter(model, iter, n);
+		return TRUE;
+	}
+
+	idx = iter_index(parent);
+	expand_node(model, idx);
+
+	idx = nth_child(model, idx, n);
+	if (idx == NO_NODE)
+		return FALSE;
+
+	set_iter(model, iter, idx);
+	return TRUE;
+}
+
+static gboolean die_model_iter_children(GtkTreeModel *tree_model, GtkTreeIter *iter,
+					GtkTreeIter *parent)
+{
+	return die_model_iter_nth_child(tree_model, iter, parent, 0);
+}
+
+static gboolean die_model_iter_has_child(GtkTreeModel *tree_model, GtkTreeIter *iter)
+{
+	DwarviewDieModel *model = DWARVIEW_DIE_MODEL(tree_model);
+	guint32 idx = iter_index(iter);
+	struct die_node *node = get_node(model, idx);
+	Dwarf_Die die, child;
+
+	if (node->kind == NODE_CU || node->kind == NODE_ALT)
+		return TRUE;
+	if (node->child != NO_NODE)
+		return nth_child(model, idx, 0) != NO_NODE;
+
+	/* do not read all children just to show the expander */
+	if (dwarf_files_die(model->files, node->off, &die) == NULL)
+		return FALSE;
+	return dwarf_haschildren(&die) && dwarf_child(&die, &child) == 0;
+}
+
+static gint die_model_iter_n_children(GtkTreeModel *tree_model, GtkTreeIter *iter)
+{
+	DwarviewDieModel *model = DWARVIEW_DIE_MODEL(tree_model);
+	guint32 idx;
+
+	if (iter == NULL)
+		return model->nr_cu;
+
+	idx = iter_index(iter);
+	expand_node(model, idx);
+	return nr_children(model, idx);
+}
+
+static gboolean die_model_iter_parent(GtkTreeModel *tree_model, GtkTreeIter *iter,
+				      GtkTreeIter *child)
+{
+	DwarviewDieModel *model = DWARVIEW_DIE_MODEL(tree_model);
+	guint32 parent = get_node(model, iter_index(child))->parent;
+
+	if (parent == NO_PARENT)
+		return FALSE;
+
+	set_iter(model, iter, parent);
+	return TRUE;
+}
+
+static void dwarview_die_model_tree_model_init(GtkTreeModelIface *iface)
+{
+	iface->get_flags       = die_model_get_flags;
+	iface->get_n_columns   = die_model_get_n_columns;
+	iface->get_column_type = die_model_get_column_type;
+	iface->get_iter        = die_model_get_iter;
+	iface->get_path        = die_model_get_path;
+	iface->get_value       = die_model_get_value;
+	iface->iter_next       = die_model_iter_next;
+	iface->iter_previous   = die_model_iter_previous;
+	iface->iter_children   = die_model_iter_children;
+	iface->iter_has_child  = die_model_iter_has_child;
+	iface->iter_n_children = die_model_iter_n_children;
+	iface->iter_nth_child  = die_model_iter_nth_child;
+	iface->iter_parent     = die_model_iter_parent;
+}
+
+static void dwarview_die_model_finalize(GObject *object)
+{
+	DwarviewDieModel *model = DWARVIEW_DIE_MODEL(object);
+
+	pr_dbg("die model: %u nodes (%zu bytes), index: %u entries (%zu bytes)\n",
+	       model->nodes->len, model->nodes->len * sizeof(struct die_node),
+	       model->nr_index, (model->index_mask + 1) * sizeof(*model->index));
+
+	g_array_free(model->nodes, TRUE);
+	g_free(model->index);
+
+	G_OBJECT_CLASS(dwarview_die_model_parent_class)->finalize(object);
+}
+
+static void dwarview_die_model_class_init(DwarviewDieModelClass *klass)
+{
+	G_OBJECT_CLASS(klass)->finalize = dwarview_die_model_finalize;
+}
+
+static void dwarview_die_model_init(DwarviewDieModel *model)
+{
+	model->nodes = g_array_new(FALSE, FALSE, sizeof(struct die_node));
+	model->stamp = g_random_int();
+
+	model->index_mask = 1023;
+	model->index = g_malloc((model->index_mask + 1) * sizeof(*model->index));
+	memset(model->index, 0xff, (model->index_mask + 1) * sizeof(*model->index));
+}
+
+/* @cu_offs is the CU DIE offsets if known already (e.g. from the cache) */
+DwarviewDieModel *dwarview_die_model_new(struct dwarf_files *files, die_name_fn_t name_fn,
+					 const Dwarf_Off *cu_offs, guint nr_cu)
+{
+	DwarviewDieModel *model = g_object_new(DWARVIEW_TYPE_DIE_MODEL, NULL);
+	struct die_node node = {
+		.parent = NO_PARENT,
+		.child = NO_NODE,
+		.kind = NODE_CU,
+	};
+	Dwarf *dwarf = dwarf_files_main(files);
+	Dwarf_Off off = 0;
+	Dwarf_Off next;
+	size_t sz;
+	guint i;
+
+	model->files = files;
+	model->name_fn = name_fn;
+
+	for (i = 0; cu_offs && i < nr_cu; i++) {
+		node.off = cu_offs[i];
+		g_array_append_val(model->nodes, node);
+		index_insert(model, model->nodes->len - 1);
+	}
+
+	/* read CU headers only */
+	while (cu_offs == NULL &&
+	       dwarf_nextcu(dwarf, off, &next, &sz, NULL, NULL, NULL) == 0) {
+		node.off = off + sz;
+		g_array_append_val(model->nodes, node);
+		index_insert(model, model->nodes->len - 1);
+		off = next;
+	}
+
+	/* it sorts after all CUs in the main file */
+	if (dwarf_files_alt_name(files)) {
+		node.off = die_file_off(DIE_FILE_ALT, 0);
+		node.kind = NODE_ALT;
+		g_array_append_val(model->nodes, node);
+	}
+	model->nr_cu = model->nodes->len;
+
+	return model;
+}
+
+/* returns the (unified) DIE offset of the row, or -1 if it has no DIE */
+Dwarf_Off dwarview_die_model_get_offset(DwarviewDieModel *model, GtkTreeIter *iter)
+{
+	struct die_node *node = get_node(model, iter_index(iter));
+
+	if (node->kind == NODE_META || node->kind == NODE_ALT)
+		return -1;
+	return node->off;
+}
+
+/* find the child of @idx which contains @off: the last one starts before it */
+static guint32 find_child(DwarviewDieModel *model, guint32 idx, Dwarf_Off off)
+{
+	guint32 lo = 0;
+	guint32 hi = nr_children(model, idx);
+	guint32 first = get_node(model, idx)->child;
+
+	while (lo < hi) {
+		guint32 mid = (lo + hi) / 2;
+
+		if (get_node(model, first + mid)->off <= off)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	return lo ? first + lo - 1 : NO_NODE;
+}
+
+/*
+ * Nodes already read are found in the index.  Otherwise, as DIEs are
+ * stored in pre-order, a subtree covers a contiguous range of offsets.
+ * Descend into the child which starts right before the offset at each
+ * level and only read DIEs along the way.  The path is built from the
+ * parent links at the end.
+ *
+ * DIEs in a split unit are under the skeleton CU, so it starts from
+ * the skeleton.  The offsets of its children are in the same file.
+ */
+GtkTreePath *dwarview_die_model_lookup(DwarviewDieModel *model, Dwarf_Off off)
+{
+	GtkTreeIter iter;
+	Dwarf_Off top = off;
+	guint32 lo = 0;
+	guint32 hi = model->nr_cu;
+	guint32 idx;
+
+	idx = index_find(model, off);
+	if (idx != NO_NODE)
+		goto found;
+
+	if (die_file_of(off) >= DIE_FILE_SPLIT) {
+		Dwarf_Die die, skel;
+
+		if (dwarf_files_die(model->files, off, &die) == NULL ||
+		    dwarf_cu_info(die.cu, NULL, NULL, NULL, &skel, NULL, NULL, NULL) != 0 ||
+		    skel.cu == NULL)
+			return NULL;
+		top = dwarf_files_offset(model->files, &skel);
+	}
+
+	while (lo < hi) {
+		guint32 mid = (lo + hi) / 2;
+
+		if (get_node(model, mid)->off <= top)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	if (lo == 0)
+		return NULL;
+
+	idx = lo - 1;
+	while (get_node(model, idx)->off != off) {
+		struct die_node *node;
+
+		expand_node(model, idx);
+		node = get_node(model, idx);
+
+		if (node->kind == NODE_CU) {
+			guint32 best = NO_NODE;
+			guint32 meta;
+
+			/* top-level DIEs are split into meta groups */
+			for (meta = node->child; meta < node->child + NR_META; meta++) {
+				guint32 cand = find_child(model, meta, off);
+
+				if (cand == NO_NODE)
+					continue;
+				if (best == NO_NODE ||
+				    get_node(model, cand)->off > get_node(model, best)->off)
+					best = cand;
+			}
+			idx = best;
+		}
+		else {
+			idx = find_child(model, idx, off);
+		}
+
+		if (idx == NO_NODE)
+			return NULL;
+	}
+
+found:
+	set_iter(model, &iter, idx);
+	return die_model_get_path(GTK_TREE_MODEL(model), &iter);
+}
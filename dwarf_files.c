@@ -0,0 +1,194 @@
+/*
+ * dwarview - DWARF debug info viewer
+ *
+ * Copyright (C) 2016  Namhyung Kim <namhyung@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 or later of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+/*
+ * Files which DIEs can come from.
+ *
+ * Besides the main file, DIEs can be in the alternate file made by dwz
+ * (DW_FORM_GNU_ref_alt or the .debug_sup file of DWARF 5) and in split
+ * units (.dwo files or a .dwp package) of skeleton CUs.  libdw opens
+ * those files by itself when they're accessed first, and we never ask
+ * for them until a reference is followed or a skeleton CU is expanded
+ * (or the search index has entries from the split unit).
+ *
+ * A DIE offset is only unique in its own file, so the upper bits of the
+ * offset are used to tell the file (see die_file_off()).  The main file
+ * is 0 so its offsets are used as is.  Other files are numbered as they
+ * are seen.
+ */
+
+#include <string.h>
+
+#include "dwarview.h"
+
+struct dwarf_files {
+	GPtrArray *dwarfs;	/* file number -> Dwarf */
+	GHashTable *numbers;	/* Dwarf -> file number */
+	bool alt_checked;
+};
+
+struct dwarf_files *dwarf_files_new(Dwarf *dwarf)
+{
+	struct dwarf_files *files = g_malloc0(sizeof(*files));
+
+	files->dwarfs = g_ptr_array_new();
+	files->numbers = g_hash_table_new(g_direct_hash, g_direct_equal);
+
+	/* the alternate file is not loaded yet */
+	g_ptr_array_add(files->dwarfs, dwarf);
+	g_ptr_array_add(files->dwarfs, NULL);
+	g_hash_table_insert(files->numbers, dwarf, GUINT_TO_POINTER(DIE_FILE_MAIN));
+	return files;
+}
+
+/* the Dwarf handles are owned by libdw, they go away with the main one */
+void dwarf_files_free(struct dwarf_files *files)
+{
+	pr_dbg("dwarf files: %u files used\n", files->dwarfs->len);
+
+	g_ptr_array_free(files->dwarfs, TRUE);
+	g_hash_table_destroy(files->numbers);
+	g_free(files);
+}
+
+Dwarf *dwarf_files_main(struct dwarf_files *files)
+{
+	return files->dwarfs->pdata[DIE_FILE_MAIN];
+}
+
+/* returns the file name of the alternate file, or NULL if it has none */
+const char *dwarf_files_alt_name(struct dwarf_files *files)
+{
+	Elf *elf = dwarf_getelf(dwarf_files_main(files));
+	Elf_Data *data;
+
+	/* a file name and the build-id */
+	data = get_elf_secdata(elf, ".gnu_debugaltlink");
+	if (data && data->d_size && memchr(data->d_buf, '\0', data->d_size))
+		return data->d_buf;
+
+	/* version (2), is_supplementary (1) and a file name */
+	data = get_elf_secdata(elf, ".debug_sup");
+	if (data && data->d_size > 3 && memchr(data->d_buf + 3, '\0', data->d_size - 3))
+		return data->d_buf + 3;
+
+	return NULL;
+}
+
+/* libdw opens the alternate file when it's asked first */
+Dwarf *dwarf_files_alt(struct dwarf_files *files)
+{
+	Dwarf *alt;
+
+	if (files->alt_checked)
+		return files->dwarfs->pdata[DIE_FILE_ALT];
+
+	files->alt_checked = true;
+
+	alt = dwarf_getalt(dwarf_files_main(files));
+	if (alt == NULL)
+		return NULL;
+
+	pr_dbg("dwarf files: alternate file %s\n", dwarf_files_alt_name(files) ?: "(unknown)");
+
+	files->dwarfs->pdata[DIE_FILE_ALT] = alt;
+	g_hash_table_insert(files->numbers, alt, GUINT_TO_POINTER(DIE_FILE_ALT));
+	return alt;
+}
+
+static bool is_split_unit(Dwarf_Die *die)
+{
+	uint8_t unit_type;
+
+	if (dwarf_cu_info(die->cu, NULL, &unit_type, NULL, NULL, NULL, NULL, NULL) != 0)
+		return false;
+
+	return unit_type == DW_UT_split_compile || unit_type == DW_UT_split_type;
+}
+
+/*
+ * Sets @split to the CU DIE of the split unit if @cudie is a skeleton.
+ * It opens the .dwo (or .dwp) file on the first call.
+ */
+bool dwarf_files_split_unit(struct dwarf_files *files, Dwarf_Die *cudie, Dwarf_Die *split)
+{
+	uint8_t unit_type;
+
+	if (dwarf_cu_info(cudie->cu, NULL, &unit_type, NULL, split,
+			  NULL, NULL, NULL) != 0 || unit_type != DW_UT_skeleton)
+		return false;
+
+	/* libdw clears it if the split unit is not found */
+	if (split->cu == NULL) {
+		pr_dbg("dwarf files: split unit of %#lx not found\n",
+		       (unsigned long)dwarf_dieoffset(cudie));
+		return false;
+	}
+	return true;
+}
+
+/* returns the unified offset of @die, or -1 if the file is not known */
+Dwarf_Off dwarf_files_offset(struct dwarf_files *files, Dwarf_Die *die)
+{
+	Dwarf *dwarf = dwarf_cu_getdwarf(die->cu);
+	Dwarf_Off off = dwarf_dieoffset(die);
+	gpointer nr;
+
+	if (dwarf == dwarf_files_main(files))
+		return off;
+
+	if (g_hash_table_lookup_extended(files->numbers, dwarf, NULL, &nr))
+		return die_file_off(GPOINTER_TO_UINT(nr), off);
+
+	/* other DIEs should be in the alternate file */
+	if (!is_split_unit(die)) {
+		if (dwarf_files_alt(files) == dwarf)
+			return die_file_off(DIE_FILE_ALT, off);
+		return -1;
+	}
+
+	if (files->dwarfs->len >= DIE_FILE_MAX)
+		return -1;
+
+	nr = GUINT_TO_POINTER(files->dwarfs->len);
+	g_ptr_array_add(files->dwarfs, dwarf);
+	g_hash_table_insert(files->numbers, dwarf, nr);
+
+	pr_dbg("dwarf files: split file %u added\n", GPOINTER_TO_UINT(nr));
+	return die_file_off(GPOINTER_TO_UINT(nr), off);
+}
+
+/* finds the DIE at the unified offset */
+Dwarf_Die *dwarf_files_die(struct dwarf_files *files, Dwarf_Off off, Dwarf_Die *result)
+{
+	guint nr = die_file_of(off);
+	Dwarf *dwarf;
+
+	if (nr == DIE_FILE_ALT)
+		dwarf = dwarf_files_alt(files);
+	else if (nr < files->dwarfs->len)
+		dwarf = files->dwarfs->pdata[nr];
+	else
+		return NULL;
+
+	if (dwarf == NULL)
+		return NULL;
+	return dwarf_offdie(dwarf, die_local_off(off), result);
+}
@@ -17,17 +17,101 @@
  * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
  */
 
+#include <string.h>
+
 #include "dwarview.h"
 
-/* DWARF tags.  */
-struct tag_name {
-	int tag;
+/*
+ * Names of DWARF codes.
+ *
+ * Each table below maps codes to names and is the only place to add a
+ * new code.  They're looked up through a dense array indexed by the
+ * code for the standard range, and vendor extensions (lo_user..hi_user)
+ * are sorted for binary search.  Both are built on the first lookup.
+ */
+struct code_name {
+	unsigned code;
 	char *name;
 };
 
+/* codes below this are looked up directly */
+#define DENSE_CODE_MAX  256
+
+struct name_lookup {
+	const struct code_name *table;
+	unsigned nr;
+	GOnce once;
+
+	char *dense[DENSE_CODE_MAX];
+	struct code_name *sparse;	/* sorted by code */
+	unsigned nr_sparse;
+};
+
+#define NAME_LOOKUP(_table)  { .table = _table, .nr = ARRAY_SIZE(_table), .once = G_ONCE_INIT }
+
+/* vendor codes are not many, just insert them in order */
+static void add_sparse(struct name_lookup *lk, const struct code_name *cn)
+{
+	unsigned i = lk->nr_sparse;
+
+	while (i > 0 && lk->sparse[i - 1].code > cn->code)
+		i--;
+
+	/* the first one in the table wins, as in a linear search */
+	if (i > 0 && lk->sparse[i - 1].code == cn->code)
+		return;
+
+	memmove(&lk->sparse[i + 1], &lk->sparse[i], (lk->nr_sparse - i) * sizeof(*cn));
+	lk->sparse[i] = *cn;
+	lk->nr_sparse++;
+}
+
+static gpointer build_lookup(gpointer data)
+{
+	struct name_lookup *lk = data;
+	unsigned i;
+
+	lk->sparse = g_new(struct code_name, lk->nr);
+
+	for (i = 0; i < lk->nr; i++) {
+		const struct code_name *cn = &lk->table[i];
+
+		if (cn->code >= DENSE_CODE_MAX)
+			add_sparse(lk, cn);
+		else if (lk->dense[cn->code] == NULL)
+			lk->dense[cn->code] = cn->name;
+	}
+	return NULL;
+}
+
+static char *lookup_name(struct name_lookup *lk, unsigned code)
+{
+	unsigned lo, hi;
+
+	g_once(&lk->once, build_lookup, lk);
+
+	if (code < DENSE_CODE_MAX)
+		return lk->dense[code] ?: "unknown";
+
+	lo = 0;
+	hi = lk->nr_sparse;
+	while (lo < hi) {
+		unsigned mid = (lo + hi) / 2;
+
+		if (lk->sparse[mid].code == code)
+			return lk->sparse[mid].name;
+		if (lk->sparse[mid].code < code)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return "unknown";
+}
+
+/* DWARF tags.  */
 #define DWARF_TAG(_t)  { DW_TAG_##_t, #_t }
 
-static const struct tag_name tag_names[] = {
+static const struct code_name tag_names[] = {
 	DWARF_TAG(array_type),
 	DWARF_TAG(class_type),
 	DWARF_TAG(entry_point),
@@ -120,27 +204,18 @@ static const struct tag_name tag_names[] = {
 
 #undef DWARF_TAG
 
+static struct name_lookup tag_lookup = NAME_LOOKUP(tag_names);
+
 char *dwarview_tag_name(int tag)
 {
-	unsigned i;
-
-	for (i = 0; i < ARRAY_SIZE(tag_names); i++)
-		if (tag_names[i].tag == tag)
-			return tag_names[i].name;
-
-	return "unknown";
+	return lookup_name(&tag_lookup, (unsigned)tag);
 }
 
 
 /* DWARF attributes encodings.  */
-struct attr_name {
-	unsigned code;
-	char *name;
-};
-
 #define DWARF_ATTR(_a)  { DW_AT_##_a, #_a }
 
-static const struct attr_name attr_names[] = {
+static const struct code_name attr_names[] = {
 	DWARF_ATTR(sibling),
 	DWARF_ATTR(location),
 	DWARF_ATTR(name),
@@ -337,26 +412,17 @@ static const struct attr_name attr_names[] = {
 
 #undef DWARF_ATTR
 
+static struct name_lookup attr_lookup = NAME_LOOKUP(attr_names);
+
 char *dwarview_attr_name(unsigned int attr)
 {
-	unsigned i;
-
-	for (i = 0; i < ARRAY_SIZE(attr_names); i++)
-		if (attr_names[i].code == attr)
-			return attr_names[i].name;
-
-	return "unknown";
+	return lookup_name(&attr_lookup, attr);
 }
 
 /* DWARF form encodings.  */
-struct form_name {
-	unsigned form;
-	char *name;
-};
-
 #define DWARF_FORM(_f)  { DW_FORM_##_f, #_f }
 
-static const struct form_name form_names[] = {
+static const struct code_name form_names[] = {
 	DWARF_FORM(addr),
 	DWARF_FORM(block2),
 	DWARF_FORM(block4),
@@ -410,58 +476,40 @@ static const struct form_name form_names[] = {
 	DWARF_FORM(GNU_strp_alt),
 };
 
+static struct name_lookup form_lookup = NAME_LOOKUP(form_names);
+
 char *dwarview_form_name(unsigned int form)
 {
-	unsigned i;
-
-	for (i = 0; i < ARRAY_SIZE(form_names); i++)
-		if (form_names[i].form == form)
-			return form_names[i].name;
-
-	return "unknown";
+	return lookup_name(&form_lookup, form);
 }
 
 #undef DWARF_FORM
 
 
 /* DWARF inline encodings. */
-struct inline_name {
-	unsigned code;
-	char *name;
-};
-
 #define DWARF_INLINE(_inl)  { DW_INL_##_inl, #_inl }
 
-static const struct inline_name inline_names[] = {
+static const struct code_name inline_names[] = {
 	DWARF_INLINE(not_inlined),
 	DWARF_INLINE(inlined),
 	DWARF_INLINE(declared_not_inlined),
 	DWARF_INLINE(declared_inlined),
 };
 
+static struct name_lookup inline_lookup = NAME_LOOKUP(inline_names);
+
 char *dwarview_inline_name(unsigned int code)
 {
-	unsigned i;
-
-	for (i = 0; i < ARRAY_SIZE(inline_names); i++)
-		if (inline_names[i].code == code)
-			return inline_names[i].name;
-
-	return "unknown";
+	return lookup_name(&inline_lookup, code);
 }
 
 #undef DWARF_INLINE
 
 /* DWARF language encodings. */
-struct lang_name {
-	unsigned code;
-	char *name;
-};
-
 #define DWARF_LANGUAGE(_lang)  { DW_LANG_##_lang, #_lang }
 #define DWARF_LANG_Cpp(pre_, _year, name)  { DW_LANG_##pre_##C_plus_plus##_year, name }
 
-static const struct lang_name language_names[] = {
+static const struct code_name language_names[] = {
 	DWARF_LANGUAGE(C89),
 	DWARF_LANGUAGE(C),
 	DWARF_LANGUAGE(Ada83),
@@ -499,15 +547,11 @@ static const struct lang_name language_names[] = {
 	{ 0x25, "BLISS" },
 };
 
+static struct name_lookup language_lookup = NAME_LOOKUP(language_names);
+
 char *dwarview_language_name(unsigned int code)
 {
-	unsigned i;
-
-	for (i = 0; i < ARRAY_SIZE(language_names); i++)
-		if (language_names[i].code == code)
-			return language_names[i].name;
-
-	return "unknown";
+	return lookup_name(&language_lookup, code);
 }
 
 #undef DWARF_LANGUAGE
@@ -25,15 +25,274 @@
 #include <elfutils/libdw.h>
 #include <elfutils/libdwfl.h>
 
+#include <stdio.h>
+#include <stdbool.h>
+
 #include <gtk/gtk.h>
 
 
 #define ARRAY_SIZE(a)  (sizeof(a) / sizeof(a[0]))
 
+/* set by DWARVIEW_DEBUG environment variable */
+extern bool dwarview_debug;
+
+#define pr_dbg(fmt, ...)						\
+	do {								\
+		if (dwarview_debug)					\
+			fprintf(stderr, fmt, ##__VA_ARGS__);		\
+	} while (0)
+
 char *dwarview_tag_name(int tag);
 char *dwarview_attr_name(unsigned int attr);
 char *dwarview_form_name(unsigned int form);
 char *dwarview_inline_name(unsigned int code);
 char *dwarview_language_name(unsigned int code);
 
+/* die_info.c */
+int dwarview_open(const char *path, Dwarf **dwarfp, char **debug_path, char **build_id);
+Elf_Data *get_elf_secdata(Elf *elf, const char *sec_name);
+char *die_location(Dwarf_Die *die);
+void file_name_reset(void);
+const char *type_name(Dwarf_Die *die);
+void type_name_stats(guint64 *hit, guint64 *miss);
+void type_name_reset(void);
+gchar *die_name(Dwarf_Die *die);
+const char *die_name_ref(Dwarf_Die *die);
+gchar *attr_value(Dwarf_Die *diep, Dwarf_Attribute *attr, unsigned long *raw_value);
+guint64 type_signature(Dwarf_Die *die);
+
+/* expr.c */
+struct expr_ctx {
+	unsigned machine;	/* ELF e_machine for register names */
+	bool big_endian;
+	int addr_size;
+	int offset_size;
+};
+
+void expr_ctx_init(struct expr_ctx *ctx, Dwarf_Die *die);
+void expr_print(struct expr_ctx *ctx, const unsigned char *data, size_t len, GString *out);
+gchar *expr_print_loclist(struct expr_ctx *ctx, Dwarf_Attribute *attr);
+
+/* dwarf_files.c */
+enum die_file {
+	DIE_FILE_MAIN,
+	DIE_FILE_ALT,		/* dwz alternate file */
+	DIE_FILE_SPLIT,		/* the first split unit file */
+};
+
+/* unified DIE offsets have the file number in the upper bits */
+#define DIE_FILE_SHIFT  40
+#define DIE_FILE_MAX    ((1U << (64 - DIE_FILE_SHIFT)) - 1)
+
+#define die_file_of(off)         ((guint)((off) >> DIE_FILE_SHIFT))
+#define die_local_off(off)       ((off) & ((1ULL << DIE_FILE_SHIFT) - 1))
+#define die_file_off(nr, off)    ((Dwarf_Off)(nr) << DIE_FILE_SHIFT | (off))
+
+struct dwarf_files;
+
+struct dwarf_files *dwarf_files_new(Dwarf *dwarf);
+void dwarf_files_free(struct dwarf_files *files);
+Dwarf *dwarf_files_main(struct dwarf_files *files);
+const char *dwarf_files_alt_name(struct dwarf_files *files);
+Dwarf *dwarf_files_alt(struct dwarf_files *files);
+bool dwarf_files_split_unit(struct dwarf_files *files, Dwarf_Die *cudie, Dwarf_Die *split);
+Dwarf_Off dwarf_files_offset(struct dwarf_files *files, Dwarf_Die *die);
+Dwarf_Die *dwarf_files_die(struct dwarf_files *files, Dwarf_Off off, Dwarf_Die *result);
+
+/* demangle.c */
+void setup_demangler(void);
+void finish_demangler(void);
+bool demangler_enabled(void);
+int demangle(const char *input, char *output, int outlen);
+void demangle_set_notify(GSourceFunc fn, gpointer data);
+void demangle_set_sync(bool sync);
+void demangle_flush(void);
+void demangle_reset(void);
+bool demangle_pending(void);
+bool demangle_external_name(const char *name);
+
+/* die_model.c */
+enum die_model_column {
+	DIE_MODEL_COL_OFFSET,
+	DIE_MODEL_COL_TAG,
+	DIE_MODEL_COL_NAME,
+	DIE_MODEL_NR_COLUMNS,
+};
+
+typedef gchar *(*die_name_fn_t)(Dwarf_Die *die);
+
+#define DWARVIEW_TYPE_DIE_MODEL  (dwarview_die_model_get_type())
+G_DECLARE_FINAL_TYPE(DwarviewDieModel, dwarview_die_model, DWARVIEW, DIE_MODEL, GObject)
+
+DwarviewDieModel *dwarview_die_model_new(struct dwarf_files *files, die_name_fn_t name_fn,
+					 const Dwarf_Off *cu_offs, guint nr_cu);
+GtkTreePath *dwarview_die_model_lookup(DwarviewDieModel *model, Dwarf_Off off);
+Dwarf_Off dwarview_die_model_get_offset(DwarviewDieModel *model, GtkTreeIter *iter);
+
+/* loader.c */
+enum index_kind {
+	INDEX_FUNC,
+	INDEX_VAR,
+	INDEX_TYPE,
+};
+
+struct index_entry {
+	gchar *name;		/* allocated, or NULL if @str is used */
+	const char *str;	/* name in the file, valid until it's closed */
+	Dwarf_Off off;
+	Dwarf_Off skel;		/* skeleton CU DIE if @off is in its split unit, or 0 */
+	int kind;
+	guint64 sig;		/* type signature for INDEX_TYPE */
+};
+
+struct index_batch {
+	GArray *items;		/* struct index_entry */
+	size_t bytes;		/* size of CUs finished */
+	bool last;		/* the worker is done */
+	bool error;
+};
+
+struct dwarview_loader;
+
+struct dwarview_loader *loader_new(Dwarf *dwarf, const char *path,
+				   die_name_fn_t name_fn, bool types_only);
+struct index_batch *loader_pop(struct dwarview_loader *ld);
+bool loader_done(struct dwarview_loader *ld);
+void loader_destroy(struct dwarview_loader *ld);
+void loader_free_batch(struct index_batch *batch);
+
+/* cache.c */
+struct search_item {
+	const char *name;
+	Dwarf_Off off;
+};
+
+struct index_cache;
+struct type_index;
+
+struct index_cache *index_cache_open(const char *build_id, size_t debug_info_size);
+void index_cache_close(struct index_cache *cache);
+const Dwarf_Off *index_cache_cus(struct index_cache *cache, guint *nr_cu);
+guint index_cache_nr_entry(struct index_cache *cache);
+const char *index_cache_entry(struct index_cache *cache, guint idx,
+			      Dwarf_Off *off, int *kind, guint64 *sig);
+bool index_cache_save(const char *build_id, size_t debug_info_size, Dwarf *dwarf,
+		      GArray *funcs, GArray *vars, struct type_index *types);
+
+/* name_index.c */
+struct name_index;
+struct name_query;
+
+#define NAME_TOP_K  256  /* names in the result of ranked (fuzzy) search */
+
+struct name_index *name_index_new(GPtrArray *items);
+void name_index_free(struct name_index *idx);
+GPtrArray *name_index_search(struct name_index *idx, struct name_query *query,
+			     const gint *cancel, GArray *scores);
+
+/* matcher.c */
+enum match_mode {
+	MATCH_GLOB,
+	MATCH_REGEX,
+	MATCH_FUZZY,
+};
+
+struct name_query *name_query_new(const char *pattern, int mode);
+void name_query_free(struct name_query *q);
+int name_query_mode(struct name_query *q);
+size_t name_query_prefix(struct name_query *q, const char **prefix);
+gchar **name_query_literals(struct name_query *q);
+guint64 name_query_mask(struct name_query *q);
+int name_query_score(struct name_query *q, const char *name);
+bool name_query_match(struct name_query *q, const char *name);
+guint64 name_char_mask(const char *name);
+
+/* type_index.c */
+struct type_index *type_index_new(void);
+void type_index_free(struct type_index *idx);
+void type_index_add(struct type_index *idx, const char *name, guint64 sig, Dwarf_Off off);
+GPtrArray *type_index_items(struct type_index *idx);
+GArray *type_index_copies(struct search_item *item);
+void type_index_foreach(struct type_index *idx,
+			void (*fn)(const char *name, guint64 sig, Dwarf_Off off, void *arg),
+			void *arg);
+
+/* accel.c */
+GArray *accel_read(Dwarf *dwarf);
+void accel_free(GArray *entries);
+bool accel_resolve(Dwarf_Die *cudie, const char *name, Dwarf_Die *result);
+
+/* addr_index.c */
+struct addr_index;
+
+struct addr_index *addr_index_new(Dwarf *dwarf);
+void addr_index_free(struct addr_index *idx);
+bool addr_index_find_cu(struct addr_index *idx, Dwarf_Addr addr, Dwarf_Off *cu_off);
+int addr_index_lookup(struct addr_index *idx, Dwarf_Addr addr,
+		      Dwarf_Off *chain, int max);
+
+/* line_index.c */
+struct line_info {
+	Dwarf_Addr addr;
+	const char *file;
+	guint32 line;
+	guint16 column;
+	guint8 view;		/* number of rows before it at the same address */
+	guint8 is_stmt:1;
+	guint8 end_sequence:1;
+};
+
+struct line_index;
+
+struct line_index *line_index_new(Dwarf *dwarf, struct addr_index *addrs);
+void line_index_free(struct line_index *idx);
+const struct line_info *line_index_cu(struct line_index *idx, Dwarf_Off cu_off, guint *nr_row);
+const struct line_info *line_index_lookup(struct line_index *idx, Dwarf_Addr addr);
+GPtrArray *line_index_addrs(struct line_index *idx, const char *file, guint32 line);
+
+/* layout.c */
+#define CACHELINE_SIZE  64
+
+struct layout_summary {
+	gchar *name;
+	int tag;
+	Dwarf_Off off;
+	guint64 size;
+	guint64 wasted;		/* holes and padding, in bytes */
+	guint64 padding;
+	guint nr_holes;
+};
+
+struct struct_layout;
+
+struct struct_layout *struct_layout_new(Dwarf_Die *die);
+void struct_layout_free(struct struct_layout *layout);
+void struct_layout_summary(struct struct_layout *layout, struct layout_summary *sum);
+gchar *struct_layout_print(struct struct_layout *layout);
+GPtrArray *layout_report(const char *path, guint top_n, const gint *cancel);
+
+/* export.c */
+enum export_format {
+	EXPORT_JSON,		/* one object per line */
+	EXPORT_BINARY,		/* length-prefixed records */
+};
+
+int export_dies(const char *path, enum export_format format, FILE *out, guint64 *nr_die);
+
+/* walker.c */
+enum walk_action {
+	WALK_CONTINUE,		/* visit children (if any) and siblings */
+	WALK_SKIP,		/* do not visit children */
+	WALK_STOP,		/* stop walking */
+};
+
+/* @depth is 1 for the children of the starting DIE */
+typedef int (*die_visit_fn)(Dwarf_Die *die, int depth, void *arg);
+
+bool die_walk(Dwarf_Die *parent, die_visit_fn visit, void *arg);
+
+/* cli.c */
+bool cli_requested(int argc, char *argv[]);
+int dwarview_cli(int argc, char *argv[]);
+
 #endif /* DWARVIEW_H */
@@ -0,0 +1,435 @@
+/*
+ * dwarview - DWARF debug info viewer
+ *
+ * Copyright (C) 2016  Namhyung Kim <namhyung@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 or later of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+/*
+ * Export of the whole DIE tree.
+ *
+ * Every DIE is written with its offset, depth (0 for CU DIEs), tag and
+ * attributes (with the values shown in the GUI) in the order of the
+ * file, either as JSON (one object per line) or in a binary format:
+ *
+ *   header:  "DWVX", version (1 byte), 3 bytes of zero
+ *   record:  ULEB128 length of the rest of the record
+ *            ULEB128 offset, depth, tag and number of attributes
+ *            for each attribute:
+ *              ULEB128 name, form, raw value and length of the value
+ *              value string (not NUL-terminated)
+ *
+ * CUs are rendered by worker threads, each with its own Dwarf handle,
+ * into chunks which the calling thread writes out in the order of CUs.
+ * Only a window of CUs after the one being written can be in progress,
+ * and a worker waits if it has too many chunks for a CU which is not
+ * written yet, so memory usage doesn't depend on the size of the file.
+ */
+
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "dwarview.h"
+
+#define EXPORT_MAGIC      "DWVX"
+#define EXPORT_VERSION    1
+
+#define CHUNK_SIZE        (256 * 1024)
+#define MAX_PENDING       4		/* chunks per CU not being written */
+#define WINDOW_PER_WORKER 2		/* CUs in progress */
+
+/* libdw keeps data of all CUs it has seen until the handle is closed */
+#define REOPEN_CUS        4096
+
+struct export_slot {
+	GQueue chunks;			/* GString, in the order of DIEs */
+	bool done;
+};
+
+struct export {
+	const char *path;
+	enum export_format format;
+	GArray *cus;			/* CU DIE offsets */
+
+	GMutex lock;
+	GCond cond;
+	struct export_slot *slots;	/* CU index % window */
+	guint window;
+	guint next_cu;			/* next CU to render */
+	guint head;			/* next CU to write */
+	bool failed;
+
+	guint64 nr_die;
+};
+
+struct export_worker {
+	struct export *ex;
+	Dwarf *dwarf;
+	int fd;
+
+	guint idx;			/* CU index being rendered */
+	Dwarf_Die *die;			/* DIE being rendered */
+	GString *chunk;
+	GString *rec;			/* record header (binary) */
+	GString *attrs;			/* attributes of a record */
+	guint nr_attr;
+	guint64 nr_die;
+};
+
+static void free_chunk(gpointer data)
+{
+	g_string_free(data, TRUE);
+}
+
+static void put_uleb128(GString *str, guint64 val)
+{
+	do {
+		guchar byte = val & 0x7f;
+
+		val >>= 7;
+		if (val)
+			byte |= 0x80;
+		g_string_append_c(str, byte);
+	}
+	while (val);
+}
+
+static void put_json_string(GString *str, const char *s)
+{
+	const unsigned char *p = (const unsigned char *)(s ?: "");
+
+	g_string_append_c(str, '"');
+	for (; *p; p++) {
+		switch (*p) {
+		case '"':
+			g_string_append(str, "\\\"");
+			break;
+		case '\\':
+			g_string_append(str, "\\\\");
+			break;
+		case '\n':
+			g_string_append(str, "\\n");
+			break;
+		case '\t':
+			g_string_append(str, "\\t");
+			break;
+		default:
+			if (*p < 0x20)
+				g_string_append_printf(str, "\\u%04x", *p);
+			else
+				g_string_append_c(str, *p);
+			break;
+		}
+	}
+	g_string_append_c(str, '"');
+}
+
+/* hands the chunk over to the writer, it might wait until the writer catches up */
+static void flush_chunk(struct export_worker *w, bool done)
+{
+	struct export *ex = w->ex;
+	struct export_slot *slot = &ex->slots[w->idx % ex->window];
+
+	g_mutex_lock(&ex->lock);
+	while (!ex->failed && w->idx != ex->head &&
+	       g_queue_get_length(&slot->chunks) >= MAX_PENDING)
+		g_cond_wait(&ex->cond, &ex->lock);
+
+	if (ex->failed || w->chunk->len == 0)
+		g_string_free(w->chunk, TRUE);
+	else
+		g_queue_push_tail(&slot->chunks, w->chunk);
+	slot->done = done;
+
+	g_cond_broadcast(&ex->cond);
+	g_mutex_unlock(&ex->lock);
+
+	w->chunk = g_string_sized_new(CHUNK_SIZE + 4096);
+}
+
+static int export_attr(Dwarf_Attribute *attr, void *arg)
+{
+	struct export_worker *w = arg;
+	unsigned name = dwarf_whatattr(attr);
+	unsigned form = dwarf_whatform(attr);
+	unsigned long raw_value;
+	gchar *val_str;
+
+	val_str = attr_value(w->die, attr, &raw_value);
+
+	if (w->ex->format == EXPORT_JSON) {
+		g_string_append(w->attrs, w->nr_attr ? ",{\"name\":" : "{\"name\":");
+		put_json_string(w->attrs, dwarview_attr_name(name));
+		g_string_append(w->attrs, ",\"form\":");
+		put_json_string(w->attrs, dwarview_form_name(form));
+		g_string_append_printf(w->attrs, ",\"raw\":%lu,\"value\":", raw_value);
+		put_json_string(w->attrs, val_str);
+		g_string_append_c(w->attrs, '}');
+	}
+	else {
+		size_t len = val_str ? strlen(val_str) : 0;
+
+		put_uleb128(w->attrs, name);
+		put_uleb128(w->attrs, form);
+		put_uleb128(w->attrs, raw_value);
+		put_uleb128(w->attrs, len);
+		g_string_append_len(w->attrs, val_str, len);
+	}
+
+	w->nr_attr++;
+	g_free(val_str);
+	return DWARF_CB_OK;
+}
+
+static int export_die(Dwarf_Die *die, int depth, void *arg)
+{
+	struct export_worker *w = arg;
+	Dwarf_Off off = dwarf_dieoffset(die);
+	int tag = dwarf_tag(die);
+
+	w->die = die;
+	w->nr_attr = 0;
+	g_string_truncate(w->attrs, 0);
+	dwarf_getattrs(die, export_attr, w, 0);
+
+	if (w->ex->format == EXPORT_JSON) {
+		g_string_append_printf(w->chunk, "{\"offset\":%lu,\"depth\":%d,\"tag\":",
+				       (unsigned long)off, depth);
+		put_json_string(w->chunk, dwarview_tag_name(tag));
+		g_string_append(w->chunk, ",\"attrs\":[");
+		g_string_append_len(w->chunk, w->attrs->str, w->attrs->len);
+		g_string_append(w->chunk, "]}\n");
+	}
+	else {
+		g_string_truncate(w->rec, 0);
+		put_uleb128(w->rec, off);
+		put_uleb128(w->rec, depth);
+		put_uleb128(w->rec, tag);
+		put_uleb128(w->rec, w->nr_attr);
+
+		put_uleb128(w->chunk, w->rec->len + w->attrs->len);
+		g_string_append_len(w->chunk, w->rec->str, w->rec->len);
+		g_string_append_len(w->chunk, w->attrs->str, w->attrs->len);
+	}
+
+	w->nr_die++;
+	if (w->chunk->len >= CHUNK_SIZE)
+		flush_chunk(w, false);
+
+	/* the writer is gone, no need to go further */
+	return w->ex->failed ? WALK_STOP : WALK_CONTINUE;
+}
+
+static bool open_dwarf(struct export_worker *w)
+{
+	if (w->dwarf)
+		dwarf_end(w->dwarf);
+	if (w->fd >= 0)
+		close(w->fd);
+
+	w->dwarf = NULL;
+	w->fd = open(w->ex->path, O_RDONLY);
+	if (w->fd >= 0)
+		w->dwarf = dwarf_begin(w->fd, DWARF_C_READ);
+	return w->dwarf != NULL;
+}
+
+static gpointer export_thread(gpointer data)
+{
+	struct export_worker *w = data;
+	struct export *ex = w->ex;
+	guint nr_cu = 0;
+
+	w->fd = -1;
+	w->chunk = g_string_sized_new(CHUNK_SIZE + 4096);
+	w->rec = g_string_sized_new(64);
+	w->attrs = g_string_sized_new(4096);
+
+	if (!open_dwarf(w)) {
+		g_mutex_lock(&ex->lock);
+		ex->failed = true;
+		g_cond_broadcast(&ex->cond);
+		g_mutex_unlock(&ex->lock);
+	}
+
+	while (w->dwarf) {
+		Dwarf_Die cudie;
+
+		g_mutex_lock(&ex->lock);
+		while (!ex->failed && ex->next_cu < ex->cus->len &&
+		       ex->next_cu >= ex->head + ex->window)
+			g_cond_wait(&ex->cond, &ex->lock);
+
+		if (ex->failed || ex->next_cu >= ex->cus->len) {
+			g_mutex_unlock(&ex->lock);
+			break;
+		}
+		w->idx = ex->next_cu++;
+		g_mutex_unlock(&ex->lock);
+
+		if (++nr_cu % REOPEN_CUS == 0 && !open_dwarf(w)) {
+			g_mutex_lock(&ex->lock);
+			ex->failed = true;
+			g_cond_broadcast(&ex->cond);
+			g_mutex_unlock(&ex->lock);
+			break;
+		}
+
+		if (dwarf_offdie(w->dwarf, g_array_index(ex->cus, Dwarf_Off, w->idx), &cudie)) {
+			/* die_walk() doesn't visit the starting DIE */
+			if (export_die(&cudie, 0, w) == WALK_CONTINUE)
+				die_walk(&cudie, export_die, w);
+		}
+		flush_chunk(w, true);
+	}
+
+	g_mutex_lock(&ex->lock);
+	ex->nr_die += w->nr_die;
+	g_mutex_unlock(&ex->lock);
+
+	if (w->dwarf)
+		dwarf_end(w->dwarf);
+	if (w->fd >= 0)
+		close(w->fd);
+
+	g_string_free(w->chunk, TRUE);
+	g_string_free(w->rec, TRUE);
+	g_string_free(w->attrs, TRUE);
+	g_free(w);
+	return NULL;
+}
+
+/* writes chunks of CUs in order as they're ready, returns false on write errors */
+static bool write_chunks(struct export *ex, FILE *out)
+{
+	g_mutex_lock(&ex->lock);
+	while (!ex->failed && ex->head < ex->cus->len) {
+		struct export_slot *slot = &ex->slots[ex->head % ex->window];
+		GString *chunk = g_queue_pop_head(&slot->chunks);
+
+		if (chunk) {
+			bool ok;
+
+			g_mutex_unlock(&ex->lock);
+			ok = fwrite(chunk->str, 1, chunk->len, out) == chunk->len;
+			g_string_free(chunk, TRUE);
+			g_mutex_lock(&ex->lock);
+
+			if (!ok)
+				ex->failed = true;
+		}
+		else if (slot->done) {
+			slot->done = false;
+			ex->head++;
+		}
+		else {
+			g_cond_wait(&ex->cond, &ex->lock);
+			continue;
+		}
+		g_cond_broadcast(&ex->cond);
+	}
+	g_mutex_unlock(&ex->lock);
+
+	return !ex->failed;
+}
+
+/*
+ * Writes all DIEs in @path to @out in @format.  It opens @path for
+ * itself like layout_report().  Returns 0 on success, or -1 if @path
+ * cannot be read or the output cannot be written.
+ */
+int export_dies(const char *path, enum export_format format, FILE *out, guint64 *nr_die)
+{
+	struct export ex = {
+		.path = path,
+		.format = format,
+	};
+	GThread **workers;
+	Dwarf *dwarf = NULL;
+	Dwarf_Off off = 0;
+	Dwarf_Off next;
+	size_t sz;
+	guint i, nr_workers;
+	bool ok;
+	int fd;
+
+	fd = open(path, O_RDONLY);
+	if (fd >= 0)
+		dwarf = dwarf_begin(fd, DWARF_C_READ);
+	if (dwarf == NULL) {
+		if (fd >= 0)
+			close(fd);
+		return -1;
+	}
+
+	ex.cus = g_array_new(FALSE, FALSE, sizeof(Dwarf_Off));
+	while (dwarf_nextcu(dwarf, off, &next, &sz, NULL, NULL, NULL) == 0) {
+		Dwarf_Off cu_off = off + sz;
+
+		g_array_append_val(ex.cus, cu_off);
+		off = next;
+	}
+
+	dwarf_end(dwarf);
+	close(fd);
+
+	if (format == EXPORT_BINARY) {
+		char header[8] = EXPORT_MAGIC;
+
+		header[4] = EXPORT_VERSION;
+		fwrite(header, 1, sizeof(header), out);
+	}
+
+	g_mutex_init(&ex.lock);
+	g_cond_init(&ex.cond);
+
+	nr_workers = MAX(MIN(g_get_num_processors(), ex.cus->len), 1);
+	ex.window = nr_workers * WINDOW_PER_WORKER;
+	ex.slots = g_new0(struct export_slot, ex.window);
+	workers = g_new0(GThread *, nr_workers);
+
+	for (i = 0; i < nr_workers; i++) {
+		struct export_worker *w = g_malloc0(sizeof(*w));
+
+		w->ex = &ex;
+		workers[i] = g_thread_new("dwarview-export", export_thread, w);
+	}
+
+	ok = write_chunks(&ex, out);
+
+	for (i = 0; i < nr_workers; i++)
+		g_thread_join(workers[i]);
+
+	if (fflush(out) != 0 || ferror(out))
+		ok = false;
+
+	pr_dbg("export: %lu DIEs in %u CUs with %u workers\n",
+	       (unsigned long)ex.nr_die, ex.cus->len, nr_workers);
+
+	if (nr_die)
+		*nr_die = ex.nr_die;
+
+	for (i = 0; i < ex.window; i++)
+		g_queue_clear_full(&ex.slots[i].chunks, free_chunk);
+
+	g_free(ex.slots);
+	g_free(workers);
+	g_cond_clear(&ex.cond);
+	g_mutex_clear(&ex.lock);
+	g_array_free(ex.cus, TRUE);
+	return ok ? 0 : -1;
+}
@@ -0,0 +1,675 @@
+/*
+ * dwarview - DWARF debug info viewer
+ *
+ * Copyright (C) 2016  Namhyung Kim <namhyung@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 or later of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+/*
+ * DWARF expression decoder.
+ *
+ * Operations are decoded by the operand encodings in op_table, so a
+ * new operation is a single line there.  Register names come from the
+ * tables of the machine (ELF e_machine) of the file.  The output goes
+ * to a GString so expressions of any length can be printed.
+ *
+ * Location lists are read by libdw, which already decoded the
+ * operations, and printed with the same table.
+ */
+
+#include <string.h>
+
+#include "dwarview.h"
+
+enum expr_operand {
+	OPND_NONE,
+	OPND_U8,
+	OPND_U16,
+	OPND_U32,
+	OPND_U64,
+	OPND_S8,
+	OPND_S16,
+	OPND_S32,
+	OPND_S64,
+	OPND_ULEB,
+	OPND_SLEB,
+	OPND_ADDR,		/* address size of the CU */
+	OPND_OFFSET,		/* offset size of the CU, a DIE offset */
+	OPND_REG,		/* ULEB128 register number */
+	OPND_TYPE,		/* ULEB128 CU-relative offset of a base type */
+	OPND_BRANCH,		/* 2-byte offset from the next operation */
+	OPND_BLOCK,		/* ULEB128 length and the bytes */
+	OPND_BLOCK1,		/* 1-byte length and the bytes */
+	OPND_EXPR,		/* ULEB128 length and a nested expression */
+};
+
+/* operations with the number in the opcode */
+enum op_family {
+	FAMILY_NONE,
+	FAMILY_LIT,
+	FAMILY_REG,
+	FAMILY_BREG,
+};
+
+struct op_desc {
+	const char *name;
+	unsigned char opnd[2];
+	unsigned char family;
+	unsigned char base;	/* first opcode of the family */
+};
+
+#define OP(_code, _name, ...)  [_code] = { _name, { __VA_ARGS__ } }
+#define OP_FAMILY(_first, _last, _name, _fam, ...)				\
+	[_first ... _last] = { _name, { __VA_ARGS__ }, _fam, _first }
+
+static const struct op_desc op_table[256] = {
+	OP(0x03, "addr", OPND_ADDR),
+	OP(0x06, "deref"),
+	OP(0x08, "const1u", OPND_U8),
+	OP(0x09, "const1s", OPND_S8),
+	OP(0x0a, "const2u", OPND_U16),
+	OP(0x0b, "const2s", OPND_S16),
+	OP(0x0c, "const4u", OPND_U32),
+	OP(0x0d, "const4s", OPND_S32),
+	OP(0x0e, "const8u", OPND_U64),
+	OP(0x0f, "const8s", OPND_S64),
+	OP(0x10, "constu", OPND_ULEB),
+	OP(0x11, "consts", OPND_SLEB),
+	OP(0x12, "dup"),
+	OP(0x13, "drop"),
+	OP(0x14, "over"),
+	OP(0x15, "pick", OPND_U8),
+	OP(0x16, "swap"),
+	OP(0x17, "rot"),
+	OP(0x18, "xderef"),
+	OP(0x19, "abs"),
+	OP(0x1a, "and"),
+	OP(0x1b, "div"),
+	OP(0x1c, "minus"),
+	OP(0x1d, "mod"),
+	OP(0x1e, "mul"),
+	OP(0x1f, "neg"),
+	OP(0x20, "not"),
+	OP(0x21, "or"),
+	OP(0x22, "plus"),
+	OP(0x23, "plus_uconst", OPND_ULEB),
+	OP(0x24, "shl"),
+	OP(0x25, "shr"),
+	OP(0x26, "shra"),
+	OP(0x27, "xor"),
+	OP(0x28, "bra", OPND_BRANCH),
+	OP(0x29, "eq"),
+	OP(0x2a, "ge"),
+	OP(0x2b, "gt"),
+	OP(0x2c, "le"),
+	OP(0x2d, "lt"),
+	OP(0x2e, "ne"),
+	OP(0x2f, "skip", OPND_BRANCH),
+	OP_FAMILY(0x30, 0x4f, "lit", FAMILY_LIT),
+	OP_FAMILY(0x50, 0x6f, "reg", FAMILY_REG),
+	OP_FAMILY(0x70, 0x8f, "breg", FAMILY_BREG, OPND_SLEB),
+	OP(0x90, "regx", OPND_REG),
+	OP(0x91, "fbreg", OPND_SLEB),
+	OP(0x92, "bregx", OPND_REG, OPND_SLEB),
+	OP(0x93, "piece", OPND_ULEB),
+	OP(0x94, "deref_size", OPND_U8),
+	OP(0x95, "xderef_size", OPND_U8),
+	OP(0x96, "nop"),
+	OP(0x97, "push_object_address"),
+	OP(0x98, "call2", OPND_U16),
+	OP(0x99, "call4", OPND_U32),
+	OP(0x9a, "call_ref", OPND_OFFSET),
+	OP(0x9b, "form_tls_address"),
+	OP(0x9c, "call_frame_cfa"),
+	OP(0x9d, "bit_piece", OPND_ULEB, OPND_ULEB),
+	OP(0x9e, "implicit_value", OPND_BLOCK),
+	OP(0x9f, "stack_value"),
+	OP(0xa0, "implicit_pointer", OPND_OFFSET, OPND_SLEB),
+	OP(0xa1, "addrx", OPND_ULEB),
+	OP(0xa2, "constx", OPND_ULEB),
+	OP(0xa3, "entry_value", OPND_EXPR),
+	OP(0xa4, "const_type", OPND_TYPE, OPND_BLOCK1),
+	OP(0xa5, "regval_type", OPND_REG, OPND_TYPE),
+	OP(0xa6, "deref_type", OPND_U8, OPND_TYPE),
+	OP(0xa7, "xderef_type", OPND_U8, OPND_TYPE),
+	OP(0xa8, "convert", OPND_TYPE),
+	OP(0xa9, "reinterpret", OPND_TYPE),
+
+	/* GNU extensions.  */
+	OP(0xe0, "GNU_push_tls_address"),
+	OP(0xf0, "GNU_uninit"),
+	OP(0xf2, "GNU_implicit_pointer", OPND_OFFSET, OPND_SLEB),
+	OP(0xf3, "GNU_entry_value", OPND_EXPR),
+	OP(0xf4, "GNU_const_type", OPND_TYPE, OPND_BLOCK1),
+	OP(0xf5, "GNU_regval_type", OPND_REG, OPND_TYPE),
+	OP(0xf6, "GNU_deref_type", OPND_U8, OPND_TYPE),
+	OP(0xf7, "GNU_convert", OPND_TYPE),
+	OP(0xf9, "GNU_reinterpret", OPND_TYPE),
+	OP(0xfa, "GNU_parameter_ref", OPND_U32),
+	OP(0xfb, "GNU_addr_index", OPND_ULEB),
+	OP(0xfc, "GNU_const_index", OPND_ULEB),
+	OP(0xfd, "GNU_variable_value", OPND_OFFSET),
+};
+
+#undef OP
+#undef OP_FAMILY
+
+/* DWARF register numbers in the psABI of each machine */
+struct reg_range {
+	unsigned first, last;
+	const char *prefix;		/* named as prefix + (regno - first + base) */
+	unsigned base;
+	const char * const *names;	/* or by this */
+};
+
+#define REG_NAMES(_first, _last, ...)  { _first, _last, NULL, 0, (const char * const []){ __VA_ARGS__ } }
+#define REG_PREFIX(_first, _last, _prefix, _base)  { _first, _last, _prefix, _base, NULL }
+
+static const struct reg_range x86_64_regs[] = {
+	REG_NAMES(0, 7, "rax", "rdx", "rcx", "rbx", "rsi", "rdi", "rbp", "rsp"),
+	REG_PREFIX(8, 15, "r", 8),
+	REG_NAMES(16, 16, "rip"),
+	REG_PREFIX(17, 32, "xmm", 0),
+	REG_PREFIX(33, 40, "st", 0),
+	REG_PREFIX(41, 48, "mm", 0),
+	REG_NAMES(49, 55, "rflags", "es", "cs", "ss", "ds", "fs", "gs"),
+	REG_NAMES(58, 59, "fs.base", "gs.base"),
+	REG_PREFIX(67, 82, "xmm", 16),
+};
+
+static const struct reg_range i386_regs[] = {
+	REG_NAMES(0, 9, "eax", "ecx", "edx", "ebx", "esp", "ebp", "esi", "edi", "eip", "eflags"),
+	REG_PREFIX(11, 18, "st", 0),
+	REG_PREFIX(21, 28, "xmm", 0),
+	REG_PREFIX(29, 36, "mm", 0),
+};
+
+static const struct reg_range aarch64_regs[] = {
+	REG_PREFIX(0, 30, "x", 0),
+	REG_NAMES(31, 33, "sp", "pc", "elr_mode"),
+	REG_PREFIX(64, 95, "v", 0),
+};
+
+static const struct reg_range riscv_regs[] = {
+	REG_NAMES(0, 31,
+		  "zero", "ra", "sp", "gp", "tp", "t0", "t1", "t2",
+		  "s0", "s1", "a0", "a1", "a2", "a3", "a4", "a5",
+		  "a6", "a7", "s2", "s3", "s4", "s5", "s6", "s7",
+		  "s8", "s9", "s10", "s11", "t3", "t4", "t5", "t6"),
+	REG_PREFIX(32, 63, "f", 0),
+};
+
+static const struct reg_range s390_regs[] = {
+	REG_PREFIX(0, 15, "r", 0),
+	REG_NAMES(16, 31,
+		  "f0", "f2", "f4", "f6", "f1", "f3", "f5", "f7",
+		  "f8", "f10", "f12", "f14", "f9", "f11", "f13", "f15"),
+	REG_PREFIX(32, 47, "cr", 0),
+	REG_PREFIX(48, 63, "a", 0),
+	REG_NAMES(64, 65, "pswm", "pswa"),
+};
+
+static const struct reg_range ppc_regs[] = {
+	REG_PREFIX(0, 31, "r", 0),
+	REG_PREFIX(32, 63, "f", 0),
+	REG_NAMES(65, 66, "lr", "ctr"),
+	REG_PREFIX(68, 75, "cr", 0),
+	REG_NAMES(76, 76, "xer"),
+	REG_PREFIX(77, 108, "vr", 0),
+};
+
+static const struct reg_range arm_regs[] = {
+	REG_PREFIX(0, 12, "r", 0),
+	REG_NAMES(13, 15, "sp", "lr", "pc"),
+	REG_PREFIX(64, 95, "s", 0),
+	REG_PREFIX(256, 287, "d", 0),
+};
+
+#undef REG_NAMES
+#undef REG_PREFIX
+
+#define ARCH_REGS(_machine, _regs)  { _machine, _regs, ARRAY_SIZE(_regs) }
+
+static const struct arch_regs {
+	unsigned machine;
+	const struct reg_range *ranges;
+	unsigned nr_ranges;
+} arch_regs[] = {
+	ARCH_REGS(EM_X86_64, x86_64_regs),
+	ARCH_REGS(EM_386, i386_regs),
+	ARCH_REGS(EM_AARCH64, aarch64_regs),
+	ARCH_REGS(EM_RISCV, riscv_regs),
+	ARCH_REGS(EM_S390, s390_regs),
+	ARCH_REGS(EM_PPC64, ppc_regs),
+	ARCH_REGS(EM_PPC, ppc_regs),
+	ARCH_REGS(EM_ARM, arm_regs),
+};
+
+#undef ARCH_REGS
+
+/* a decoded operation */
+struct expr_op {
+	unsigned char code;
+	guint64 arg[2];
+	const unsigned char *block;	/* for OPND_BLOCK*, OPND_EXPR */
+	size_t block_len;
+};
+
+struct expr_reader {
+	const unsigned char *p;
+	const unsigned char *end;
+	bool big_endian;
+};
+
+static void decode_expr(struct expr_ctx *ctx, const unsigned char *data, size_t len,
+			bool show_bytes, GString *out);
+
+void expr_ctx_init(struct expr_ctx *ctx, Dwarf_Die *die)
+{
+	Dwarf_Die cudie;
+	GElf_Ehdr ehdr;
+	uint8_t addr_size = 8;
+	uint8_t offset_size = 4;
+
+	memset(ctx, 0, sizeof(*ctx));
+
+	dwarf_diecu(die, &cudie, &addr_size, &offset_size);
+	ctx->addr_size = addr_size;
+	ctx->offset_size = offset_size;
+
+	if (gelf_getehdr(dwarf_getelf(dwarf_cu_getdwarf(die->cu)), &ehdr)) {
+		ctx->machine = ehdr.e_machine;
+		ctx->big_endian = ehdr.e_ident[EI_DATA] == ELFDATA2MSB;
+	}
+}
+
+/* appends the name of @regno, returns false if it's unknown */
+static bool append_regname(struct expr_ctx *ctx, unsigned regno, GString *out)
+{
+	unsigned i, k;
+
+	for (i = 0; i < ARRAY_SIZE(arch_regs); i++) {
+		if (arch_regs[i].machine != ctx->machine)
+			continue;
+
+		for (k = 0; k < arch_regs[i].nr_ranges; k++) {
+			const struct reg_range *r = &arch_regs[i].ranges[k];
+
+			if (regno < r->first || regno > r->last)
+				continue;
+
+			if (r->names)
+				g_string_append(out, r->names[regno - r->first]);
+			else
+				g_string_append_printf(out, "%s%u", r->prefix,
+						       regno - r->first + r->base);
+			return true;
+		}
+		break;
+	}
+	return false;
+}
+
+static void append_hex(GString *out, const unsigned char *data, size_t len)
+{
+	static const char digits[] = "0123456789abcdef";
+	char buf[3] = { 0, 0, ' ' };
+
+	while (len--) {
+		buf[0] = digits[*data >> 4];
+		buf[1] = digits[*data & 0xf];
+		g_string_append_len(out, buf, sizeof(buf));
+		data++;
+	}
+}
+
+static bool read_fixed(struct expr_reader *r, int size, guint64 *val)
+{
+	int i;
+
+	if (size <= 0 || size > 8 || r->end - r->p < size)
+		return false;
+
+	*val = 0;
+	for (i = 0; i < size; i++) {
+		int shift = r->big_endian ? (size - i - 1) * 8 : i * 8;
+
+		*val |= (guint64)r->p[i] << shift;
+	}
+	r->p += size;
+	return true;
+}
+
+static bool read_uleb(struct expr_reader *r, guint64 *val)
+{
+	unsigned shift = 0;
+
+	*val = 0;
+	while (r->p < r->end) {
+		unsigned char byte = *r->p++;
+
+		/* ignore the bits beyond 64 */
+		if (shift < 64)
+			*val |= (guint64)(byte & 0x7f) << shift;
+		shift += 7;
+
+		if (!(byte & 0x80))
+			return true;
+	}
+	return false;
+}
+
+static bool read_sleb(struct expr_reader *r, guint64 *val)
+{
+	unsigned shift = 0;
+
+	*val = 0;
+	while (r->p < r->end) {
+		unsigned char byte = *r->p++;
+
+		if (shift < 64)
+			*val |= (guint64)(byte & 0x7f) << shift;
+		shift += 7;
+
+		if (!(byte & 0x80)) {
+			/* sign extension */
+			if (shift < 64 && (byte & 0x40))
+				*val |= -1ULL << shift;
+			return true;
+		}
+	}
+	return false;
+}
+
+static gint64 sign_extend(guint64 val, int size)
+{
+	int shift = 64 - size * 8;
+
+	return (gint64)(val << shift) >> shift;
+}
+
+static bool read_operand(struct expr_ctx *ctx, struct expr_reader *r, int opnd,
+			 struct expr_op *op, guint64 *val)
+{
+	static const int sizes[] = {
+		[OPND_U8] = 1, [OPND_U16] = 2, [OPND_U32] = 4, [OPND_U64] = 8,
+		[OPND_S8] = 1, [OPND_S16] = 2, [OPND_S32] = 4, [OPND_S64] = 8,
+		[OPND_BRANCH] = 2,
+	};
+
+	switch (opnd) {
+	case OPND_U8:
+	case OPND_U16:
+	case OPND_U32:
+	case OPND_U64:
+		return read_fixed(r, sizes[opnd], val);
+	case OPND_S8:
+	case OPND_S16:
+	case OPND_S32:
+	case OPND_S64:
+	case OPND_BRANCH:
+		if (!read_fixed(r, sizes[opnd], val))
+			return false;
+		*val = sign_extend(*val, sizes[opnd]);
+		return true;
+	case OPND_ADDR:
+		return read_fixed(r, ctx->addr_size, val);
+	case OPND_OFFSET:
+		return read_fixed(r, ctx->offset_size, val);
+	case OPND_ULEB:
+	case OPND_REG:
+	case OPND_TYPE:
+		return read_uleb(r, val);
+	case OPND_SLEB:
+		return read_sleb(r, val);
+	case OPND_BLOCK:
+	case OPND_EXPR:
+		if (!read_uleb(r, val) || *val > (guint64)(r->end - r->p))
+			return false;
+		break;
+	case OPND_BLOCK1:
+		if (!read_fixed(r, 1, val) || *val > (guint64)(r->end - r->p))
+			return false;
+		break;
+	default:
+		return true;
+	}
+
+	op->block = r->p;
+	op->block_len = *val;
+	r->p += *val;
+	return true;
+}
+
+/* returns NULL on success, or the reason of the failure */
+static const char *read_op(struct expr_ctx *ctx, struct expr_reader *r, struct expr_op *op)
+{
+	const struct op_desc *desc;
+	int i;
+
+	memset(op, 0, sizeof(*op));
+	op->code = *r->p++;
+
+	desc = &op_table[op->code];
+	if (desc->name == NULL)
+		return "unknown";
+
+	for (i = 0; i < 2 && desc->opnd[i] != OPND_NONE; i++) {
+		if (!read_operand(ctx, r, desc->opnd[i], op, &op->arg[i]))
+			return "truncated";
+	}
+	return NULL;
+}
+
+static void format_op(struct expr_ctx *ctx, struct expr_op *op, GString *out)
+{
+	const struct op_desc *desc = &op_table[op->code];
+	unsigned num = op->code - desc->base;
+	int i;
+
+	switch (desc->family) {
+	case FAMILY_LIT:
+		g_string_append_printf(out, "lit%u", num);
+		return;
+	case FAMILY_REG:
+		g_string_append_printf(out, "reg%u ", num);
+		if (!append_regname(ctx, num, out))
+			g_string_truncate(out, out->len - 1);
+		return;
+	case FAMILY_BREG:
+		g_string_append_printf(out, "breg%u ", num);
+		if (!append_regname(ctx, num, out))
+			g_string_append_printf(out, "reg%u", num);
+		g_string_append_printf(out, "%+" G_GINT64_FORMAT, (gint64)op->arg[0]);
+		return;
+	default:
+		break;
+	}
+
+	g_string_append(out, desc->name);
+
+	for (i = 0; i < 2 && desc->opnd[i] != OPND_NONE; i++) {
+		guint64 val = op->arg[i];
+
+		switch (desc->opnd[i]) {
+		case OPND_SLEB:
+			/* an offset from the register */
+			if (i > 0 && desc->opnd[i - 1] == OPND_REG) {
+				g_string_append_printf(out, "%+" G_GINT64_FORMAT, (gint64)val);
+				continue;
+			}
+			/* fall through */
+		case OPND_S8:
+		case OPND_S16:
+		case OPND_S32:
+		case OPND_S64:
+			g_string_append_printf(out, " %" G_GINT64_FORMAT, (gint64)val);
+			break;
+		case OPND_BRANCH:
+			g_string_append_printf(out, " %+" G_GINT64_FORMAT, (gint64)val);
+			break;
+		case OPND_ADDR:
+		case OPND_OFFSET:
+			g_string_append_printf(out, " %#" G_GINT64_MODIFIER "x", val);
+			break;
+		case OPND_TYPE:
+			g_string_append_printf(out, " type %#" G_GINT64_MODIFIER "x", val);
+			break;
+		case OPND_REG:
+			g_string_append_c(out, ' ');
+			if (!append_regname(ctx, val, out))
+				g_string_append_printf(out, "reg%" G_GUINT64_FORMAT, val);
+			break;
+		case OPND_BLOCK:
+		case OPND_BLOCK1:
+			g_string_append(out, " [ ");
+			if (op->block)
+				append_hex(out, op->block, op->block_len);
+			else
+				g_string_append(out, "... ");
+			g_string_append_c(out, ']');
+			break;
+		case OPND_EXPR:
+			g_string_append(out, " {");
+			if (op->block)
+				decode_expr(ctx, op->block, op->block_len, false, out);
+			g_string_append(out, " }");
+			break;
+		default:
+			g_string_append_printf(out, " %" G_GUINT64_FORMAT, val);
+			break;
+		}
+	}
+}
+
+/*
+ * Prints the bytes of each operation followed by its description in
+ * parentheses.  Nested expressions are printed without the bytes.
+ */
+static void decode_expr(struct expr_ctx *ctx, const unsigned char *data, size_t len,
+			bool show_bytes, GString *out)
+{
+	struct expr_reader r = {
+		.p = data,
+		.end = data + len,
+		.big_endian = ctx->big_endian,
+	};
+
+	while (r.p < r.end) {
+		const unsigned char *start = r.p;
+		struct expr_op op;
+		const char *err = read_op(ctx, &r, &op);
+
+		if (err) {
+			/* the rest cannot be decoded */
+			if (show_bytes)
+				append_hex(out, start, r.end - start);
+			g_string_append_printf(out, "%s(%s)", show_bytes ? "" : " ", err);
+			break;
+		}
+
+		if (show_bytes) {
+			append_hex(out, start, r.p - start);
+			g_string_append_c(out, '(');
+		}
+		else
+			g_string_append_c(out, ' ');
+
+		format_op(ctx, &op, out);
+
+		if (show_bytes)
+			g_string_append(out, ") ");
+	}
+}
+
+/* appends the decoded expression in @data to @out */
+void expr_print(struct expr_ctx *ctx, const unsigned char *data, size_t len, GString *out)
+{
+	decode_expr(ctx, data, len, true, out);
+}
+
+/* operations decoded by libdw, the raw bytes are not available */
+static void print_ops(struct expr_ctx *ctx, Dwarf_Attribute *attr,
+		      Dwarf_Op *ops, size_t nr, GString *out)
+{
+	size_t i;
+
+	for (i = 0; i < nr; i++) {
+		const struct op_desc *desc = &op_table[ops[i].atom];
+		struct expr_op op = {
+			.code = ops[i].atom,
+			.arg = { ops[i].number, ops[i].number2 },
+		};
+		Dwarf_Attribute nested;
+		Dwarf_Block block;
+
+		if (i > 0)
+			g_string_append_c(out, ' ');
+
+		if (desc->name == NULL) {
+			g_string_append_printf(out, "(unknown %#x)", op.code);
+			continue;
+		}
+
+		switch (desc->opnd[0]) {
+		case OPND_BLOCK:
+			if (dwarf_getlocation_implicit_value(attr, &ops[i], &block) == 0) {
+				op.block = block.data;
+				op.block_len = block.length;
+			}
+			break;
+		case OPND_EXPR:
+			if (dwarf_getlocation_attr(attr, &ops[i], &nested) == 0 &&
+			    dwarf_formblock(&nested, &block) == 0) {
+				op.block = block.data;
+				op.block_len = block.length;
+			}
+			break;
+		default:
+			break;
+		}
+
+		g_string_append_c(out, '(');
+		format_op(ctx, &op, out);
+		g_string_append_c(out, ')');
+	}
+}
+
+/* returns the location list of @attr as a string, or NULL if it's not */
+gchar *expr_print_loclist(struct expr_ctx *ctx, Dwarf_Attribute *attr)
+{
+	GString *out = g_string_new(NULL);
+	Dwarf_Addr base, start, end;
+	Dwarf_Op *ops;
+	size_t nr;
+	ptrdiff_t off = 0;
+	int nr_entry = 0;
+
+	while ((off = dwarf_getlocations(attr, off, &base, &start, &end, &ops, &nr)) > 0) {
+		if (nr_entry++)
+			g_string_append(out, ", ");
+
+		g_string_append_printf(out, "[%#" G_GINT64_MODIFIER "x,%#" G_GINT64_MODIFIER "x) ",
+				       start, end);
+		print_ops(ctx, attr, ops, nr, out);
+	}
+
+	if (off < 0 && nr_entry == 0) {
+		g_string_free(out, TRUE);
+		return NULL;
+	}
+	return g_string_free(out, FALSE);
+}
@@ -0,0 +1,602 @@
+/*
+ * dwarview - DWARF debug info viewer
+ *
+ * Copyright (C) 2016  Namhyung Kim <namhyung@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 or later of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+/*
+ * Struct layout (like pahole).
+ *
+ * Positions of members are kept in bits so that bitfields are handled
+ * the same way.  A hole is the gap between the end of the members so
+ * far and the next member, it's charged to the member before it.  The
+ * padding is the gap at the end of the struct.
+ *
+ * The report of wasted bytes walks CUs in worker threads (with their own
+ * Dwarf handles like the loader).  The same struct is usually defined in
+ * many CUs, so the results are merged by the tag, name and size.
+ */
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "dwarview.h"
+
+struct layout_member {
+	gchar *name;
+	gchar *type;		/* NULL if types are not needed */
+	guint64 bit_pos;	/* from the start of the struct */
+	guint64 bit_size;
+	guint64 size;		/* of the type, in bytes */
+	guint64 hole_bits;	/* between this and the next member */
+	bool bitfield;
+};
+
+struct struct_layout {
+	int tag;
+	gchar *name;
+	Dwarf_Off off;
+	guint64 size;
+	GArray *members;
+	guint nr_holes;
+	guint64 hole_bits;	/* sum of holes */
+	guint64 padding_bits;	/* at the end */
+	guint64 member_bits;	/* sum of members */
+};
+
+static bool is_layout_tag(int tag)
+{
+	return tag == DW_TAG_structure_type || tag == DW_TAG_class_type ||
+		tag == DW_TAG_union_type;
+}
+
+static const char *tag_keyword(int tag)
+{
+	switch (tag) {
+	case DW_TAG_class_type:
+		return "class";
+	case DW_TAG_union_type:
+		return "union";
+	default:
+		return "struct";
+	}
+}
+
+static guint64 udata_attr(Dwarf_Die *die, unsigned int name, guint64 def)
+{
+	Dwarf_Attribute attr;
+	Dwarf_Word val;
+
+	if (dwarf_attr(die, name, &attr) == NULL || dwarf_formudata(&attr, &val) != 0)
+		return def;
+	return val;
+}
+
+/* returns the byte offset of a member, DWARF 2 uses a location expression */
+static guint64 member_offset(Dwarf_Die *die)
+{
+	Dwarf_Attribute attr;
+	Dwarf_Word off;
+	Dwarf_Op *ops;
+	size_t nr;
+
+	/* union members don't have it */
+	if (dwarf_attr(die, DW_AT_data_member_location, &attr) == NULL)
+		return 0;
+
+	if (dwarf_formudata(&attr, &off) == 0)
+		return off;
+
+	if (dwarf_getlocation(&attr, &ops, &nr) == 0 && nr == 1 &&
+	    ops[0].atom == DW_OP_plus_uconst)
+		return ops[0].number;
+
+	return 0;
+}
+
+static void add_member(struct struct_layout *layout, Dwarf_Die *die,
+		       bool big_endian, bool with_types)
+{
+	struct layout_member m = {};
+	Dwarf_Attribute attr;
+	Dwarf_Die type;
+	Dwarf_Word size = 0;
+	guint64 off = member_offset(die);
+
+	if (dwarf_attr(die, DW_AT_type, &attr) && dwarf_formref_die(&attr, &type)) {
+		dwarf_aggregate_size(&type, &size);
+
+		if (with_types) {
+			m.type = g_strdup(type_name(&type));
+		}
+	}
+
+	if (dwarf_tag(die) == DW_TAG_inheritance)
+		m.name = g_strdup("<ancestor>");
+	else
+		m.name = g_strdup(dwarf_diename(die) ?: "");
+
+	m.size = size;
+	m.bit_pos = off * 8;
+	m.bit_size = size * 8;
+
+	if (dwarf_hasattr(die, DW_AT_bit_size)) {
+		m.bitfield = true;
+		m.bit_size = udata_attr(die, DW_AT_bit_size, 0);
+
+		if (dwarf_hasattr(die, DW_AT_data_bit_offset)) {
+			m.bit_pos = udata_attr(die, DW_AT_data_bit_offset, 0);
+		}
+		else if (dwarf_hasattr(die, DW_AT_bit_offset)) {
+			/* DWARF 2/3 counts from the most significant bit of the storage */
+			guint64 storage = udata_attr(die, DW_AT_byte_size, size);
+			guint64 bit_off = udata_attr(die, DW_AT_bit_offset, 0);
+
+			if (big_endian)
+				m.bit_pos += bit_off;
+			else if (storage * 8 >= bit_off + m.bit_size)
+				m.bit_pos += storage * 8 - bit_off - m.bit_size;
+		}
+	}
+
+	g_array_append_val(layout->members, m);
+}
+
+static int cmp_member(const void *a, const void *b)
+{
+	const struct layout_member *ma = a;
+	const struct layout_member *mb = b;
+
+	if (ma->bit_pos != mb->bit_pos)
+		return ma->bit_pos < mb->bit_pos ? -1 : 1;
+	return 0;
+}
+
+static void find_holes(struct struct_layout *layout)
+{
+	struct layout_member *prev = NULL;
+	guint64 end = 0;
+	guint i;
+
+	for (i = 0; i < layout->members->len; i++) {
+		struct layout_member *m = &g_array_index(layout->members, struct layout_member, i);
+
+		layout->member_bits += m->bit_size;
+
+		if (layout->tag == DW_TAG_union_type) {
+			end = MAX(end, m->bit_size);
+			continue;
+		}
+
+		if (prev && m->bit_pos > end) {
+			prev->hole_bits = m->bit_pos - end;
+			layout->hole_bits += prev->hole_bits;
+			layout->nr_holes++;
+		}
+
+		end = MAX(end, m->bit_pos + m->bit_size);
+		prev = m;
+	}
+
+	if (layout->size * 8 > end)
+		layout->padding_bits = layout->size * 8 - end;
+}
+
+static struct struct_layout *compute_layout(Dwarf_Die *die, bool with_types)
+{
+	struct struct_layout *layout;
+	struct expr_ctx ctx;
+	Dwarf_Die child;
+	guint i;
+
+	if (!is_layout_tag(dwarf_tag(die)) || !dwarf_hasattr(die, DW_AT_byte_size) ||
+	    dwarf_hasattr(die, DW_AT_declaration))
+		return NULL;
+
+	layout = g_malloc0(sizeof(*layout));
+	layout->tag = dwarf_tag(die);
+	layout->off = dwarf_dieoffset(die);
+	layout->size = udata_attr(die, DW_AT_byte_size, 0);
+	layout->members = g_array_new(FALSE, FALSE, sizeof(struct layout_member));
+
+	if (with_types) {
+		layout->name = g_strdup(type_name(die));
+	}
+	else {
+		layout->name = g_strdup_printf("%s %s", tag_keyword(layout->tag),
+						dwarf_diename(die) ?: "(anonymous)");
+	}
+
+	/* for the bit offset of DWARF 2/3 bitfields */
+	expr_ctx_init(&ctx, die);
+
+	if (dwarf_child(die, &child) == 0) {
+		do {
+			int tag = dwarf_tag(&child);
+
+			/* static members are declarations (or variables in DWARF 5) */
+			if ((tag == DW_TAG_member && !dwarf_hasattr(&child, DW_AT_declaration) &&
+			     !dwarf_hasattr(&child, DW_AT_external)) ||
+			    tag == DW_TAG_inheritance)
+				add_member(layout, &child, ctx.big_endian, with_types);
+		}
+		while (dwarf_siblingof(&child, &child) == 0);
+	}
+
+	/* members are usually in order already (and all at 0 in unions) */
+	for (i = 1; layout->tag != DW_TAG_union_type && i < layout->members->len; i++) {
+		struct layout_member *m = &g_array_index(layout->members, struct layout_member, 0);
+
+		if (cmp_member(&m[i - 1], &m[i]) > 0) {
+			g_array_sort(layout->members, cmp_member);
+			break;
+		}
+	}
+
+	find_holes(layout);
+	return layout;
+}
+
+/* follows typedefs and qualifiers, returns NULL if @die is not a struct, class or union */
+struct struct_layout *struct_layout_new(Dwarf_Die *die)
+{
+	Dwarf_Die type;
+
+	if (dwarf_peel_type(die, &type) != 0)
+		type = *die;
+
+	return compute_layout(&type, true);
+}
+
+void struct_layout_free(struct struct_layout *layout)
+{
+	guint i;
+
+	for (i = 0; i < layout->members->len; i++) {
+		struct layout_member *m = &g_array_index(layout->members, struct layout_member, i);
+
+		g_free(m->name);
+		g_free(m->type);
+	}
+
+	g_array_free(layout->members, TRUE);
+	g_free(layout->name);
+	g_free(layout);
+}
+
+/* wasted bytes are holes and the padding, partial bytes are not counted */
+void struct_layout_summary(struct struct_layout *layout, struct layout_summary *sum)
+{
+	sum->name = layout->name;
+	sum->tag = layout->tag;
+	sum->off = layout->off;
+	sum->size = layout->size;
+	sum->nr_holes = layout->nr_holes;
+	sum->padding = layout->padding_bits / 8;
+	sum->wasted = (layout->hole_bits + layout->padding_bits) / 8;
+}
+
+static void print_hole(GString *str, guint64 bits)
+{
+	if (bits >= 8)
+		g_string_append_printf(str, "\n\t/* XXX %lu byte%s hole, try to pack */\n",
+				       (unsigned long)bits / 8, bits >= 16 ? "s" : "");
+	if (bits % 8)
+		g_string_append_printf(str, "%s\t/* XXX %lu bit%s hole, try to pack */\n",
+				       bits >= 8 ? "" : "\n", (unsigned long)bits % 8,
+				       bits % 8 > 1 ? "s" : "");
+	g_string_append_c(str, '\n');
+}
+
+/*
+ * Returns the layout in the pahole format: members with their offsets
+ * and sizes, holes and cacheline boundaries, and a summary at the end.
+ */
+gchar *struct_layout_print(struct struct_layout *layout)
+{
+	GString *str = g_string_new(NULL);
+	guint64 cacheline = 0;
+	guint i;
+
+	g_string_append_printf(str, "%s {\n", layout->name);
+
+	for (i = 0; i < layout->members->len; i++) {
+		struct layout_member *m = &g_array_index(layout->members, struct layout_member, i);
+		guint64 start = m->bit_pos / 8;
+		guint64 end = (m->bit_pos + m->bit_size + 7) / 8;
+		gchar *name;
+
+		if (start / CACHELINE_SIZE > cacheline) {
+			cacheline = start / CACHELINE_SIZE;
+			g_string_append_printf(str, "\t/* --- cacheline %lu boundary (%lu bytes) --- */\n",
+					       (unsigned long)cacheline,
+					       (unsigned long)cacheline * CACHELINE_SIZE);
+		}
+
+		if (m->bitfield)
+			name = g_strdup_printf("%s:%lu;", m->name, (unsigned long)m->bit_size);
+		else
+			name = g_strdup_printf("%s;", m->name);
+
+		if (m->bitfield) {
+			g_string_append_printf(str, "\t%-32s %-24s /* %5lu:%2lu %4lu */\n",
+					       m->type ?: "", name, (unsigned long)start,
+					       (unsigned long)(m->bit_pos % 8), (unsigned long)m->size);
+		}
+		else {
+			g_string_append_printf(str, "\t%-32s %-24s /* %5lu %7lu */\n",
+					       m->type ?: "", name, (unsigned long)start,
+					       (unsigned long)m->size);
+		}
+		g_free(name);
+
+		/* it straddles the boundary */
+		if (end && (end - 1) / CACHELINE_SIZE > cacheline) {
+			cacheline = (end - 1) / CACHELINE_SIZE;
+			g_string_append_printf(str, "\t/* --- cacheline %lu boundary (%lu bytes) was %lu bytes ago --- */\n",
+					       (unsigned long)cacheline,
+					       (unsigned long)cacheline * CACHELINE_SIZE,
+					       (unsigned long)(end - cacheline * CACHELINE_SIZE));
+		}
+
+		if (m->hole_bits)
+			print_hole(str, m->hole_bits);
+	}
+
+	g_string_append_printf(str, "\n\t/* size: %lu, cachelines: %lu, members: %u */\n",
+			       (unsigned long)layout->size,
+			       (unsigned long)(layout->size + CACHELINE_SIZE - 1) / CACHELINE_SIZE,
+			       layout->members->len);
+	if (layout->nr_holes) {
+		g_string_append_printf(str, "\t/* sum members: %lu, holes: %u, sum holes: %lu */\n",
+				       (unsigned long)layout->member_bits / 8, layout->nr_holes,
+				       (unsigned long)layout->hole_bits / 8);
+	}
+	if (layout->hole_bits % 8)
+		g_string_append_printf(str, "\t/* bit holes: %lu bits */\n",
+				       (unsigned long)layout->hole_bits % 8);
+	if (layout->padding_bits / 8)
+		g_string_append_printf(str, "\t/* padding: %lu */\n",
+				       (unsigned long)layout->padding_bits / 8);
+	if (layout->padding_bits % 8)
+		g_string_append_printf(str, "\t/* bit padding: %lu bits */\n",
+				       (unsigned long)layout->padding_bits % 8);
+	if (layout->size % CACHELINE_SIZE)
+		g_string_append_printf(str, "\t/* last cacheline: %lu bytes */\n",
+				       (unsigned long)layout->size % CACHELINE_SIZE);
+
+	g_string_append(str, "};\n");
+	return g_string_free(str, FALSE);
+}
+
+struct report {
+	const char *path;
+	const gint *cancel;
+	GArray *cus;		/* CU DIE offsets */
+	gint next_cu;
+	GMutex lock;
+	GHashTable *found;	/* "tag:name:size" -> struct layout_summary */
+};
+
+struct report_worker {
+	struct report *rep;
+	Dwarf *dwarf;
+	GHashTable *found;	/* the same as above, merged at the end */
+};
+
+static void free_summary(gpointer data)
+{
+	struct layout_summary *sum = data;
+
+	g_free(sum->name);
+	g_free(sum);
+}
+
+static int visit_layout(Dwarf_Die *die, int depth, void *arg)
+{
+	struct report_worker *w = arg;
+	struct struct_layout *layout;
+	struct layout_summary *sum;
+	gchar *key;
+
+	switch (dwarf_tag(die)) {
+	case DW_TAG_subprogram:
+		/* local types are not interesting */
+		return WALK_SKIP;
+	case DW_TAG_structure_type:
+	case DW_TAG_class_type:
+	case DW_TAG_union_type:
+		break;
+	default:
+		return WALK_CONTINUE;
+	}
+
+	if (!dwarf_hasattr(die, DW_AT_name))
+		return WALK_CONTINUE;
+
+	layout = compute_layout(die, false);
+	if (layout == NULL)
+		return WALK_CONTINUE;
+
+	if (layout->hole_bits + layout->padding_bits < 8)
+		goto out;
+
+	key = g_strdup_printf("%d:%s:%lu", layout->tag, layout->name, (unsigned long)layout->size);
+	if (g_hash_table_contains(w->found, key)) {
+		g_free(key);
+		goto out;
+	}
+
+	sum = g_malloc0(sizeof(*sum));
+	struct_layout_summary(layout, sum);
+	sum->name = g_strdup(layout->name);
+	g_hash_table_insert(w->found, key, sum);
+
+out:
+	struct_layout_free(layout);
+
+	/* nested types in C++ */
+	return WALK_CONTINUE;
+}
+
+static gpointer report_thread(gpointer data)
+{
+	struct report_worker *w = data;
+	struct report *rep = w->rep;
+	GHashTableIter iter;
+	gpointer key, val;
+	int fd;
+
+	w->found = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, free_summary);
+
+	fd = open(rep->path, O_RDONLY);
+	if (fd >= 0)
+		w->dwarf = dwarf_begin(fd, DWARF_C_READ);
+
+	/* check it for each CU */
+	while (w->dwarf && !(rep->cancel && g_atomic_int_get(rep->cancel))) {
+		gint idx = g_atomic_int_add(&rep->next_cu, 1);
+		Dwarf_Die cudie;
+
+		if (idx >= (gint)rep->cus->len)
+			break;
+
+		if (dwarf_offdie(w->dwarf, g_array_index(rep->cus, Dwarf_Off, idx), &cudie))
+			die_walk(&cudie, visit_layout, w);
+	}
+
+	if (w->dwarf)
+		dwarf_end(w->dwarf);
+	if (fd >= 0)
+		close(fd);
+
+	/* keep the first one (in the order of the CUs) for duplicates */
+	g_mutex_lock(&rep->lock);
+	g_hash_table_iter_init(&iter, w->found);
+	while (g_hash_table_iter_next(&iter, &key, &val)) {
+		struct layout_summary *old = g_hash_table_lookup(rep->found, key);
+		struct layout_summary *sum = val;
+
+		if (old && old->off < sum->off)
+			continue;
+
+		g_hash_table_iter_steal(&iter);
+		g_hash_table_replace(rep->found, key, sum);
+	}
+	g_mutex_unlock(&rep->lock);
+
+	g_hash_table_destroy(w->found);
+	g_free(w);
+	return NULL;
+}
+
+static int cmp_wasted(const void *a, const void *b)
+{
+	const struct layout_summary *sa = *(const struct layout_summary **)a;
+	const struct layout_summary *sb = *(const struct layout_summary **)b;
+
+	if (sa->wasted != sb->wasted)
+		return sa->wasted > sb->wasted ? -1 : 1;
+	return strcmp(sa->name, sb->name);
+}
+
+/*
+ * Returns an array of (at most @top_n) struct layout_summary with the most
+ * wasted bytes, or NULL if @path cannot be read or @cancel (can be NULL)
+ * was set.  It opens @path for itself so that it can be called in a
+ * thread other than the main one.
+ */
+GPtrArray *layout_report(const char *path, guint top_n, const gint *cancel)
+{
+	struct report rep = {
+		.path = path,
+		.cancel = cancel,
+	};
+	GPtrArray *result;
+	GHashTableIter iter;
+	GThread **workers;
+	gpointer key, val;
+	Dwarf *dwarf = NULL;
+	Dwarf_Off off = 0;
+	Dwarf_Off next;
+	size_t sz;
+	int i, nr_workers;
+	int fd;
+
+	fd = open(path, O_RDONLY);
+	if (fd >= 0)
+		dwarf = dwarf_begin(fd, DWARF_C_READ);
+	if (dwarf == NULL) {
+		if (fd >= 0)
+			close(fd);
+		return NULL;
+	}
+
+	rep.cus = g_array_new(FALSE, FALSE, sizeof(Dwarf_Off));
+	while (dwarf_nextcu(dwarf, off, &next, &sz, NULL, NULL, NULL) == 0) {
+		Dwarf_Off cu_off = off + sz;
+
+		g_array_append_val(rep.cus, cu_off);
+		off = next;
+	}
+
+	dwarf_end(dwarf);
+	close(fd);
+
+	g_mutex_init(&rep.lock);
+	rep.found = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, free_summary);
+
+	nr_workers = MAX(MIN(g_get_num_processors(), rep.cus->len), 1);
+	workers = g_new0(GThread *, nr_workers);
+
+	for (i = 0; i < nr_workers; i++) {
+		struct report_worker *w = g_malloc0(sizeof(*w));
+
+		w->rep = &rep;
+		workers[i] = g_thread_new("dwarview-layout", report_thread, w);
+	}
+	for (i = 0; i < nr_workers; i++)
+		g_thread_join(workers[i]);
+
+	if (cancel && g_atomic_int_get(cancel)) {
+		result = NULL;
+		goto out;
+	}
+
+	result = g_ptr_array_new_with_free_func(free_summary);
+	g_hash_table_iter_init(&iter, rep.found);
+	while (g_hash_table_iter_next(&iter, &key, &val)) {
+		g_hash_table_iter_steal(&iter);
+		g_ptr_array_add(result, val);
+		g_free(key);
+	}
+
+	qsort(result->pdata, result->len, sizeof(*result->pdata), cmp_wasted);
+	if (result->len > top_n)
+		g_ptr_array_set_size(result, top_n);
+
+	pr_dbg("layout: %u CUs with %d workers\n", rep.cus->len, nr_workers);
+
+out:
+	g_hash_table_destroy(rep.found);
+	g_mutex_clear(&rep.lock);
+	g_array_free(rep.cus, TRUE);
+	g_free(workers);
+	return result;
+}
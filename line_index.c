@@ -0,0 +1,270 @@
+/*
+ * dwarview - DWARF debug info viewer
+ *
+ * Copyright (C) 2016  Namhyung Kim <namhyung@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 or later of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+/*
+ * Address to source line lookup.
+ *
+ * The line table of a CU is read when it's used first and kept until
+ * the index is freed.  dwarf_getsrclines() returns the rows sorted by
+ * address (and the end of a sequence comes first at the same address),
+ * so an address is found by binary search in the table of the CU which
+ * the address index finds.
+ *
+ * The reverse lookup (file and line to addresses) reads the tables of
+ * all CUs at once, and sorts the rows by line number.  The rows of a
+ * line are then filtered by the file name as it can be partial.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "dwarview.h"
+
+struct line_table {
+	struct line_info *rows;
+	guint nr_row;
+};
+
+struct line_index {
+	Dwarf *dwarf;
+	struct addr_index *addrs;
+	GHashTable *tables;		/* CU DIE offset -> struct line_table */
+	GStringChunk *files;		/* interned file names */
+
+	/* statement rows of all CUs sorted by line, for the reverse lookup */
+	const struct line_info **by_line;
+	guint nr_by_line;
+};
+
+static void free_table(gpointer data)
+{
+	struct line_table *table = data;
+
+	g_free(table->rows);
+	g_free(table);
+}
+
+static struct line_table *read_table(struct line_index *idx, Dwarf_Off cu_off)
+{
+	struct line_table *table = g_malloc0(sizeof(*table));
+	Dwarf_Die cudie;
+	Dwarf_Lines *lines;
+	size_t i, nr;
+
+	if (dwarf_offdie(idx->dwarf, cu_off, &cudie) == NULL ||
+	    dwarf_getsrclines(&cudie, &lines, &nr) != 0)
+		return table;
+
+	table->rows = g_new0(struct line_info, nr);
+
+	for (i = 0; i < nr; i++) {
+		Dwarf_Line *line = dwarf_onesrcline(lines, i);
+		struct line_info *row = &table->rows[table->nr_row];
+		const char *file;
+		int lineno = 0;
+		int col = 0;
+		bool flag;
+
+		if (line == NULL || dwarf_lineaddr(line, &row->addr) != 0)
+			continue;
+
+		dwarf_lineno(line, &lineno);
+		dwarf_linecol(line, &col);
+		row->line = lineno;
+		row->column = col;
+
+		file = dwarf_linesrc(line, NULL, NULL);
+		if (file)
+			row->file = g_string_chunk_insert_const(idx->files, file);
+
+		if (dwarf_linebeginstatement(line, &flag) == 0)
+			row->is_stmt = flag;
+		if (dwarf_lineendsequence(line, &flag) == 0)
+			row->end_sequence = flag;
+
+		/* rows at the same address are numbered as location views */
+		if (table->nr_row && row[-1].addr == row->addr && !row[-1].end_sequence)
+			row->view = MIN(row[-1].view + 1, G_MAXUINT8);
+
+		table->nr_row++;
+	}
+
+	pr_dbg("line index: CU %#lx has %u rows\n", (unsigned long)cu_off, table->nr_row);
+	return table;
+}
+
+static struct line_table *get_table(struct line_index *idx, Dwarf_Off cu_off)
+{
+	struct line_table *table;
+
+	table = g_hash_table_lookup(idx->tables, &cu_off);
+	if (table == NULL) {
+		gint64 *key = g_malloc(sizeof(*key));
+
+		*key = cu_off;
+		table = read_table(idx, cu_off);
+		g_hash_table_insert(idx->tables, key, table);
+	}
+	return table;
+}
+
+/* @addrs is used to find the CU of an address, it should outlive the index */
+struct line_index *line_index_new(Dwarf *dwarf, struct addr_index *addrs)
+{
+	struct line_index *idx = g_malloc0(sizeof(*idx));
+
+	idx->dwarf = dwarf;
+	idx->addrs = addrs;
+	idx->tables = g_hash_table_new_full(g_int64_hash, g_int64_equal,
+					    g_free, free_table);
+	idx->files = g_string_chunk_new(16 * 1024);
+	return idx;
+}
+
+void line_index_free(struct line_index *idx)
+{
+	g_free(idx->by_line);
+	g_hash_table_destroy(idx->tables);
+	g_string_chunk_free(idx->files);
+	g_free(idx);
+}
+
+/* returns the rows of the CU sorted by address, they're valid until the index is freed */
+const struct line_info *line_index_cu(struct line_index *idx, Dwarf_Off cu_off, guint *nr_row)
+{
+	struct line_table *table = get_table(idx, cu_off);
+
+	*nr_row = table->nr_row;
+	return table->rows;
+}
+
+/* returns the row which covers @addr, or NULL */
+const struct line_info *line_index_lookup(struct line_index *idx, Dwarf_Addr addr)
+{
+	struct line_table *table;
+	Dwarf_Off cu_off;
+	guint lo, hi;
+
+	if (!addr_index_find_cu(idx->addrs, addr, &cu_off))
+		return NULL;
+
+	table = get_table(idx, cu_off);
+
+	/* find the last row at or before @addr */
+	lo = 0;
+	hi = table->nr_row;
+	while (lo < hi) {
+		guint mid = (lo + hi) / 2;
+
+		if (table->rows[mid].addr <= addr)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	/* it's in a gap between sequences */
+	if (lo == 0 || table->rows[lo - 1].end_sequence)
+		return NULL;
+
+	return &table->rows[lo - 1];
+}
+
+static int cmp_line(const void *a, const void *b)
+{
+	const struct line_info *ra = *(const struct line_info **)a;
+	const struct line_info *rb = *(const struct line_info **)b;
+
+	if (ra->line != rb->line)
+		return ra->line < rb->line ? -1 : 1;
+	if (ra->addr != rb->addr)
+		return ra->addr < rb->addr ? -1 : 1;
+	return 0;
+}
+
+static void build_by_line(struct line_index *idx)
+{
+	GPtrArray *rows = g_ptr_array_new();
+	Dwarf_Off off = 0;
+	Dwarf_Off next;
+	size_t sz;
+	guint i;
+
+	while (dwarf_nextcu(idx->dwarf, off, &next, &sz, NULL, NULL, NULL) == 0) {
+		struct line_table *table = get_table(idx, off + sz);
+
+		for (i = 0; i < table->nr_row; i++) {
+			if (table->rows[i].is_stmt && !table->rows[i].end_sequence)
+				g_ptr_array_add(rows, &table->rows[i]);
+		}
+		off = next;
+	}
+
+	qsort(rows->pdata, rows->len, sizeof(*rows->pdata), cmp_line);
+
+	idx->nr_by_line = rows->len;
+	idx->by_line = (const struct line_info **)g_ptr_array_free(rows, FALSE);
+}
+
+/* @file matches the full path, or the last components of it */
+static bool match_file(const char *path, const char *file, size_t file_len)
+{
+	size_t len;
+
+	if (path == NULL)
+		return false;
+
+	len = strlen(path);
+	if (len < file_len || strcmp(path + len - file_len, file))
+		return false;
+
+	return len == file_len || path[len - file_len - 1] == '/';
+}
+
+/*
+ * Returns an array of statement rows for @line in @file, in the order
+ * of address.  The rows are valid until the index is freed.
+ */
+GPtrArray *line_index_addrs(struct line_index *idx, const char *file, guint32 line)
+{
+	GPtrArray *result = g_ptr_array_new();
+	size_t file_len = strlen(file);
+	guint lo, hi;
+
+	if (idx->by_line == NULL)
+		build_by_line(idx);
+
+	/* find the first row of @line */
+	lo = 0;
+	hi = idx->nr_by_line;
+	while (lo < hi) {
+		guint mid = (lo + hi) / 2;
+
+		if (idx->by_line[mid]->line < line)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	for (; lo < idx->nr_by_line && idx->by_line[lo]->line == line; lo++) {
+		if (match_file(idx->by_line[lo]->file, file, file_len))
+			g_ptr_array_add(result, (gpointer)idx->by_line[lo]);
+	}
+	return result;
+}
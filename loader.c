@@ -0,0 +1,369 @@
+/*
+ * dwarview - DWARF debug info viewer
+ *
+ * Copyright (C) 2016  Namhyung Kim <namhyung@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 or later of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * Build the search index using worker threads.
+ *
+ * libdw is not thread-safe, so each worker opens its own Dwarf handle
+ * for the file and takes the next CU to walk from a shared counter.
+ * Results are collected in a per-thread buffer and passed to the main
+ * thread in batches through an async queue.
+ *
+ * It can collect type definitions only, for files which have an
+ * accelerator table with functions and variables but not types.
+ *
+ * Names which are strings in the file are not copied.  As a worker's
+ * Dwarf handle goes away with the worker, they are translated to the
+ * same offset in the sections of the main Dwarf handle.
+ *
+ * The split unit of a skeleton CU is walked with the skeleton.  Its
+ * entries have the offset in the split file and the skeleton, as the
+ * file number of the unified offset is given by the main thread.
+ */
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "dwarview.h"
+
+#define LOADER_BATCH_SIZE  4096
+#define LOADER_BATCH_TIME  100	/* msec, to report progress regularly */
+
+/* sections where DW_AT_name strings can be */
+static const char * const str_sections[] = {
+	".debug_str",
+	".debug_info",
+};
+
+#define NR_STR_SECTION  ARRAY_SIZE(str_sections)
+
+struct str_section {
+	const char *data;
+	size_t size;
+};
+
+struct cu_info {
+	Dwarf_Off off;		/* offset of the CU DIE */
+	size_t size;		/* size of the whole unit */
+};
+
+struct dwarview_loader {
+	char *path;
+	die_name_fn_t name_fn;
+	bool types_only;
+
+	struct str_section secs[NR_STR_SECTION];	/* of the main Dwarf */
+
+	GArray *cus;
+	gint next_cu;
+	gint cancel;
+
+	GThread **workers;
+	int nr_workers;
+	int nr_finished;
+
+	GAsyncQueue *queue;
+};
+
+struct loader_worker {
+	struct dwarview_loader *ld;
+	Dwarf *dwarf;
+	struct index_batch *batch;
+	gint64 batch_start;		/* usec, monotonic */
+	Dwarf_Off skel;			/* skeleton CU of the split unit walking */
+	struct str_section secs[NR_STR_SECTION];
+};
+
+static void read_str_sections(Dwarf *dwarf, struct str_section *secs)
+{
+	Elf *elf = dwarf_getelf(dwarf);
+	unsigned i;
+
+	for (i = 0; i < NR_STR_SECTION; i++) {
+		Elf_Data *data = get_elf_secdata(elf, str_sections[i]);
+
+		secs[i].data = data ? data->d_buf : NULL;
+		secs[i].size = data ? data->d_size : 0;
+	}
+}
+
+/* returns the same string in the main Dwarf, or NULL if it's not in the sections */
+static const char *map_string(struct loader_worker *w, const char *str)
+{
+	unsigned i;
+
+	for (i = 0; i < NR_STR_SECTION; i++) {
+		struct str_section *sec = &w->secs[i];
+		struct str_section *main_sec = &w->ld->secs[i];
+
+		if (sec->data == NULL || main_sec->data == NULL ||
+		    sec->size != main_sec->size)
+			continue;
+
+		if (str >= sec->data && str < sec->data + sec->size)
+			return main_sec->data + (str - sec->data);
+	}
+	return NULL;
+}
+
+static struct index_batch *new_batch(void)
+{
+	struct index_batch *batch = g_malloc0(sizeof(*batch));
+
+	batch->items = g_array_sized_new(FALSE, FALSE, sizeof(struct index_entry),
+					 LOADER_BATCH_SIZE);
+	return batch;
+}
+
+void loader_free_batch(struct index_batch *batch)
+{
+	guint i;
+
+	for (i = 0; i < batch->items->len; i++)
+		g_free(g_array_index(batch->items, struct index_entry, i).name);
+
+	g_array_free(batch->items, TRUE);
+	g_free(batch);
+}
+
+static void flush_batch(struct loader_worker *w, bool last)
+{
+	w->batch->last = last;
+	g_async_queue_push(w->ld->queue, w->batch);
+
+	w->batch = last ? NULL : new_batch();
+	w->batch_start = g_get_monotonic_time();
+}
+
+static void add_entry(struct loader_worker *w, Dwarf_Die *die, int kind)
+{
+	struct index_entry entry = {};
+	const char *str = die_name_ref(die);
+
+	if (str)
+		entry.str = map_string(w, str);
+
+	if (entry.str == NULL) {
+		gchar *name = w->ld->name_fn(die);
+
+		if (!g_strcmp0(name, "(no name)")) {
+			g_free(name);
+			return;
+		}
+		entry.name = name;
+	}
+
+	entry.off = dwarf_dieoffset(die);
+	entry.skel = w->skel;
+	entry.kind = kind;
+	entry.sig = kind == INDEX_TYPE ? type_signature(die) : 0;
+	g_array_append_val(w->batch->items, entry);
+}
+
+static int visit_die(Dwarf_Die *die, int depth, void *arg)
+{
+	struct loader_worker *w = arg;
+
+	/* check it for each top-level DIE */
+	if (depth == 1 && g_atomic_int_get(&w->ld->cancel))
+		return WALK_STOP;
+
+	/* functions, variables and type definitions can be searched */
+	switch (dwarf_tag(die)) {
+	case DW_TAG_subprogram:
+	case DW_TAG_inlined_subroutine:
+	case DW_TAG_entry_point:
+		if (!w->ld->types_only)
+			add_entry(w, die, INDEX_FUNC);
+		break;
+	case DW_TAG_variable:
+	case DW_TAG_constant:
+		if (!w->ld->types_only)
+			add_entry(w, die, INDEX_VAR);
+		break;
+	case DW_TAG_base_type:
+	case DW_TAG_typedef:
+	case DW_TAG_structure_type:
+	case DW_TAG_union_type:
+	case DW_TAG_enumeration_type:
+	case DW_TAG_class_type:
+		/* anonymous types are found by their users */
+		if (dwarf_hasattr(die, DW_AT_name) && !dwarf_hasattr(die, DW_AT_declaration))
+			add_entry(w, die, INDEX_TYPE);
+		break;
+	default:
+		break;
+	}
+	return WALK_CONTINUE;
+}
+
+/* returns false if it's canceled */
+static bool walk_unit(struct loader_worker *w, struct cu_info *cu)
+{
+	Dwarf_Die die, split;
+	uint8_t unit_type;
+	bool ret;
+
+	if (dwarf_offdie(w->dwarf, cu->off, &die) == NULL)
+		return true;
+
+	if (!die_walk(&die, visit_die, w))
+		return false;
+
+	/* libdw opens the split file for this handle */
+	if (dwarf_cu_info(die.cu, NULL, &unit_type, NULL, &split, NULL, NULL, NULL) != 0 ||
+	    unit_type != DW_UT_skeleton || split.cu == NULL)
+		return true;
+
+	w->skel = cu->off;
+	ret = die_walk(&split, visit_die, w);
+	w->skel = 0;
+	return ret;
+}
+
+static void walk_cu(struct loader_worker *w, struct cu_info *cu)
+{
+	if (!walk_unit(w, cu))
+		return;
+
+	w->batch->bytes += cu->size;
+
+	/* CUs with few entries would not update the progress for long */
+	if (w->batch->items->len >= LOADER_BATCH_SIZE ||
+	    g_get_monotonic_time() - w->batch_start >= LOADER_BATCH_TIME * 1000)
+		flush_batch(w, false);
+}
+
+static gpointer loader_thread(gpointer data)
+{
+	struct loader_worker *w = data;
+	struct dwarview_loader *ld = w->ld;
+	int fd;
+
+	w->batch = new_batch();
+	w->batch_start = g_get_monotonic_time();
+
+	fd = open(ld->path, O_RDONLY);
+	if (fd >= 0)
+		w->dwarf = dwarf_begin(fd, DWARF_C_READ);
+
+	if (w->dwarf == NULL) {
+		w->batch->error = true;
+		goto out;
+	}
+
+	read_str_sections(w->dwarf, w->secs);
+
+	while (!g_atomic_int_get(&ld->cancel)) {
+		gint idx = g_atomic_int_add(&ld->next_cu, 1);
+
+		if (idx >= (gint)ld->cus->len)
+			break;
+
+		walk_cu(w, &g_array_index(ld->cus, struct cu_info, idx));
+	}
+
+	dwarf_end(w->dwarf);
+out:
+	if (fd >= 0)
+		close(fd);
+
+	flush_batch(w, true);
+	g_free(w);
+	return NULL;
+}
+
+/* @dwarf is used to read CU headers, workers will open @path for themselves */
+struct dwarview_loader *loader_new(Dwarf *dwarf, const char *path,
+				   die_name_fn_t name_fn, bool types_only)
+{
+	struct dwarview_loader *ld = g_malloc0(sizeof(*ld));
+	struct cu_info cu;
+	Dwarf_Off off = 0;
+	Dwarf_Off next;
+	size_t sz;
+	int i;
+
+	ld->path = g_strdup(path);
+	ld->name_fn = name_fn;
+	ld->types_only = types_only;
+	ld->queue = g_async_queue_new();
+
+	read_str_sections(dwarf, ld->secs);
+
+	ld->cus = g_array_new(FALSE, FALSE, sizeof(struct cu_info));
+	while (dwarf_nextcu(dwarf, off, &next, &sz, NULL, NULL, NULL) == 0) {
+		cu.off = off + sz;
+		cu.size = next - off;
+		g_array_append_val(ld->cus, cu);
+		off = next;
+	}
+
+	ld->nr_workers = MIN(g_get_num_processors(), ld->cus->len);
+	if (ld->nr_workers == 0)
+		ld->nr_workers = 1;
+
+	ld->workers = g_malloc0(ld->nr_workers * sizeof(*ld->workers));
+	for (i = 0; i < ld->nr_workers; i++) {
+		struct loader_worker *w = g_malloc0(sizeof(*w));
+
+		w->ld = ld;
+		ld->workers[i] = g_thread_new("dwarview-loader", loader_thread, w);
+	}
+
+	pr_dbg("loader: %u CUs with %d workers\n", ld->cus->len, ld->nr_workers);
+	return ld;
+}
+
+/* returns a batch of results or NULL if nothing is available now */
+struct index_batch *loader_pop(struct dwarview_loader *ld)
+{
+	struct index_batch *batch = g_async_queue_try_pop(ld->queue);
+
+	if (batch && batch->last)
+		ld->nr_finished++;
+
+	return batch;
+}
+
+bool loader_done(struct dwarview_loader *ld)
+{
+	return ld->nr_finished == ld->nr_workers;
+}
+
+/* stop workers (if still running) and release the loader */
+void loader_destroy(struct dwarview_loader *ld)
+{
+	struct index_batch *batch;
+	int i;
+
+	g_atomic_int_set(&ld->cancel, 1);
+
+	for (i = 0; i < ld->nr_workers; i++)
+		g_thread_join(ld->workers[i]);
+
+	while ((batch = g_async_queue_try_pop(ld->queue)) != NULL)
+		loader_free_batch(batch);
+
+	g_async_queue_unref(ld->queue);
+	g_array_free(ld->cus, TRUE);
+	g_free(ld->workers);
+	g_free(ld->path);
+	g_free(ld);
+}
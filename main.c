@@ -21,56 +21,74 @@
 #include <stdlib.h>
 #include <string.h>
 #include <fcntl.h>
+#include <unistd.h>
 #include <errno.h>
 
 #include "dwarview.h"
 
-/* Dwarf FL wrappers */
-static char *debuginfo_path;	/* Currently dummy */
-
-static const Dwfl_Callbacks offline_callbacks = {
-	.find_debuginfo = dwfl_standard_find_debuginfo,
-	.debuginfo_path = &debuginfo_path,
-
-	.section_address = dwfl_offline_section_address,
-
-	/* We use this table for core files too.  */
-	.find_elf = dwfl_build_id_find_elf,
-};
-
 static Dwarf *dwarf;
+static char *dwarf_path;	/* file containing the debug info */
+static char *build_id;		/* hex string, for the index cache */
+static struct dwarf_files *files;	/* alt file and split units */
+
+bool dwarview_debug;
 
 static GtkBuilder *builder;
 
 struct content_arg {
 	char *filename;
 	GtkBuilder *builder;
-	GtkTreeStore *main_store;
+	GtkTreeView *main_view;
+	DwarviewDieModel *model;
 	GtkTreeStore *attr_store;
 	GtkStatusbar *status;
 	guint status_ctx;
-	Dwarf_Off off;
+	struct dwarview_loader *loader;
+	guint merge_id;
+	GThread *index_thread;
+	gint index_done;
+	GPtrArray *index_items[3];	/* func, var and type */
+	struct name_index *new_index[3];
+	bool error;
+	bool split;		/* some entries are in split units */
+	size_t done_size;
 	size_t total_size;
+	gint64 start_time;	/* usec, monotonic */
+	gint64 demangle_start;	/* usec, waiting for c++filt if not 0 */
 	char msgbuf[4096];
 };
 
 static struct content_arg *arg;
 
+/* a result of the name index search */
+struct search_match {
+	struct search_item *item;
+	Dwarf_Off off;		/* the DIE of a func or var, see resolve_matches() */
+	int score;		/* for ranked search */
+	bool type;
+};
+
 struct search_status {
 	bool on_going;
 	bool try_var;
 	bool with_decl;
 	gint found;
 	guint ctx_id;
-	GList *curr;
+	GArray *items;		/* search items not checked yet */
+	guint pos;
+	struct search_job *job;	/* running name index search */
+	GArray *matched;	/* struct search_match from the name index */
+	guint matched_pos;
 	gchar *text;
-	GPatternSpec *patt;
+	struct name_query *query;
 
 	GtkSearchEntry *entry;
 	GtkButton *button;
 	GtkToggleButton *func;
 	GtkToggleButton *var;
+	GtkToggleButton *type;
 	GtkToggleButton *decl;
+	GtkComboBox *mode;
 	GtkTreeView *result;
 	GtkTreeView *main_view;
 	GtkStatusbar *status;
@@ -80,67 +98,80 @@ struct search_status {
 
 static struct search_status *search;
 
-static GList *func_list;
-static GList *func_first;
-static GList *var_list;
-static GList *var_first;
+/* an entry from .gdb_index which is not found in its CU */
+#define NO_DIE_OFF  ((Dwarf_Off)-1)
 
-struct search_item {
-	char *name;
-	GtkTreePath *path;
+/*
+ * Name index search runs in a separate thread (which uses a thread pool
+ * for large indexes) so that the UI is not blocked.  Setting @cancel
+ * aborts it.  A canceled job is not waited for, it's released when it
+ * notifies the end (or when the file is closed).
+ */
+struct search_job {
+	GThread *thread;
+	gint cancel;
+	guint id;
+	struct name_query *query;
+	gchar *path;
+	bool func;
+	bool var;
+	bool type;
+
+	GArray *matched;
 };
 
-static GHashTable *die_map;
+static guint last_job_id;
+static GList *canceled_jobs;
 
-static void add_contents(GtkBuilder *builder, char *filename);
-static void destroy_item(gpointer data);
+/*
+ * Search items are fixed-size records in the arrays.  Their names point
+ * to the strings in the file (or the index cache) if possible, and other
+ * names are copied to the arena.  So they are released all at once.
+ */
+static GArray *func_items;
+static GArray *var_items;
+static GStringChunk *name_arena;
+static struct index_cache *index_cache;
+
+/* built after loading is done, search falls back to the arrays until then */
+static struct name_index *func_index;
+static struct name_index *var_index;
+static struct name_index *type_index;
+
+/* type definitions merged across CUs */
+static struct type_index *types;
+
+/* built when an address is searched first */
+static struct addr_index *addr_idx;
+
+/* built when a line table is shown first, uses addr_idx */
+static struct line_index *line_idx;
+static Dwarf_Off line_cu = -1;		/* CU in the line table */
+
+/* the report of wasted bytes runs in a thread */
+#define REPORT_TOP_N  100
+
+struct report_job {
+	GThread *thread;
+	gint cancel;
+	gchar *path;
+	GPtrArray *result;
+};
+
+static struct report_job *report_job;
 
-extern void setup_demangler(void);
-extern void finish_demangler(void);
-extern bool demangler_enabled(void);
-extern int demangle(const char *input, char *output, int outlen);
+static void add_contents(GtkBuilder *builder, char *filename);
+static void cancel_search_job(struct search_status *search);
+static void wait_canceled_jobs(void);
+static void show_layout(Dwarf_Die *die);
 
-/* Get a Dwarf from offline image */
 static int open_dwarf_file(char *path)
 {
-	int fd;
-	int err;
-	Dwfl *dwfl;
-	Dwfl_Module *mod;
-	Dwarf_Addr bias;
-
-	fd = open(path, O_RDONLY);
-	if (fd < 0)
-		return errno;
-
-	dwfl = dwfl_begin(&offline_callbacks);
-	if (!dwfl)
-		goto error;
-
-	dwfl_report_begin(dwfl);
-	mod = dwfl_report_offline(dwfl, "", "", fd);
-	if (!mod)
-		goto error;
-
-	dwarf = dwfl_module_getdwarf(mod, &bias);
-	if (!dwarf)
-		goto error;
+	int ret = dwarview_open(path, &dwarf, &dwarf_path, &build_id);
 
-	dwfl_report_end(dwfl, NULL, NULL);
-
-	return 0;
-
-error:
-	err = dwarf_errno();
-
-	if (dwfl)
-		dwfl_end(dwfl);
-	else
-		close(fd);
-
-	if (err == 0)
-		err = 6;  /* no DWARF information */
-	return err;
+	if (ret == 0)
+		files = dwarf_files_new(dwarf);
+	return ret;
 }
 
 static void close_dwarf_file(void)
@@ -148,21 +179,92 @@ static void close_dwarf_file(void)
 	if (dwarf == NULL)
 		return;
 
+	/* stop loader threads before releasing search items */
+	if (arg->merge_id)
+		g_source_remove(arg->merge_id);
+	if (arg->loader)
+		loader_destroy(arg->loader);
+	if (arg->index_thread) {
+		g_thread_join(arg->index_thread);
+		name_index_free(arg->new_index[0]);
+		name_index_free(arg->new_index[1]);
+		name_index_free(arg->new_index[2]);
+	}
+
+	/* the report uses the type name cache, on_report_done() releases it */
+	if (report_job) {
+		g_atomic_int_set(&report_job->cancel, 1);
+		g_thread_join(report_job->thread);
+		report_job->thread = NULL;
+		report_job = NULL;
+	}
+
 	dwarf_end(dwarf);
 	dwarf = NULL;
+	type_name_reset();
+	file_name_reset();
+	demangle_reset();
+
+	g_free(dwarf_path);
+	dwarf_path = NULL;
+	g_free(build_id);
+	build_id = NULL;
 
-	gtk_tree_store_clear(arg->main_store);
+	gtk_tree_view_set_model(arg->main_view, NULL);
+	g_object_unref(arg->model);
 	gtk_tree_store_clear(arg->attr_store);
 
+	dwarf_files_free(files);
+	files = NULL;
+
 	gtk_tree_store_clear(GTK_TREE_STORE(gtk_tree_view_get_model(search->result)));
 
-	g_list_free_full(func_list, destroy_item);
-	g_list_free_full(var_list, destroy_item);
-	func_list = NULL;
-	var_list = NULL;
+	/* the jobs are using the name index */
+	cancel_search_job(search);
+	wait_canceled_jobs();
+
+	if (func_index) {
+		name_index_free(func_index);
+		name_index_free(var_index);
+		name_index_free(type_index);
+		func_index = NULL;
+		var_index = NULL;
+		type_index = NULL;
+	}
+	if (search->matched) {
+		g_array_free(search->matched, TRUE);
+		search->matched = NULL;
+	}
+	if (line_idx) {
+		line_index_free(line_idx);
+		line_idx = NULL;
+	}
+	gtk_list_store_clear(GTK_LIST_STORE(gtk_builder_get_object(builder, "line_store")));
+	line_cu = -1;
+
+	gtk_list_store_clear(GTK_LIST_STORE(gtk_builder_get_object(builder, "report_store")));
+	gtk_widget_set_sensitive(GTK_WIDGET(gtk_builder_get_object(builder, "report_btn")), TRUE);
+	show_layout(NULL);
 
-	g_hash_table_destroy(die_map);
-	die_map = NULL;
+	if (addr_idx) {
+		addr_index_free(addr_idx);
+		addr_idx = NULL;
+	}
+
+	type_index_free(types);
+	types = NULL;
+
+	g_array_free(func_items, TRUE);
+	g_array_free(var_items, TRUE);
+	func_items = NULL;
+	var_items = NULL;
+
+	g_string_chunk_free(name_arena);
+	name_arena = NULL;
+	if (index_cache) {
+		index_cache_close(index_cache);
+		index_cache = NULL;
+	}
 
 	/* stop and re-enable search */
 	search->on_going = FALSE;
@@ -174,13 +276,14 @@ static void close_dwarf_file(void)
 
 	g_free(search->text);
 	search->text = NULL;
-	if (search->patt) {
-		g_pattern_spec_free(search->patt);
-		search->patt = NULL;
+	if (search->query) {
+		name_query_free(search->query);
+		search->query = NULL;
 	}
 
 	g_free(arg->filename);
 	g_free(arg);
+	arg = NULL;
 }
 
 static void show_warning(GtkWidget *parent, const char *fmt, ...)
@@ -203,632 +306,716 @@ static void show_warning(GtkWidget *parent, const char *fmt, ...)
 	g_free(msg);
 }
 
-static Elf_Data *get_elf_secdata(Elf *elf, char *sec_name)
+struct attr_arg {
+	GtkTreeStore *store;
+	Dwarf_Die *diep;
+};
+
+static int attr_callback(Dwarf_Attribute *attr, void *_arg)
 {
-	size_t i, num_sec, strndx;
-	Elf_Scn *sec;
+	struct attr_arg *arg = _arg;
+	GtkTreeStore *store = arg->store;
+	GtkTreeIter iter;
+	unsigned name = dwarf_whatattr(attr);
+	unsigned form = dwarf_whatform(attr);
+	unsigned long raw_value;
+	Dwarf_Off target = -1;
+	Dwarf_Die ref;
+	gchar *val_str;
 
-	elf_getshdrnum(elf, &num_sec);
-	elf_getshdrstrndx(elf, &strndx);
+	val_str = attr_value(arg->diep, attr, &raw_value);
 
-	for (i = 0; i < num_sec; i++) {
-		char *name;
-		GElf_Shdr shdr;
+	/* type units are not in the tree */
+	if (form != DW_FORM_ref_sig8 && dwarf_formref_die(attr, &ref))
+		target = dwarf_files_offset(files, &ref);
 
-		sec = elf_getscn(elf, i);
-		gelf_getshdr(sec, &shdr);
-		name = elf_strptr(elf, strndx, shdr.sh_name);
+	gtk_tree_store_append(store, &iter, NULL);
+	gtk_tree_store_set(store, &iter, 0, dwarview_attr_name(name),
+			   1, dwarview_form_name(form),
+			   2, raw_value, 3, val_str ?: "", 4, target, -1);
 
-		if (!g_strcmp0(name, sec_name)) {
-			return elf_getdata(sec, NULL);
-		}
-	}
-	return NULL;
+	g_free(val_str);
+	return DWARF_CB_OK;
 }
 
-static char *print_block(Dwarf_Block *block)
+/* show the line table of the CU which has @die */
+static void show_line_table(Dwarf_Die *die)
 {
-	int i;
-	int len = block->length;
-	char *result = g_malloc(len * 3 + 1);
+	GtkTreeView *view = GTK_TREE_VIEW(gtk_builder_get_object(builder, "line_view"));
+	GtkListStore *store = GTK_LIST_STORE(gtk_builder_get_object(builder, "line_store"));
+	const struct line_info *rows;
+	Dwarf_Die cudie;
+	Dwarf_Off cu_off;
+	guint i, nr;
+
+	if (dwarf_diecu(die, &cudie, NULL, NULL) == NULL)
+		return;
 
-	for (i = 0; i < len; i++) {
-		snprintf(&result[i * 3], 4, "%02x ", block->data[i]);
+	/* split units use the line table of the skeleton */
+	if (dwarf_cu_getdwarf(cudie.cu) != dwarf &&
+	    (dwarf_cu_info(cudie.cu, NULL, NULL, NULL, &cudie, NULL, NULL, NULL) != 0 ||
+	     cudie.cu == NULL || dwarf_cu_getdwarf(cudie.cu) != dwarf))
+		return;
+
+	cu_off = dwarf_dieoffset(&cudie);
+	if (cu_off == line_cu)
+		return;
+	line_cu = cu_off;
+
+	if (addr_idx == NULL)
+		addr_idx = addr_index_new(dwarf);
+	if (line_idx == NULL)
+		line_idx = line_index_new(dwarf, addr_idx);
+
+	rows = line_index_cu(line_idx, cu_off, &nr);
+
+	/* detach the model not to update the view for each row */
+	g_object_ref(store);
+	gtk_tree_view_set_model(view, NULL);
+	gtk_list_store_clear(store);
+
+	for (i = 0; i < nr; i++) {
+		const struct line_info *row = &rows[i];
+		GtkTreeIter iter;
+		char addr[32];
+
+		g_snprintf(addr, sizeof(addr), "%#lx", (unsigned long)row->addr);
+
+		gtk_list_store_append(store, &iter);
+		gtk_list_store_set(store, &iter, 0, addr, 1, row->file ?: "",
+				   2, row->line, 3, row->column, 4, row->view,
+				   5, row->end_sequence ? "end" : row->is_stmt ? "stmt" : "",
+				   6, (gulong)row->addr, -1);
 	}
 
-	return result;
+	gtk_tree_view_set_model(view, GTK_TREE_MODEL(store));
+	g_object_unref(store);
 }
 
-long read_sleb128(unsigned char *data, int *nbytes)
+/* show the layout if it's a struct, class or union (or a typedef of them), clear if NULL */
+static void show_layout(Dwarf_Die *die)
 {
-	int n = 1;
-	long val = *data & 0x7f;
-
-	while (*data & 0x80) {
-		data++;
+	GtkTextView *view = GTK_TEXT_VIEW(gtk_builder_get_object(builder, "layout_text"));
+	GtkTextBuffer *buf = gtk_text_view_get_buffer(view);
+	struct struct_layout *layout = die ? struct_layout_new(die) : NULL;
+	gchar *text;
 
-		val |= ((unsigned long)(*data & 0x7f) << (7 * n));
-		n++;
+	if (layout == NULL) {
+		gtk_text_buffer_set_text(buf, "", -1);
+		return;
 	}
 
-	if (val & (1UL << (7 * n - 1)))
-		val |= (-1UL << (7 * n));  /* sign extension */
+	text = struct_layout_print(layout);
+	gtk_text_buffer_set_text(buf, text, -1);
 
-	*nbytes = n;
-	return val;
+	g_free(text);
+	struct_layout_free(layout);
 }
 
-static const char *get_regname(int regno)
+static void on_cursor_changed(GtkTreeView *view, gpointer data)
 {
-	static char buf[32];
-	static const char *gp_regs[] = {
-		"rax", "rdx", "rcx", "rbx", "rsi", "rdi", "rbp", "rsp",
+	GtkTreeView *attr_view = data;
+	GtkTreeModel *main_model = gtk_tree_view_get_model(view);
+	GtkTreeModel *attr_model = gtk_tree_view_get_model(attr_view);
+	GtkTreeIter iter;
+	Dwarf_Off off;
+	Dwarf_Die die;
+	struct attr_arg arg = {
+		.diep = &die,
+		.store = GTK_TREE_STORE(attr_model),
 	};
-	const char *reg = buf;
-
-	switch (regno) {
-	case 0 ... 7:
-		reg = gp_regs[regno];
-		break;
-	case 8 ... 15:
-		snprintf(buf, sizeof(buf), "r%d", regno);
-		break;
-	case 16:
-		reg = "RA";  /* return address ??? */
-		break;
-	case 17 ... 32:
-		snprintf(buf, sizeof(buf), "xmm%d", regno - 17);
-		break;
-	case 33 ... 40:
-		snprintf(buf, sizeof(buf), "st%d", regno - 33);
-		break;
-	case 41 ... 48:
-		snprintf(buf, sizeof(buf), "mm%d", regno - 41);
-		break;
-	default:
-		reg = "unknown";
-		break;
+
+	GtkTreeSelection *selection = gtk_tree_view_get_selection(view);
+	/* the cursor can change with no selection when the model is replaced */
+	if (!gtk_tree_selection_get_selected(selection, NULL, &iter))
+		return;
+	off = dwarview_die_model_get_offset(DWARVIEW_DIE_MODEL(main_model), &iter);
+
+	if (dwarf_files_die(files, off, &die) == NULL) {
+		if ((int)off != -1)
+			printf("bug?? %lx\n", off);
+		return;
 	}
 
-	return reg;
+	gtk_tree_store_clear(arg.store);
+	dwarf_getattrs(&die, attr_callback, &arg, 0);
+
+	show_line_table(&die);
+	show_layout(&die);
 }
 
-static char *print_exprloc(Dwarf_Block *block)
+static void on_row_activated(GtkTreeView *view, GtkTreePath *path,
+                             GtkTreeViewColumn *column, gpointer user_data)
 {
-	int i, n, k;
-	int len = block->length;
-	int pos = 0;
-	int size = 4096;
-	char *result = g_malloc(size);
-	long sarg;
-	unsigned long uarg;
-
-	for (i = 0; i < len; i++) {
-		switch (block->data[i]) {
-		case 0x03:
-			memcpy(&uarg, block->data + i + 1, sizeof(uarg));
-			pos += snprintf(result + pos, size - pos, "03 ");
-			for (k = 0; k < sizeof(uarg); k++)
-				pos += snprintf(result + pos, size - pos,
-						"%02x ", block->data[i + k + 1]);
-			pos += snprintf(result + pos, size - pos,
-					"(addr %#lx) ", uarg);
-			i += sizeof(uarg);
-			break;
-		case 0x06:
-			pos += snprintf(result + pos, size - pos,
-					"06 (deref) ");
-			break;
-		case 0x30 ... 0x4f:
-			pos += snprintf(result + pos, size - pos,
-					"%02x (literal %d) ", block->data[i],
-					block->data[i] - 0x30);
-			break;
-		case 0x50 ... 0x6f:
-			pos += snprintf(result + pos, size - pos,
-					"%02x (reg%d: %s) ", block->data[i],
-					block->data[i] - 0x50,
-					get_regname(block->data[i] - 0x50));
-			break;
-		case 0x70 ... 0x8f:
-			sarg = read_sleb128(block->data + i + 1, &n);
-			pos += snprintf(result + pos, size - pos,
-					"%02x ", block->data[i]);
-			for (k = 0; k < n; k++)
-				pos += snprintf(result + pos, size - pos,
-						"%02x ", block->data[i + k + 1]);
-			pos += snprintf(result + pos, size - pos,
-					"(%s%+ld) ", get_regname(block->data[i] - 0x70), sarg);
-			i += n;
-			break;
-		case 0x91:
-			sarg = read_sleb128(block->data + i + 1, &n);
-			pos += snprintf(result + pos, size - pos, "91 ");
-			for (k = 0; k < n; k++)
-				pos += snprintf(result + pos, size - pos,
-						"%02x ", block->data[i + k + 1]);
-			pos += snprintf(result + pos, size - pos,
-					"(fbreg%+ld) ", sarg);
-			i += n;
-			break;
-		case 0x96:
-			pos += snprintf(result + pos, size - pos,
-					"96 (nop) ");
-			break;
-		case 0x9c:
-			pos += snprintf(result + pos, size - pos,
-					"9c (cfa) ");
-			break;
-		default:
-			pos += snprintf(result + pos, size - pos,
-					"%02x ", block->data[i]);
-			break;
-		}
-	}
+	bool expanded = gtk_tree_view_row_expanded(view, path);
+	if (expanded)
+		gtk_tree_view_collapse_row(view, path);
+	else
+		gtk_tree_view_expand_row(view, path, FALSE);
+}
+
+#define MAX_SEARCH_COUNT  1000
+
+
+static void stop_search(struct search_status *search, const gchar *msg);
+static gboolean on_search_job_done(gpointer data);
 
-	return result;
+static void show_found(struct search_status *search)
+{
+	search->found++;
+	g_snprintf(search->msgbuf, sizeof(search->msgbuf), "Searching '%s' ... (found %d)",
+		   search->text, search->found);
+
+	gtk_statusbar_pop(search->status, search->ctx_id);
+	gtk_statusbar_push(search->status, search->ctx_id, search->msgbuf);
 }
 
-static char *print_file_name(Dwarf_Die *die, int idx)
+/*
+ * @off is the DIE of @item.  Entries from .gdb_index point to the CU DIE,
+ * they are resolved by the search job or when the row is activated.
+ */
+static int add_result(struct search_status *search, struct search_item *item,
+		      Dwarf_Off off)
 {
-	Dwarf_Files *files;
-	const gchar *dir_prefix = NULL;
-	Dwarf_Word file_idx;
-	Dwarf_Attribute attr;
-	Dwarf_Die cudie;
+	GtkTreeStore *store = GTK_TREE_STORE(gtk_tree_view_get_model(search->result));
+	GtkTreeIter iter;
+	Dwarf_Die die;
+	gchar *location;
 
-	dwarf_diecu(die, &cudie, NULL, NULL);
+	if (dwarf_files_die(files, off, &die) == NULL)
+		return -1;
 
-	if (dwarf_attr(&cudie, DW_AT_comp_dir, &attr))
-		dir_prefix = dwarf_formstring(&attr);
+	if (dwarf_hasattr(&die, DW_AT_declaration) && !search->with_decl)
+		return 0;
 
-	if (dwarf_getsrcfiles(&cudie, &files, NULL) == 0) {
-		const gchar *short_name = NULL;
-		const gchar *full_path = dwarf_filesrc(files, idx, NULL, NULL);
+	location = die_location(&die);
 
-		if (g_str_has_prefix(full_path, dir_prefix)) {
-			short_name = full_path + strlen(dir_prefix);
-			while (*short_name == '/')
-				short_name++;
-		}
+	gtk_tree_store_append(store, &iter, NULL);
+	gtk_tree_store_set(store, &iter, 0, item->name, 1, location, 2, off, -1);
+	g_free(location);
 
-		return g_strdup(short_name ?: full_path);
-	}
-	else
-		return g_strdup_printf("Unknown file: %d\n", idx);
+	show_found(search);
+	return 0;
 }
 
-static char *print_addr_ranges(Dwarf_Die *die)
+/* show the canonical type and its copies in other CUs as children */
+static int add_type_result(struct search_status *search, struct search_item *item)
 {
-	ptrdiff_t offset = 0;
-	Dwarf_Addr base, start, end;
-	char *result = NULL;
+	GtkTreeStore *store = GTK_TREE_STORE(gtk_tree_view_get_model(search->result));
+	GArray *copies = type_index_copies(item);
+	GtkTreeIter iter, child;
+	Dwarf_Die die, cudie;
+	gchar *location;
+	guint i;
+
+	if (dwarf_files_die(files, item->off, &die) == NULL)
+		return -1;
+
+	location = die_location(&die);
+
+	gtk_tree_store_append(store, &iter, NULL);
+	gtk_tree_store_set(store, &iter, 0, item->name, 1, location, 2, item->off, -1);
+	g_free(location);
+
+	for (i = 0; i < copies->len; i++) {
+		Dwarf_Off off = g_array_index(copies, Dwarf_Off, i);
+		gchar *name;
 
-	while ((offset = dwarf_ranges(die, offset, &base, &start, &end)) > 0) {
-		result = g_strdup_printf("%s%s[%lx,%lx)", result ?: "",
-					 result ? ", " : "", start, end);
+		if (dwarf_files_die(files, off, &die) == NULL ||
+		    dwarf_diecu(&die, &cudie, NULL, NULL) == NULL)
+			continue;
+
+		name = g_strdup_printf("(in %s)", dwarf_diename(&cudie) ?: "unknown CU");
+
+		gtk_tree_store_append(store, &child, &iter);
+		gtk_tree_store_set(store, &child, 0, name, 1, "", 2, off, -1);
+		g_free(name);
 	}
 
-	return result;
+	show_found(search);
+	return 0;
 }
 
-static char *die_location(Dwarf_Die *die)
+static int do_search(struct search_status *search, struct search_item *item)
 {
-	gchar *file = NULL;
-	gint line = 0;
+	if (!name_query_match(search->query, item->name))
+		return 0;
 
-	if (dwarf_hasattr(die, DW_AT_decl_file) || dwarf_hasattr(die, DW_AT_call_file)) {
-		Dwarf_Die cudie;
-		Dwarf_Word file_idx;
-		Dwarf_Attribute attr;
+	return add_result(search, item, item->off);
+}
 
-		dwarf_diecu(die, &cudie, NULL, NULL);
+/* items are matched already, just add them to the result view */
+static guint search_index_handler(struct search_status *search)
+{
+	int count = 0;
+	char tmp[1024];
 
-		if (dwarf_attr(die, DW_AT_decl_file, &attr) == NULL)
-			dwarf_attr(die, DW_AT_call_file, &attr);
+	while (search->matched_pos < search->matched->len) {
+		struct search_match *m;
+		struct search_item *item;
+		int ret;
 
-		dwarf_formudata(&attr, &file_idx);
-		file = print_file_name(&cudie, file_idx);
-	}
-	if (dwarf_hasattr(die, DW_AT_decl_line) || dwarf_hasattr(die, DW_AT_call_line)) {
-		Dwarf_Word lineno;
-		Dwarf_Attribute attr;
+		m = &g_array_index(search->matched, struct search_match, search->matched_pos++);
+		item = m->item;
+
+		if (m->type)
+			ret = add_type_result(search, item);
+		else if (m->off == NO_DIE_OFF)
+			ret = 0;  /* not found in the CU */
+		else
+			ret = add_result(search, item, m->off);
 
-		if (dwarf_attr(die, DW_AT_decl_line, &attr) == NULL)
-			dwarf_attr(die, DW_AT_call_line, &attr);
+		if (ret < 0) {
+			g_snprintf(tmp, sizeof(tmp), "Failed (at %s).", item->name);
+			stop_search(search, tmp);
+			return FALSE;
+		}
 
-		dwarf_formudata(&attr, &lineno);
-		line = lineno;
+		if (++count == MAX_SEARCH_COUNT)
+			return TRUE;
 	}
 
-	return g_strdup_printf(" in %s:%d", file ?: "(unknown)", line);
+	g_snprintf(tmp, sizeof(tmp), "Done (%d found).", search->found);
+	stop_search(search, tmp);
+	return FALSE;
 }
 
-static char *type_name(Dwarf_Die *die)
+static guint search_handler(void *arg)
 {
-	char *type = NULL;
-	char *name = NULL;
-	int tag = dwarf_tag(die);
-	Dwarf_Off off;
-	Dwarf_Die ref;
-	Dwarf_Attribute attr;
-
-	if (dwarf_hasattr(die, DW_AT_name))
-		name = (char *)dwarf_diename(die);
-
-	switch (tag) {
-	case DW_TAG_structure_type:
-		type = "struct";
-		break;
-	case DW_TAG_union_type:
-		type = "union";
-		break;
-	case DW_TAG_enumeration_type:
-		type = "enum";
-		break;
-	case DW_TAG_class_type:
-		type = "class";
-		break;
-	case DW_TAG_interface_type:
-		type = "interface";
-		break;
-	case DW_TAG_subroutine_type:
-		type = "function";
-		break;
-	default:
-		break;
-	}
+	struct search_status *search = arg;
+	GArray *items = search->items;
+	guint pos = search->pos;
+	int count = 0;
 
-	if (type || name)
-		return g_strdup_printf("%s%s%s", type ?: "",
-				       (type && name) ? " " : "", name ?: "");
-
-	if (!dwarf_hasattr(die, DW_AT_type))
-		return g_strdup_printf("no type");
-
-	dwarf_attr(die, DW_AT_type, &attr);
-
-	switch (dwarf_whatform(&attr)) {
-	case DW_FORM_ref1:
-	case DW_FORM_ref2:
-	case DW_FORM_ref4:
-	case DW_FORM_ref8:
-	case DW_FORM_ref_udata:
-	case DW_FORM_ref_addr:
-	case DW_FORM_ref_sig8:
-	case DW_FORM_GNU_ref_alt:
-		dwarf_formref_die(&attr, &ref);
-		name = type_name(&ref);
-		break;
-	default:
-		name = strdup("");
-		break;
+	/* it'll be called again when the job is done */
+	if (!search->on_going || search->job)
+		return FALSE;
+
+	if (search->matched)
+		return search_index_handler(search);
+
+	while (items) {
+		while (pos < items->len) {
+			struct search_item *item = &g_array_index(items, struct search_item, pos++);
+
+			if (do_search(search, item) < 0) {
+				char tmp[1024];
+
+				g_snprintf(tmp, sizeof(tmp), "Failed (at %s).", item->name);
+				stop_search(search, tmp);
+				return FALSE;
+			}
+
+			if (++count == MAX_SEARCH_COUNT)
+				goto out;
+		}
+
+		if (search->try_var) {
+			items = var_items;
+			pos = 0;
+			search->try_var = FALSE;
+		}
+		else
+			items = NULL;
 	}
 
-	switch (tag) {
-	case DW_TAG_const_type:
-		type = g_strdup_printf("const %s", name);
-		break;
-	case DW_TAG_volatile_type:
-		type = g_strdup_printf("volatile %s", name);
-		break;
-	case DW_TAG_restrict_type:
-		type = g_strdup_printf("restrict %s", name);
-		break;
-	case DW_TAG_pointer_type:
-	case DW_TAG_ptr_to_member_type:
-		type = g_strdup_printf("pointer to %s", name);
-		break;
-	case DW_TAG_reference_type:
-	case DW_TAG_rvalue_reference_type:
-		type = g_strdup_printf("reference to %s", name);
-		break;
-	case DW_TAG_array_type:
-		type = g_strdup_printf("array of %s", name);
-		break;
-	default:
-		type = g_strdup_printf("unknown type (%d)", tag);
-		break;
+out:
+	search->items = items;
+	search->pos = pos;
+
+	if (items == NULL) {
+		char tmp[1024];
+
+		g_snprintf(tmp, sizeof(tmp), "Done (%d found).", search->found);
+		stop_search(search, tmp);
 	}
 
-	free(name);
-	return type;
+	return items != NULL;
 }
 
-struct attr_arg {
-	GtkTreeStore *store;
-	Dwarf_Die *diep;
-};
+/* append the result of @idx to @matched, returns the number of them */
+static guint add_matches(struct search_job *job, struct name_index *idx, bool type,
+			 GArray *matched)
+{
+	GArray *scores = g_array_new(FALSE, FALSE, sizeof(int));
+	GPtrArray *items = name_index_search(idx, job->query, &job->cancel, scores);
+	guint i;
+
+	for (i = 0; i < items->len; i++) {
+		struct search_match m = {
+			.item = g_ptr_array_index(items, i),
+			.score = i < scores->len ? g_array_index(scores, int, i) : 0,
+			.type = type,
+		};
+
+		m.off = m.item->off;
+		g_array_append_val(matched, m);
+	}
 
-static int attr_callback(Dwarf_Attribute *attr, void *_arg)
+	g_array_free(scores, TRUE);
+	g_ptr_array_free(items, TRUE);
+	return i;
+}
+
+/*
+ * Each index keeps the best NAME_TOP_K names of a ranked search.  Merge
+ * the sorted runs of @all into the best NAME_TOP_K names of them, items
+ * of the same name are kept together.  Earlier runs win the ties.
+ */
+static GArray *merge_ranked(GArray *all, guint *run_end, int nr_run)
 {
-	struct attr_arg *arg = _arg;
-	GtkTreeStore *store = arg->store;
-	GtkTreeIter iter;
-	unsigned name = dwarf_whatattr(attr);
-	unsigned form = dwarf_whatform(attr);
-	unsigned long raw_value = 0;
-	gpointer val_str = NULL;
-	Dwarf_Block block;
-	Dwarf_Word data;
-	Dwarf_Addr addr;
-	Dwarf_Off off;
-	Dwarf_Die die;
+	GArray *merged = g_array_new(FALSE, FALSE, sizeof(struct search_match));
+	guint pos[3];
+	guint nr_name = 0;
+	int i;
 
-	switch (form) {
-	case DW_FORM_flag:
-		raw_value = *attr->valp;
-		val_str = g_strdup_printf("%s", raw_value ? "True" : "False");
-		break;
-	case DW_FORM_flag_present:
-		raw_value = 1;
-		val_str = g_strdup("True");
-		break;
-	case DW_FORM_string:
-		val_str = g_strdup(attr->valp);
-		break;
-	case DW_FORM_strp:
-	case DW_FORM_GNU_strp_alt:
-		val_str = g_strdup(dwarf_formstring(attr));
-		break;
-	case DW_FORM_data1:
-	case DW_FORM_data2:
-	case DW_FORM_data4:
-	case DW_FORM_data8:
-	case DW_FORM_sdata:
-	case DW_FORM_udata:
-	case DW_FORM_sec_offset:
-		dwarf_formudata(attr, &data);
-		raw_value = data;
-		if (name == DW_AT_decl_file || name == DW_AT_call_file)
-			val_str = print_file_name(arg->diep, raw_value);
-		else if (name == DW_AT_decl_line || name == DW_AT_call_line)
-			val_str = g_strdup_printf("Line %lu", raw_value);
-		else if (name == DW_AT_inline)
-			val_str = g_strdup(dwarview_inline_name(raw_value));
-		else if (name == DW_AT_ranges)
-			val_str = print_addr_ranges(arg->diep);
-		else if (name == DW_AT_language)
-			val_str = g_strdup(dwarview_language_name(raw_value));
-		else
-			val_str = g_strdup_printf("%#lx", raw_value);
-		break;
-	case DW_FORM_block1:
-	case DW_FORM_block2:
-	case DW_FORM_block4:
-	case DW_FORM_block:
-	case DW_FORM_exprloc:
-		dwarf_formblock(attr, &block);
-		raw_value = block.length;
-		if (form == DW_FORM_exprloc)
-			val_str = print_exprloc(&block);
-		else
-			val_str = print_block(&block);
-		break;
-	case DW_FORM_addr:
-		dwarf_formaddr(attr, &addr);
-		raw_value = addr;
-		val_str = g_strdup_printf("%#lx", raw_value);
-		break;
-	case DW_FORM_ref1:
-	case DW_FORM_ref2:
-	case DW_FORM_ref4:
-	case DW_FORM_ref8:
-	case DW_FORM_ref_udata:
-	case DW_FORM_ref_addr:
-	case DW_FORM_ref_sig8:
-	case DW_FORM_GNU_ref_alt:
-		dwarf_formref(attr, &off);
-		raw_value = off;
-
-		dwarf_formref_die(attr, &die);
-
-		if (name == DW_AT_type) {
-			char *type = type_name(&die);
-
-			val_str = g_strdup_printf("%#lx (%s)", raw_value, type);
-			free(type);
+	for (i = 0; i < nr_run; i++)
+		pos[i] = i ? run_end[i - 1] : 0;
+
+	while (nr_name < NAME_TOP_K) {
+		struct search_match *best = NULL;
+		int k = -1;
+		const char *name;
+
+		for (i = 0; i < nr_run; i++) {
+			struct search_match *m;
+
+			if (pos[i] == run_end[i])
+				continue;
+
+			m = &g_array_index(all, struct search_match, pos[i]);
+			if (best == NULL || m->score > best->score) {
+				best = m;
+				k = i;
+			}
 		}
-		else if (dwarf_diename(&die)) {
-			val_str = g_strdup_printf("%#lx (%s)", raw_value,
-						  dwarf_diename(&die));
+		if (best == NULL)
+			break;
+
+		name = best->item->name;
+		while (pos[k] < run_end[k]) {
+			struct search_match *m = &g_array_index(all, struct search_match, pos[k]);
+
+			if (strcmp(m->item->name, name))
+				break;
+
+			g_array_append_val(merged, *m);
+			pos[k]++;
 		}
-		else
-			val_str = g_strdup_printf("%#lx", raw_value);
-		break;
+		nr_name++;
 	}
 
-	gtk_tree_store_append(store, &iter, NULL);
-	gtk_tree_store_set(store, &iter, 0, dwarview_attr_name(name),
-			   1, dwarview_form_name(form),
-			   2, raw_value, 3, val_str ?: "", -1);
+	g_array_free(all, TRUE);
+	return merged;
+}
 
-	g_free(val_str);
-	return DWARF_CB_OK;
+static int cmp_off(const void *a, const void *b)
+{
+	const Dwarf_Off *x = a;
+	const Dwarf_Off *y = b;
+
+	return *x < *y ? -1 : *x > *y;
 }
 
-static void on_cursor_changed(GtkTreeView *view, gpointer data)
+/*
+ * Entries from .gdb_index point to the CU DIE, walk the CU here to find
+ * the DIE (it uses its own handle as libdw is not thread-safe).  It's
+ * NO_DIE_OFF if not found.
+ */
+static void resolve_matches(struct search_job *job)
 {
-	GtkTreeView *attr_view = data;
-	GtkTreeModel *main_model = gtk_tree_view_get_model(view);
-	GtkTreeModel *attr_model = gtk_tree_view_get_model(attr_view);
-	GtkTreeIter iter;
-	GValue val = G_VALUE_INIT;
-	Dwarf_Off off;
-	Dwarf_Die die;
-	struct attr_arg arg = {
-		.diep = &die,
-		.store = GTK_TREE_STORE(attr_model),
-	};
-	char buf[32];
+	GArray *cus = g_array_new(FALSE, FALSE, sizeof(Dwarf_Off));
+	Dwarf *dw = NULL;
+	Dwarf_Off off = 0;
+	Dwarf_Off next;
+	size_t sz;
+	guint i;
+	int fd;
 
-	GtkTreeSelection *selection = gtk_tree_view_get_selection(view);
-	gtk_tree_selection_get_selected(selection, NULL, &iter);
-	gtk_tree_model_get_value(main_model, &iter, 0, &val);
-	off = strtoul(g_value_get_string(&val), NULL, 0);
-	g_value_unset(&val);
+	fd = open(job->path, O_RDONLY);
+	if (fd >= 0)
+		dw = dwarf_begin(fd, DWARF_C_READ);
 
-	if (dwarf_offdie(dwarf, off, &die) == NULL) {
-		if ((int)off != -1)
-			printf("bug?? %lx\n", off);
-		return;
+	while (dw && dwarf_nextcu(dw, off, &next, &sz, NULL, NULL, NULL) == 0) {
+		Dwarf_Off cu_off = off + sz;
+
+		g_array_append_val(cus, cu_off);
+		off = next;
 	}
 
-	gtk_tree_store_clear(arg.store);
-	dwarf_getattrs(&die, attr_callback, &arg, 0);
+	for (i = 0; i < job->matched->len; i++) {
+		struct search_match *m = &g_array_index(job->matched, struct search_match, i);
+		Dwarf_Die die;
+
+		if (g_atomic_int_get(&job->cancel))
+			break;
+
+		if (m->type ||
+		    !bsearch(&m->off, cus->data, cus->len, sizeof(Dwarf_Off), cmp_off))
+			continue;
+
+		if (dwarf_offdie(dw, m->off, &die) && accel_resolve(&die, m->item->name, &die))
+			m->off = dwarf_dieoffset(&die);
+		else
+			m->off = NO_DIE_OFF;
+	}
+
+	if (dw)
+		dwarf_end(dw);
+	if (fd >= 0)
+		close(fd);
+	g_array_free(cus, TRUE);
 }
 
-static void on_row_activated(GtkTreeView *view, GtkTreePath *path,
-                             GtkTreeViewColumn *column, gpointer user_data)
+static gpointer search_job_thread(gpointer data)
 {
-	bool expanded = gtk_tree_view_row_expanded(view, path);
-	if (expanded)
-		gtk_tree_view_collapse_row(view, path);
-	else
-		gtk_tree_view_expand_row(view, path, FALSE);
-}
+	struct search_job *job = data;
+	guint run_end[3];
+	int nr_run = 0;
+	guint nr = 0;
 
-#define MAX_SEARCH_COUNT  1000
+	job->matched = g_array_new(FALSE, FALSE, sizeof(struct search_match));
 
+	if (job->func)
+		run_end[nr_run++] = nr += add_matches(job, func_index, false, job->matched);
+	if (job->var)
+		run_end[nr_run++] = nr += add_matches(job, var_index, false, job->matched);
+	if (job->type)
+		run_end[nr_run++] = nr += add_matches(job, type_index, true, job->matched);
 
-static void stop_search(struct search_status *search, const gchar *msg);
+	/* show the best ones of all kinds first */
+	if (name_query_mode(job->query) == MATCH_FUZZY && nr_run > 1)
+		job->matched = merge_ranked(job->matched, run_end, nr_run);
 
-static int do_search(struct search_status *search, struct search_item *item)
+	resolve_matches(job);
+
+	g_idle_add(on_search_job_done, GUINT_TO_POINTER(job->id));
+	return NULL;
+}
+
+static void free_search_job(struct search_job *job)
 {
-	GtkTreeStore *store = GTK_TREE_STORE(gtk_tree_view_get_model(search->result));
-	GtkTreeModel *main_model = gtk_tree_view_get_model(search->main_view);
-	GtkTreeIter iter, main_iter;
-	GValue val = G_VALUE_INIT;
-	Dwarf_Off off;
-	Dwarf_Die die;
-	gchar *location;
+	g_thread_join(job->thread);
 
-	if (!g_pattern_match_string(search->patt, item->name))
-		return 0;
+	if (job->matched)
+		g_array_free(job->matched, TRUE);
+	name_query_free(job->query);
+	g_free(job->path);
+	g_free(job);
+}
 
-	gtk_tree_model_get_iter(main_model, &main_iter, item->path);
-	gtk_tree_model_get_value(main_model, &main_iter, 0, &val);
-	off = strtoul(g_value_get_string(&val), NULL, 0);
-	g_value_unset(&val);
+/* it doesn't wait for the job, see on_search_job_done() */
+static void cancel_search_job(struct search_status *search)
+{
+	if (search->job == NULL)
+		return;
 
-	if (dwarf_offdie(dwarf, off, &die) == NULL)
-		return -1;
+	g_atomic_int_set(&search->job->cancel, 1);
+	canceled_jobs = g_list_prepend(canceled_jobs, search->job);
+	search->job = NULL;
+}
 
-	if (dwarf_hasattr(&die, DW_AT_declaration) && !search->with_decl)
-		return 0;
+/* they stop soon as the name index checks @cancel regularly */
+static void wait_canceled_jobs(void)
+{
+	g_list_free_full(canceled_jobs, (GDestroyNotify)free_search_job);
+	canceled_jobs = NULL;
+}
 
-	location = die_location(&die);
+/* move the result of the job and show it */
+static gboolean on_search_job_done(gpointer data)
+{
+	struct search_job *job = search->job;
+	GList *pos;
 
-	gtk_tree_store_append(store, &iter, NULL);
-	gtk_tree_store_set(store, &iter, 0, item->name, 1, location, 2, item->path, -1);
-	g_free(location);
+	/* release it if it's canceled (and not released already) */
+	for (pos = canceled_jobs; pos; pos = pos->next) {
+		struct search_job *old = pos->data;
 
-	search->found++;
-	g_snprintf(search->msgbuf, sizeof(search->msgbuf), "Searching '%s' ... (found %d)",
-		   search->text, search->found);
+		if (old->id == GPOINTER_TO_UINT(data)) {
+			canceled_jobs = g_list_delete_link(canceled_jobs, pos);
+			free_search_job(old);
+			return G_SOURCE_REMOVE;
+		}
+	}
 
-	gtk_statusbar_pop(search->status, search->ctx_id);
-	gtk_statusbar_push(search->status, search->ctx_id, search->msgbuf);
+	if (job == NULL || job->id != GPOINTER_TO_UINT(data))
+		return G_SOURCE_REMOVE;
 
-	return 0;
+	search->matched = job->matched;
+	search->matched_pos = 0;
+
+	job->matched = NULL;
+	free_search_job(job);
+	search->job = NULL;
+
+	g_idle_add((GSourceFunc)search_handler, search);
+	return G_SOURCE_REMOVE;
 }
 
-static guint search_handler(void *arg)
+/* returns false if @text is not a valid pattern */
+static bool start_search(struct search_status *search, const gchar *text)
 {
-	struct search_status *search = arg;
-	int count = 0;
-	GList *curr = search->curr;
+	int mode = gtk_combo_box_get_active(search->mode);
+	struct name_query *query;
 
-	if (!search->on_going)
-		return FALSE;
+	/* abort the previous search if it's still running */
+	cancel_search_job(search);
 
-	while (curr) {
-		struct search_item *item = curr->data;
+	query = name_query_new(text, mode);
+	if (query == NULL)
+		return false;
 
-		if (do_search(search, item) < 0) {
-			char tmp[1024];
+	/* delete previous result */
+	gtk_tree_store_clear(GTK_TREE_STORE(gtk_tree_view_get_model(search->result)));
+	search->found = 0;
 
-err:
-			g_snprintf(tmp, sizeof(tmp), "Failed (at %s).", item->name);
-			stop_search(search, tmp);
-			return FALSE;
-		}
+	g_free(search->text);
+	if (search->query)
+		name_query_free(search->query);
 
-		curr = g_list_previous(curr);
+	search->text = g_strdup(text);
+	search->query = query;
 
-		if (++count == MAX_SEARCH_COUNT)
-			goto out;
+	if (search->matched) {
+		g_array_free(search->matched, TRUE);
+		search->matched = NULL;
 	}
 
-	if (search->try_var) {
-		curr = var_first;
-		search->try_var = FALSE;
-	}
+	if (func_index) {
+		struct search_job *job = g_malloc0(sizeof(*job));
+
+		job->id = ++last_job_id;
+		job->query = name_query_new(text, mode);
+		job->path = g_strdup(dwarf_path);
+		job->func = gtk_toggle_button_get_active(search->func);
+		job->var = gtk_toggle_button_get_active(search->var);
+		job->type = gtk_toggle_button_get_active(search->type);
+
+		search->job = job;
+		job->thread = g_thread_new("dwarview-search", search_job_thread, job);
+	}
+
+	/* types can be searched after the name index is built */
+	search->try_var = FALSE;
+	search->pos = 0;
+	if (gtk_toggle_button_get_active(search->func)) {
+		search->items = func_items;
+		if (gtk_toggle_button_get_active(search->var))
+			search->try_var = TRUE;
+	}
+	else if (gtk_toggle_button_get_active(search->var))
+		search->items = var_items;
+	else
+		search->items = NULL;
+
+	search->with_decl = gtk_toggle_button_get_active(search->decl);
+
+	search->on_going = TRUE;
+	if (search->job == NULL)
+		g_idle_add((GSourceFunc)search_handler, search);
+	return true;
+}
+
+static void stop_search(struct search_status *search, const gchar *msg)
+{
+	cancel_search_job(search);
+
+	search->on_going = FALSE;
+	g_object_set(search->entry, "editable", TRUE, NULL);
+	gtk_button_set_label(search->button, "Search");
+
+	g_snprintf(search->msgbuf, sizeof(search->msgbuf), "Searching '%s' ... %s",
+		   search->text, msg);
+
+	gtk_statusbar_pop(search->status, search->ctx_id);
+	gtk_statusbar_push(search->status, search->ctx_id, search->msgbuf);
+}
+
+/* "0x1234 0x5678" searches DIEs containing the addresses */
+static bool is_addr_query(const gchar *text)
+{
+	return g_str_has_prefix(text, "0x") || g_str_has_prefix(text, "0X");
+}
+
+#define MAX_ADDR_CHAIN  64
 
-	while (curr) {
-		struct search_item *item = curr->data;
+/* add DIEs containing @addr as a chain of nested rows, returns the innermost */
+static GtkTreePath *add_addr_result(struct search_status *search, Dwarf_Addr addr)
+{
+	GtkTreeStore *store = GTK_TREE_STORE(gtk_tree_view_get_model(search->result));
+	Dwarf_Off chain[MAX_ADDR_CHAIN];
+	GtkTreeIter iter, parent;
+	int i, nr;
 
-		if (do_search(search, item) < 0)
-			goto err;
+	nr = addr_index_lookup(addr_idx, addr, chain, MAX_ADDR_CHAIN);
 
-		curr = g_list_previous(curr);
+	for (i = 0; i < nr; i++) {
+		Dwarf_Die die;
+		gchar *name;
+		gchar *location;
 
-		if (++count == MAX_SEARCH_COUNT)
+		if (dwarf_files_die(files, chain[i], &die) == NULL)
 			break;
-	}
 
-out:
-	search->curr = curr;
+		name = die_name(&die);
+		location = die_location(&die);
 
-	if (curr == NULL) {
-		char tmp[1024];
+		gtk_tree_store_append(store, &iter, i ? &parent : NULL);
+		gtk_tree_store_set(store, &iter, 0, name, 1, location, 2, chain[i], -1);
+		parent = iter;
 
-		g_snprintf(tmp, sizeof(tmp), "Done (%d found).", search->found);
-		stop_search(search, tmp);
+		g_free(name);
+		g_free(location);
 	}
 
-	return curr != NULL;
+	if (i == 0)
+		return NULL;
+
+	search->found++;
+	return gtk_tree_model_get_path(GTK_TREE_MODEL(store), &iter);
 }
 
-static void start_search(struct search_status *search, const gchar *text)
+static void search_address(struct search_status *search, const gchar *text)
 {
-	/* delete previous result */
+	gchar **addrs = g_strsplit_set(text, " ,\t", -1);
+	GtkTreePath *path = NULL;
+	char tmp[1024];
+	int i;
+
 	gtk_tree_store_clear(GTK_TREE_STORE(gtk_tree_view_get_model(search->result)));
 	search->found = 0;
 
 	g_free(search->text);
-	if (search->patt)
-		g_pattern_spec_free(search->patt);
-
 	search->text = g_strdup(text);
-	search->patt = g_pattern_spec_new(text);
 
-	search->try_var = FALSE;
-	if (gtk_toggle_button_get_active(search->func)) {
-		search->curr = func_first;
-		if (gtk_toggle_button_get_active(search->var))
-			search->try_var = TRUE;
-	}
-	else
-		search->curr = var_first;
+	if (addr_idx == NULL)
+		addr_idx = addr_index_new(dwarf);
 
-	search->with_decl = gtk_toggle_button_get_active(search->decl);
+	for (i = 0; addrs[i]; i++) {
+		Dwarf_Addr addr;
+		char *end;
 
-	search->on_going = TRUE;
-	g_idle_add((GSourceFunc)search_handler, search);
-}
+		addr = strtoull(addrs[i], &end, 16);
+		if (end == addrs[i] || *end != '\0')
+			continue;
 
-static void stop_search(struct search_status *search, const gchar *msg)
-{
-	search->on_going = FALSE;
-	g_object_set(search->entry, "editable", TRUE, NULL);
-	gtk_button_set_label(search->button, "Search");
+		if (path)
+			gtk_tree_path_free(path);
+		path = add_addr_result(search, addr);
+	}
+	g_strfreev(addrs);
 
-	g_snprintf(search->msgbuf, sizeof(search->msgbuf), "Searching '%s' ... %s",
-		   search->text, msg);
+	gtk_tree_view_expand_all(search->result);
 
-	gtk_statusbar_pop(search->status, search->ctx_id);
-	gtk_statusbar_push(search->status, search->ctx_id, search->msgbuf);
+	/* show the innermost DIE of the (last) address */
+	if (path) {
+		gtk_tree_view_row_activated(search->result, path, NULL);
+		gtk_tree_path_free(path);
+	}
+
+	g_snprintf(tmp, sizeof(tmp), "Done (%d found).", search->found);
+	stop_search(search, tmp);
 }
 
 static void on_search_activated(GtkEntry *entry, gpointer data)
@@ -843,38 +1030,92 @@ static void on_search_button(GtkButton *button, gpointer data)
 	const gchar *text;
 
 	if (!search->on_going) {
+		text = gtk_entry_get_text(entry);
+		if (dwarf && is_addr_query(text)) {
+			search_address(search, text);
+			return;
+		}
+
 		/* at least one of the check boxes should be set */
 		if (!gtk_toggle_button_get_active(search->func) &&
-		    !gtk_toggle_button_get_active(search->var))
+		    !gtk_toggle_button_get_active(search->var) &&
+		    !gtk_toggle_button_get_active(search->type))
 			return;
 
-		text = gtk_entry_get_text(entry);
-		if (*text && g_strcmp0(text, search->text)) {
-			start_search(search, text);
-			g_object_set(entry, "editable", FALSE, NULL);
-			gtk_button_set_label(button, "Stop");
+		if (*text == '\0')
+			return;
+
+		/* same search with the same mode */
+		if (!g_strcmp0(text, search->text) && search->query &&
+		    name_query_mode(search->query) == gtk_combo_box_get_active(search->mode))
+			return;
+
+		if (!start_search(search, text)) {
+			g_snprintf(search->msgbuf, sizeof(search->msgbuf),
+				   "Invalid pattern: '%s'", text);
+			gtk_statusbar_pop(search->status, search->ctx_id);
+			gtk_statusbar_push(search->status, search->ctx_id, search->msgbuf);
+			return;
 		}
+		g_object_set(entry, "editable", FALSE, NULL);
+		gtk_button_set_label(button, "Stop");
 	}
 	else {
 		stop_search(search, "Canceled");
 	}
 }
 
+/*
+ * Results found before the name index is built may have the CU DIE
+ * for entries from .gdb_index.  Find the DIE in the CU only when it's
+ * activated, and remember it in the row.
+ */
+static Dwarf_Off resolve_result(GtkTreeModel *model, GtkTreeIter *iter, Dwarf_Off off)
+{
+	Dwarf_Die die;
+	gchar *name;
+
+	if (dwarf_files_die(files, off, &die) == NULL ||
+	    dwarf_tag(&die) != DW_TAG_compile_unit)
+		return off;
+
+	/* rows for the CU itself (from the address search) have its name */
+	gtk_tree_model_get(model, iter, 0, &name, -1);
+	if (name && g_strcmp0(name, dwarf_diename(&die)) &&
+	    accel_resolve(&die, name, &die)) {
+		off = dwarf_files_offset(files, &die);
+		gtk_tree_store_set(GTK_TREE_STORE(model), iter, 2, off, -1);
+	}
+	g_free(name);
+	return off;
+}
+
 static void on_search_result(GtkTreeView *view, GtkTreePath *path,
 			     GtkTreeViewColumn *col, gpointer data)
 {
 	GtkTreeView *main_view = data;
 	GtkTreeModel *model = gtk_tree_view_get_model(view);
+	GtkTreeModel *main_model = gtk_tree_view_get_model(main_view);
 	GtkTreeIter iter;
 	GtkTreePath *main_path;
 	GValue val = G_VALUE_INIT;
 	gboolean expanded;
+	Dwarf_Off off;
+
+	if (main_model == NULL)
+		return;
 
 	gtk_tree_model_get_iter(model, &iter, path);
 	gtk_tree_model_get_value(model, &iter, 2, &val);
-	main_path = g_value_get_pointer(&val);
+	off = g_value_get_ulong(&val);
 	g_value_unset(&val);
 
+	off = resolve_result(model, &iter, off);
+
+	main_path = dwarview_die_model_lookup(DWARVIEW_DIE_MODEL(main_model), off);
+	if (main_path == NULL)
+		return;
+
 	expanded = gtk_tree_view_row_expanded(main_view, main_path);
 
 	gtk_tree_view_expand_to_path(main_view, main_path);
@@ -885,6 +1126,8 @@ static void on_search_result(GtkTreeView *view, GtkTreePath *path,
 	/* do not change 'expanded' status */
 	if (!expanded)
 		gtk_tree_view_collapse_row(main_view, main_path);
+
+	gtk_tree_path_free(main_path);
 }
 
 static void setup_search_status(GtkBuilder *builder)
@@ -893,12 +1136,16 @@ static void setup_search_status(GtkBuilder *builder)
 
 	search->on_going = FALSE;
 	search->text = NULL;
-	search->patt = NULL;
+	search->query = NULL;
+	search->matched = NULL;
+	search->job = NULL;
 	search->entry = GTK_SEARCH_ENTRY(gtk_builder_get_object(builder, "search_entry"));
 	search->button = GTK_BUTTON(gtk_builder_get_object(builder, "search_btn"));
 	search->func = GTK_TOGGLE_BUTTON(gtk_builder_get_object(builder, "search_func"));
 	search->var = GTK_TOGGLE_BUTTON(gtk_builder_get_object(builder, "search_var"));
+	search->type = GTK_TOGGLE_BUTTON(gtk_builder_get_object(builder, "search_type"));
 	search->decl = GTK_TOGGLE_BUTTON(gtk_builder_get_object(builder, "search_decl"));
+	search->mode = GTK_COMBO_BOX(gtk_builder_get_object(builder, "search_mode"));
 	search->result = GTK_TREE_VIEW(gtk_builder_get_object(builder, "search_view"));
 	search->main_view = GTK_TREE_VIEW(gtk_builder_get_object(builder, "main_view"));
 
@@ -952,6 +1199,7 @@ static gboolean on_attr_press(GtkWidget *widget, GdkEvent *event, gpointer data)
 	GtkTreePath *path = NULL;
 	GtkTreeModel *model = gtk_tree_view_get_model(view);
 	GtkTreeView *main_view = data;
+	GtkTreeModel *main_model = gtk_tree_view_get_model(main_view);
 	GtkTreeIter iter;
 	GValue val = G_VALUE_INIT;
 	const char *type;
@@ -978,13 +1226,17 @@ static gboolean on_attr_press(GtkWidget *widget, GdkEvent *event, gpointer data)
 	if (!ref)
 		return FALSE;
 
-	gtk_tree_model_get_value(model, &iter, 2, &val);
+	/* the unified offset of the target, it can be in another file */
+	gtk_tree_model_get_value(model, &iter, 4, &val);
 	off = g_value_get_ulong(&val);
 	g_value_unset(&val);
 
 	gtk_tree_path_free(path);
 
-	path = g_hash_table_lookup(die_map, (void *)off);
+	if (main_model == NULL)
+		return FALSE;
+
+	path = dwarview_die_model_lookup(DWARVIEW_DIE_MODEL(main_model), off);
 	if (path == NULL)
 		return FALSE;
 
@@ -999,9 +1251,138 @@ static gboolean on_attr_press(GtkWidget *widget, GdkEvent *event, gpointer data)
 	if (!expanded)
 		gtk_tree_view_collapse_row(main_view, path);
 
+	gtk_tree_path_free(path);
 	return TRUE;
 }
 
+/* move the cursor to the DIE at @off without changing the expanded state */
+static void select_die(GtkTreeView *main_view, Dwarf_Off off)
+{
+	GtkTreeModel *main_model = gtk_tree_view_get_model(main_view);
+	GtkTreePath *main_path;
+	gboolean expanded;
+
+	if (main_model == NULL)
+		return;
+
+	main_path = dwarview_die_model_lookup(DWARVIEW_DIE_MODEL(main_model), off);
+	if (main_path == NULL)
+		return;
+
+	expanded = gtk_tree_view_row_expanded(main_view, main_path);
+
+	gtk_tree_view_expand_to_path(main_view, main_path);
+	gtk_tree_view_scroll_to_cell(main_view, main_path, NULL, TRUE, 0.5, 0);  /* center align */
+	gtk_tree_view_set_cursor(main_view, main_path, NULL, FALSE);
+
+	/* do not change 'expanded' status */
+	if (!expanded)
+		gtk_tree_view_collapse_row(main_view, main_path);
+
+	gtk_tree_path_free(main_path);
+}
+
+/* jump to the innermost DIE which contains the address of the row */
+static void on_line_activated(GtkTreeView *view, GtkTreePath *path,
+			      GtkTreeViewColumn *col, gpointer data)
+{
+	GtkTreeView *main_view = data;
+	GtkTreeModel *model = gtk_tree_view_get_model(view);
+	GtkTreeIter iter;
+	GValue val = G_VALUE_INIT;
+	Dwarf_Off chain[MAX_ADDR_CHAIN];
+	Dwarf_Addr addr;
+	int nr;
+
+	if (addr_idx == NULL)
+		return;
+
+	gtk_tree_model_get_iter(model, &iter, path);
+	gtk_tree_model_get_value(model, &iter, 6, &val);
+	addr = g_value_get_ulong(&val);
+	g_value_unset(&val);
+
+	nr = addr_index_lookup(addr_idx, addr, chain, MAX_ADDR_CHAIN);
+	if (nr == 0)
+		return;
+
+	select_die(main_view, chain[nr - 1]);
+}
+
+static gboolean on_report_done(gpointer data)
+{
+	struct report_job *job = data;
+	GtkListStore *store = GTK_LIST_STORE(gtk_builder_get_object(builder, "report_store"));
+	guint i;
+
+	/* it's joined already if the file was closed */
+	if (job->thread)
+		g_thread_join(job->thread);
+
+	/* the file was closed (or reopened) */
+	if (job != report_job)
+		goto out;
+
+	report_job = NULL;
+	gtk_widget_set_sensitive(GTK_WIDGET(gtk_builder_get_object(builder, "report_btn")), TRUE);
+
+	for (i = 0; job->result && i < job->result->len; i++) {
+		struct layout_summary *sum = g_ptr_array_index(job->result, i);
+		GtkTreeIter iter;
+
+		gtk_list_store_append(store, &iter);
+		gtk_list_store_set(store, &iter, 0, sum->name, 1, (gulong)sum->size,
+				   2, (gulong)sum->wasted, 3, sum->nr_holes,
+				   4, (gulong)sum->padding, 5, (gulong)sum->off, -1);
+	}
+
+out:
+	if (job->result)
+		g_ptr_array_free(job->result, TRUE);
+	g_free(job->path);
+	g_free(job);
+	return G_SOURCE_REMOVE;
+}
+
+static gpointer report_thread(gpointer data)
+{
+	struct report_job *job = data;
+
+	job->result = layout_report(job->path, REPORT_TOP_N, &job->cancel);
+
+	g_idle_add(on_report_done, job);
+	return NULL;
+}
+
+static void on_report_clicked(GtkButton *button, gpointer data)
+{
+	if (dwarf == NULL || report_job)
+		return;
+
+	gtk_list_store_clear(GTK_LIST_STORE(gtk_builder_get_object(builder, "report_store")));
+	gtk_widget_set_sensitive(GTK_WIDGET(button), FALSE);
+
+	report_job = g_malloc0(sizeof(*report_job));
+	report_job->path = g_strdup(dwarf_path);
+	report_job->thread = g_thread_new("dwarview-report", report_thread, report_job);
+}
+
+static void on_report_activated(GtkTreeView *view, GtkTreePath *path,
+				GtkTreeViewColumn *col, gpointer data)
+{
+	GtkTreeModel *model = gtk_tree_view_get_model(view);
+	GtkTreeIter iter;
+	GValue val = G_VALUE_INIT;
+	Dwarf_Off off;
+
+	gtk_tree_model_get_iter(model, &iter, path);
+	gtk_tree_model_get_value(model, &iter, 5, &val);
+	off = g_value_get_ulong(&val);
+	g_value_unset(&val);
+
+	select_die(data, off);
+}
+
 static void add_gtk_callbacks(GtkBuilder *builder)
 {
 	gtk_builder_add_callback_symbol(builder, "on-file-open",
@@ -1018,264 +1399,268 @@ static void add_gtk_callbacks(GtkBuilder *builder)
 					G_CALLBACK(on_search_result));
 	gtk_builder_add_callback_symbol(builder, "on-attr-press",
 					G_CALLBACK(on_attr_press));
+	gtk_builder_add_callback_symbol(builder, "on-line-activated",
+					G_CALLBACK(on_line_activated));
+	gtk_builder_add_callback_symbol(builder, "on-report-clicked",
+					G_CALLBACK(on_report_clicked));
+	gtk_builder_add_callback_symbol(builder, "on-report-activated",
+					G_CALLBACK(on_report_activated));
 
 	setup_search_status(builder);
 }
 
-static const char *die_name(Dwarf_Die *die)
+/* @name should be valid until the file is closed */
+static void add_search_item(const char *name, Dwarf_Off off, int kind, guint64 sig)
+{
+	struct search_item item = {
+		.name = name,
+		.off = off,
+	};
+
+	if (kind == INDEX_TYPE)
+		type_index_add(types, name, sig, off);
+	else if (kind == INDEX_FUNC)
+		g_array_append_val(func_items, item);
+	else
+		g_array_append_val(var_items, item);
+}
+
+/*
+ * Entries in a split unit have the offset in the split file.  The file
+ * number is given when the split unit is seen here first.
+ */
+static Dwarf_Off split_entry_off(struct index_entry *entry)
 {
+	Dwarf_Die cudie, split;
 	Dwarf_Off off;
-	Dwarf_Die pos = *die;
-	Dwarf_Die origin;
-	Dwarf_Attribute attr;
-	const char *name;
-	static char buf[4096];
-
-	switch (dwarf_tag(die)) {
-	case DW_TAG_structure_type:
-	case DW_TAG_union_type:
-	case DW_TAG_enumeration_type:
-	case DW_TAG_class_type:
-	case DW_TAG_interface_type:
-	case DW_TAG_subroutine_type:
-	case DW_TAG_const_type:
-	case DW_TAG_volatile_type:
-	case DW_TAG_restrict_type:
-	case DW_TAG_pointer_type:
-	case DW_TAG_ptr_to_member_type:
-	case DW_TAG_reference_type:
-	case DW_TAG_rvalue_reference_type:
-	case DW_TAG_array_type:
-		return type_name(die);
-	default:
-		break;
-	}
 
-	while (true) {
-		if (dwarf_attr(&pos, DW_AT_name, &attr))
-			return dwarf_formstring(&attr);
-		/* use linkage name only if it can demangle the name */
-		if (dwarf_attr(&pos, DW_AT_linkage_name, &attr) && demangler_enabled()) {
-			demangle(dwarf_formstring(&attr), buf, sizeof(buf));
-			return buf;
-		}
+	if (dwarf_offdie(dwarf, entry->skel, &cudie) == NULL ||
+	    !dwarf_files_split_unit(files, &cudie, &split))
+		return -1;
+
+	off = dwarf_files_offset(files, &split);
+	if (off == (Dwarf_Off)-1)
+		return -1;
 
-		if (dwarf_attr(&pos, DW_AT_abstract_origin, &attr) == NULL &&
-		    dwarf_attr(&pos, DW_AT_specification, &attr) == NULL &&
-		    dwarf_attr(&pos, DW_AT_import, &attr) == NULL)
-			goto out;
+	return die_file_off(die_file_of(off), entry->off);
+}
 
-		if (dwarf_formref_die(&attr, &origin) == NULL)
-			goto out;
+/* names in the file are used as is, others are copied to the arena */
+static void add_index_entry(struct index_entry *entry)
+{
+	const char *name = entry->str;
+	Dwarf_Off off = entry->off;
 
-		pos = origin;
+	if (entry->skel) {
+		off = split_entry_off(entry);
+		if (off == (Dwarf_Off)-1)
+			return;
+		arg->split = true;
 	}
-out:
-	return "(no name)";
+
+	if (name == NULL)
+		name = g_string_chunk_insert_const(name_arena, entry->name);
+
+	add_search_item(name, off, entry->kind, entry->sig);
 }
 
-static void walk_die(Dwarf_Die *die, GtkTreeStore *store, GtkTreeIter *parent, int level)
+static GPtrArray *items_to_array(GArray *items)
 {
-	GtkTreeIter iter;
-	GtkTreePath *path;
-	Dwarf_Die next;
-	int tag = dwarf_tag(die);
-	const gchar *name = die_name(die);
-	gchar *markup = NULL;
-	char buf[32];
+	GPtrArray *array = g_ptr_array_sized_new(items->len);
+	guint i;
 
-	if (dwarf_hasattr(die, DW_AT_declaration) || tag == DW_TAG_imported_declaration) {
-		const char *decl = "(decl)";
+	for (i = 0; i < items->len; i++)
+		g_ptr_array_add(array, &g_array_index(items, struct search_item, i));
 
-		if (tag == DW_TAG_imported_declaration)
-			decl = "";
+	return array;
+}
 
-		markup = g_strdup_printf("<span foreground=\"grey\">%s %s</span>",
-					 dwarview_tag_name(tag), decl, -1);
-	}
+static gpointer build_name_index(gpointer data)
+{
+	struct content_arg *arg = data;
 
-	snprintf(buf, sizeof(buf), "%#lx", dwarf_dieoffset(die));
-	gtk_tree_store_append(store, &iter, parent);
-	gtk_tree_store_set(store, &iter, 0, buf,
-			   1, markup ?: dwarview_tag_name(tag),
-			   2, name, -1);
-	g_free(markup);
-
-	path = gtk_tree_model_get_path(GTK_TREE_MODEL(store), &iter);
-	g_hash_table_insert(die_map, (void *)dwarf_dieoffset(die), path);
-
-	/* currently function and variable type can be searched */
-	switch (tag) {
-	case DW_TAG_subprogram:
-	case DW_TAG_inlined_subroutine:
-	case DW_TAG_entry_point:
-		if (g_strcmp0(name, "(no name)")) {
-			struct search_item *item = g_malloc(sizeof(*item));
-			bool is_first = (func_list == NULL);
-
-			item->name = g_strdup(name);
-			item->path = path;
-			func_list = g_list_prepend(func_list, item);
-
-			if (is_first)
-				func_first = func_list;
-		}
-		break;
-	case DW_TAG_variable:
-	case DW_TAG_constant:
-		if (g_strcmp0(name, "(no name)")) {
-			struct search_item *item = g_malloc(sizeof(*item));
-			bool is_first = (var_list == NULL);
-
-			item->name = g_strdup(name);
-			item->path = path;
-			var_list = g_list_prepend(var_list, item);
-
-			if (is_first)
-				var_first = var_list;
-		}
-		break;
-	default:
-		break;
-	}
+	arg->new_index[0] = name_index_new(arg->index_items[0]);
+	arg->new_index[1] = name_index_new(arg->index_items[1]);
+	arg->new_index[2] = name_index_new(arg->index_items[2]);
 
-	if (dwarf_haschildren(die)) {
-		if (dwarf_child(die, &next)) {
-			printf("bug?\n");
-			return;
-		}
-		walk_die(&next, store, &iter, level+1);
+	g_atomic_int_set(&arg->index_done, 1);
+	return NULL;
+}
+
+/* the arrays don't change anymore, sort them in a separate thread */
+static void start_name_index(struct content_arg *arg)
+{
+	arg->index_items[0] = items_to_array(func_items);
+	arg->index_items[1] = items_to_array(var_items);
+	arg->index_items[2] = type_index_items(types);
+
+	arg->index_thread = g_thread_new("dwarview-index", build_name_index, arg);
+}
+
+/* returns true when the name index is ready */
+static bool finish_name_index(struct content_arg *arg)
+{
+	if (!g_atomic_int_get(&arg->index_done))
+		return false;
+
+	g_thread_join(arg->index_thread);
+	arg->index_thread = NULL;
+
+	func_index = arg->new_index[0];
+	var_index = arg->new_index[1];
+	type_index = arg->new_index[2];
+	return true;
+}
+
+/* replace linkage names which were not demangled when the loader saw them */
+static void fixup_search_names(GArray *items)
+{
+	char buf[4096];
+	guint i;
+
+	for (i = 0; i < items->len; i++) {
+		struct search_item *item = &g_array_index(items, struct search_item, i);
+
+		if (!demangle_external_name(item->name))
+			continue;
+
+		demangle(item->name, buf, sizeof(buf));
+		item->name = g_string_chunk_insert_const(name_arena, buf);
 	}
+}
 
-	if (level == 1)
-		return;
+#define MERGE_INTERVAL  100  /* msec */
+#define MERGE_BUDGET    20   /* msec, leave the rest of the interval to the UI */
+#define DEMANGLE_WAIT   10   /* sec, keep linkage names if c++filt is slower */
 
-	if (dwarf_siblingof(die, &next) != 0)
-		return;
+static void show_progress(struct content_arg *arg)
+{
+	double elapsed = (g_get_monotonic_time() - arg->start_time) / 1e6;
+	double rate = elapsed > 0 ? arg->done_size / elapsed : 0;
+	char eta[32] = "?";
+
+	/* total_size is unknown if it's -1 */
+	if (rate > 0 && arg->total_size >= arg->done_size && arg->total_size != (size_t)-1) {
+		unsigned long remain = (arg->total_size - arg->done_size) / rate;
 
-	walk_die(&next, store, parent, level);
+		g_snprintf(eta, sizeof(eta), "%lu:%02lu", remain / 60, remain % 60);
+	}
+
+	g_snprintf(arg->msgbuf, sizeof(arg->msgbuf),
+		   "Opening %s ... %lu/%lu KB (%.1f MB/s, ETA %s)", arg->filename,
+		   arg->done_size >> 10, arg->total_size >> 10, rate / (1024 * 1024), eta);
+	gtk_statusbar_push(arg->status, arg->status_ctx, arg->msgbuf);
 }
 
-static void destroy_item(gpointer data)
+/* the search items are complete, save them and build the name index */
+static void finish_loading(struct content_arg *arg)
 {
-	struct search_item *item = data;
+	arg->demangle_start = 0;
+
+	fixup_search_names(func_items);
+	fixup_search_names(var_items);
 
-	gtk_tree_path_free(item->path);
-	g_free(item->name);
-	g_free(item);
+	/*
+	 * do not save linkage names which would be demangled later.  File
+	 * numbers of split units depend on the order they were seen.
+	 */
+	if (!arg->error && !arg->split && build_id && !demangle_pending())
+		index_cache_save(build_id, arg->total_size, dwarf, func_items, var_items, types);
+
+	/* keep the timer until the name index is built */
+	start_name_index(arg);
 }
 
-static guint add_die_content(void *_arg)
+/* move search entries built by the loader threads into the arrays */
+static guint merge_index(void *_arg)
 {
 	struct content_arg *arg = _arg;
-	GtkTreeStore *main_store = arg->main_store;
-	GtkTreeIter iter, func, vars, type, misc;
-	Dwarf_Off off = arg->off;
-	Dwarf_Off next;
-	Dwarf_Die die, child;
-	size_t sz;
-	char buf[32];
+	struct index_batch *batch;
+	gint64 deadline = g_get_monotonic_time() + MERGE_BUDGET * 1000;
+	guint i;
+
+	if (arg->loader == NULL) {
+		/* on_demangled() finishes it unless c++filt takes too long */
+		if (arg->demangle_start) {
+			if (g_get_monotonic_time() - arg->demangle_start <
+			    DEMANGLE_WAIT * G_USEC_PER_SEC)
+				return TRUE;
+			finish_loading(arg);
+		}
 
-	if (dwarf_nextcu(dwarf, off, &next, &sz, NULL, NULL, NULL)) {
-		gtk_statusbar_pop(arg->status, arg->status_ctx);
-		g_snprintf(arg->msgbuf, sizeof(arg->msgbuf), "Opening %s ... Done!", arg->filename);
-		gtk_statusbar_push(arg->status, arg->status_ctx, arg->msgbuf);
-		return FALSE;
-	}
+		if (!finish_name_index(arg))
+			return TRUE;
 
-	if (dwarf_offdie(dwarf, off + sz, &die) == NULL) {
-		g_snprintf(arg->msgbuf, sizeof(arg->msgbuf), "Error: cannot find offset %lx for %s",
-			   off + sz, arg->filename);
-		gtk_statusbar_push(arg->status, arg->status_ctx, arg->msgbuf);
+		arg->merge_id = 0;
 		return FALSE;
 	}
 
-	snprintf(buf, sizeof(buf), "%#lx", off + sz);
-	gtk_tree_store_append(main_store, &iter, NULL);
-	gtk_tree_store_set(main_store, &iter, 0, buf,
-			   1, dwarview_tag_name(dwarf_tag(&die)),
-			   2, dwarf_diename(&die), -1);
-
-	g_hash_table_insert(die_map, (void *)(off + sz),
-			    gtk_tree_model_get_path(GTK_TREE_MODEL(main_store), &iter));
-
-	gtk_tree_store_append(main_store, &func, &iter);
-	gtk_tree_store_set(main_store, &func, 0, "", 1, "meta", 2, "functions", -1);
-	gtk_tree_store_append(main_store, &vars, &iter);
-	gtk_tree_store_set(main_store, &vars, 0, "", 1, "meta", 2, "variables", -1);
-	gtk_tree_store_append(main_store, &type, &iter);
-	gtk_tree_store_set(main_store, &type, 0, "", 1, "meta", 2, "types", -1);
-	gtk_tree_store_append(main_store, &misc, &iter);
-	gtk_tree_store_set(main_store, &misc, 0, "", 1, "meta", 2, "others", -1);
-
-	arg->off = next;
-	if (dwarf_child(&die, &child) != 0)
-		return TRUE;
-
-	do {
-		GtkTreeIter *parent;
+	/* the rest will be merged in the next tick */
+	while (g_get_monotonic_time() < deadline &&
+	       (batch = loader_pop(arg->loader)) != NULL) {
+		for (i = 0; i < batch->items->len; i++) {
+			struct index_entry *entry;
 
-		switch (dwarf_tag(&child)) {
-		case DW_TAG_subprogram:
-		case DW_TAG_inlined_subroutine:
-		case DW_TAG_entry_point:
-			parent = &func;
-			break;
-		case DW_TAG_base_type:
-		case DW_TAG_array_type:
-		case DW_TAG_class_type:
-		case DW_TAG_enumeration_type:
-		case DW_TAG_pointer_type:
-		case DW_TAG_reference_type:
-		case DW_TAG_string_type:
-		case DW_TAG_structure_type:
-		case DW_TAG_subroutine_type:
-		case DW_TAG_union_type:
-		case DW_TAG_set_type:
-		case DW_TAG_subrange_type:
-		case DW_TAG_const_type:
-		case DW_TAG_file_type:
-		case DW_TAG_packed_type:
-		case DW_TAG_thrown_type:
-		case DW_TAG_volatile_type:
-		case DW_TAG_restrict_type:
-		case DW_TAG_interface_type:
-		case DW_TAG_unspecified_type:
-		case DW_TAG_shared_type:
-		case DW_TAG_ptr_to_member_type:
-		case DW_TAG_rvalue_reference_type:
-		case DW_TAG_typedef:
-			parent = &type;
-			break;
-		case DW_TAG_variable:
-			parent = &vars;
-			break;
-		default:
-			parent = &misc;
-			break;
+			entry = &g_array_index(batch->items, struct index_entry, i);
+			add_index_entry(entry);
 		}
 
-		gtk_statusbar_pop(arg->status, arg->status_ctx);
-		g_snprintf(arg->msgbuf, sizeof(arg->msgbuf), "Opening %s ... (%lu/%lu)",
-			   arg->filename, off, arg->total_size);
-		gtk_statusbar_push(arg->status, arg->status_ctx, arg->msgbuf);
-		walk_die(&child, main_store, parent, 1);
+		arg->done_size += batch->bytes;
+		arg->error |= batch->error;
+
+		loader_free_batch(batch);
+	}
+
+	gtk_statusbar_pop(arg->status, arg->status_ctx);
+
+	if (!loader_done(arg->loader)) {
+		show_progress(arg);
+		return TRUE;
 	}
-	while (dwarf_siblingof(&child, &child) == 0);
 
+	if (arg->error)
+		g_snprintf(arg->msgbuf, sizeof(arg->msgbuf), "Error: cannot read %s", arg->filename);
+	else
+		g_snprintf(arg->msgbuf, sizeof(arg->msgbuf), "Opening %s ... Done!", arg->filename);
+	gtk_statusbar_push(arg->status, arg->status_ctx, arg->msgbuf);
+
+	loader_destroy(arg->loader);
+	arg->loader = NULL;
+
+	/* most of them should be done while loading, do not wait for the rest */
+	if (demangle_pending())
+		arg->demangle_start = g_get_monotonic_time();
+	else
+		finish_loading(arg);
 	return TRUE;
 }
 
 static void add_contents(GtkBuilder *builder, char *filename)
 {
+	struct index_cache *cache;
 	Elf_Data *data;
+	GArray *entries;
+	guint i;
 
 	arg = g_malloc(sizeof(*arg));
 	arg->builder = builder;
 	arg->filename = filename;
-	arg->off = 0;
-
-	arg->main_store = GTK_TREE_STORE(gtk_builder_get_object(builder, "main_store"));
+	arg->done_size = 0;
+	arg->start_time = g_get_monotonic_time();
+	arg->error = false;
+	arg->split = false;
+	arg->loader = NULL;
+	arg->merge_id = 0;
+	arg->index_thread = NULL;
+	arg->index_done = 0;
+	arg->demangle_start = 0;
+
+	types = type_index_new();
+	func_items = g_array_new(FALSE, FALSE, sizeof(struct search_item));
+	var_items = g_array_new(FALSE, FALSE, sizeof(struct search_item));
+	name_arena = g_string_chunk_new(64 * 1024);
+
+	arg->main_view = GTK_TREE_VIEW(gtk_builder_get_object(builder, "main_view"));
 	arg->attr_store = GTK_TREE_STORE(gtk_builder_get_object(builder, "attr_store"));
 	arg->status = GTK_STATUSBAR(gtk_builder_get_object(builder, "status"));
 
@@ -1284,15 +1669,76 @@ static void add_contents(GtkBuilder *builder, char *filename)
 	g_snprintf(arg->msgbuf, sizeof(arg->msgbuf), "Opening %s ...", filename);
 	gtk_statusbar_push(arg->status, arg->status_ctx, arg->msgbuf);
 
-	die_map = g_hash_table_new(g_direct_hash, g_direct_equal);
-
 	data = get_elf_secdata(dwarf_getelf(dwarf), ".debug_info");
 	if (data)
 		arg->total_size = data->d_size;
 	else
 		arg->total_size = -1;  /* XXX */
 
-	g_idle_add((GSourceFunc)add_die_content, arg);
+	if (build_id && (cache = index_cache_open(build_id, arg->total_size))) {
+		const Dwarf_Off *cu_offs;
+		guint nr_cu;
+
+		cu_offs = index_cache_cus(cache, &nr_cu);
+		arg->model = dwarview_die_model_new(files, die_name, cu_offs, nr_cu);
+		gtk_tree_view_set_model(arg->main_view, GTK_TREE_MODEL(arg->model));
+
+		for (i = 0; i < index_cache_nr_entry(cache); i++) {
+			const char *name;
+			Dwarf_Off off;
+			guint64 sig;
+			int kind;
+
+			name = index_cache_entry(cache, i, &off, &kind, &sig);
+			add_search_item(name, off, kind, sig);
+		}
+		/* search items point to the names in the cache */
+		index_cache = cache;
+
+		gtk_statusbar_pop(arg->status, arg->status_ctx);
+		g_snprintf(arg->msgbuf, sizeof(arg->msgbuf), "Opening %s ... Done! (cached)", filename);
+		gtk_statusbar_push(arg->status, arg->status_ctx, arg->msgbuf);
+
+		start_name_index(arg);
+		arg->merge_id = g_timeout_add(MERGE_INTERVAL, (GSourceFunc)merge_index, arg);
+		return;
+	}
+
+	/* it only reads CU headers, children are read when expanded */
+	arg->model = dwarview_die_model_new(files, die_name, NULL, 0);
+	gtk_tree_view_set_model(arg->main_view, GTK_TREE_MODEL(arg->model));
+
+	/* no need to walk DIEs if the file has an accelerator table */
+	if ((entries = accel_read(dwarf)) != NULL) {
+		bool has_type = false;
+
+		for (i = 0; i < entries->len; i++) {
+			struct index_entry *entry = &g_array_index(entries, struct index_entry, i);
+
+			add_index_entry(entry);
+			has_type |= entry->kind == INDEX_TYPE;
+		}
+		accel_free(entries);
+
+		/* .gdb_index doesn't tell where types are, walk DIEs for them */
+		if (!has_type) {
+			arg->loader = loader_new(dwarf, dwarf_path, die_name, true);
+			arg->merge_id = g_timeout_add(MERGE_INTERVAL, (GSourceFunc)merge_index, arg);
+			return;
+		}
+
+		gtk_statusbar_pop(arg->status, arg->status_ctx);
+		g_snprintf(arg->msgbuf, sizeof(arg->msgbuf), "Opening %s ... Done! (indexed)", filename);
+		gtk_statusbar_push(arg->status, arg->status_ctx, arg->msgbuf);
+
+		start_name_index(arg);
+		arg->merge_id = g_timeout_add(MERGE_INTERVAL, (GSourceFunc)merge_index, arg);
+		return;
+	}
+
+	/* build the search list in the background */
+	arg->loader = loader_new(dwarf, dwarf_path, die_name, false);
+	arg->merge_id = g_timeout_add(MERGE_INTERVAL, (GSourceFunc)merge_index, arg);
 }
 
 static int try_add_builder(GtkBuilder *builder)
@@ -1341,10 +1787,30 @@ static int try_add_builder(GtkBuilder *builder)
 	return -1;
 }
 
+/* show the demangled names instead of linkage names */
+static gboolean on_demangled(gpointer data)
+{
+	GtkBuilder *builder = data;
+
+	gtk_widget_queue_draw(GTK_WIDGET(gtk_builder_get_object(builder, "main_view")));
+
+	/* the search names were waiting for the last ones */
+	if (arg && arg->demangle_start && !demangle_pending())
+		finish_loading(arg);
+	return G_SOURCE_REMOVE;
+}
+
 int main(int argc, char *argv[])
 {
 	GtkWidget  *window;
 
+	if (getenv("DWARVIEW_DEBUG"))
+		dwarview_debug = true;
+
+	/* it doesn't need a display */
+	if (cli_requested(argc, argv))
+		return dwarview_cli(argc, argv);
+
 	gtk_init_check(&argc, &argv);
 
 	builder = gtk_builder_new();
@@ -1354,6 +1820,7 @@ int main(int argc, char *argv[])
 	}
 
 	setup_demangler();
+	demangle_set_notify(on_demangled, builder);
 
 	window = GTK_WIDGET(gtk_builder_get_object(builder, "root_window"));
 	gtk_widget_show(window);
@@ -0,0 +1,287 @@
+/*
+ * dwarview - DWARF debug info viewer
+ *
+ * Copyright (C) 2016  Namhyung Kim <namhyung@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 or later of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+/*
+ * Search queries.
+ *
+ * A query matches names with a glob pattern, a regular expression or
+ * fuzzy (subsequence) matching.  It also provides what the name index
+ * needs to skip names before running the matcher: literal strings
+ * which every matching name contains (for the trigram index) and a
+ * mask of the characters in the pattern (for fuzzy matching).
+ *
+ * Fuzzy matching is ranked like fzf: every character of the pattern
+ * should be found in order (ignoring case), and matches at word
+ * boundaries and consecutive characters score higher while gaps lower
+ * the score.
+ */
+
+#include <string.h>
+
+#include "dwarview.h"
+
+struct name_query {
+	int mode;		/* enum match_mode */
+	gchar *pattern;
+	gchar **literals;	/* NULL-terminated */
+	size_t prefix_len;	/* for glob only */
+	guint64 mask;		/* for fuzzy only */
+
+	GPatternSpec *patt;
+	GRegex *regex;
+};
+
+/* score of fuzzy matching */
+#define SCORE_MATCH        16
+#define SCORE_BOUNDARY      8
+#define SCORE_CONSECUTIVE   4
+#define SCORE_GAP          -1
+
+/* different characters can share a bit, it only filters out names */
+guint64 name_char_mask(const char *name)
+{
+	guint64 mask = 0;
+
+	for (; *name; name++)
+		mask |= 1ULL << (g_ascii_tolower(*name) % 64);
+	return mask;
+}
+
+/* literals are separated by wildcards */
+static gchar **glob_literals(const char *pattern)
+{
+	return g_strsplit_set(pattern, "*?", -1);
+}
+
+/*
+ * Returns literals which should be in any matching string.  It gives
+ * up (returns none) on alternation or options.  A run of literal
+ * characters ends at any meta character, and the character before a
+ * quantifier is dropped as it can be missing.  Groups are skipped as
+ * they can be optional.
+ */
+static gchar **regex_literals(const char *pattern)
+{
+	GPtrArray *lits = g_ptr_array_new();
+	GString *run = g_string_new(NULL);
+	const char *p;
+	int depth = 0;
+
+	if (strchr(pattern, '|') || strstr(pattern, "(?"))
+		goto out;
+
+	for (p = pattern; *p; p++) {
+		switch (*p) {
+		case '*':
+		case '?':
+			if (run->len)
+				g_string_truncate(run, run->len - 1);
+			break;
+		case '{':
+			if (run->len)
+				g_string_truncate(run, run->len - 1);
+			while (p[1] && *p != '}')
+				p++;
+			break;
+		case '\\':
+			if (p[1])
+				p++;
+			break;
+		case '[':
+			/* ']' right after '[' (or '[^') is a member */
+			if (p[1] == '^')
+				p++;
+			if (p[1] == ']')
+				p++;
+			while (p[1] && p[1] != ']')
+				p++;
+			if (p[1])
+				p++;
+			break;
+		case '(':
+			depth++;
+			break;
+		case ')':
+			depth--;
+			break;
+		case '.':
+		case '^':
+		case '$':
+		case '+':
+			break;
+		default:
+			if (depth == 0) {
+				g_string_append_c(run, *p);
+				continue;
+			}
+			break;
+		}
+
+		if (run->len)
+			g_ptr_array_add(lits, g_strdup(run->str));
+		g_string_truncate(run, 0);
+	}
+
+	if (run->len)
+		g_ptr_array_add(lits, g_strdup(run->str));
+
+out:
+	g_string_free(run, TRUE);
+	g_ptr_array_add(lits, NULL);
+	return (gchar **)g_ptr_array_free(lits, FALSE);
+}
+
+/* returns NULL if @pattern is not a valid regex */
+struct name_query *name_query_new(const char *pattern, int mode)
+{
+	struct name_query *q = g_malloc0(sizeof(*q));
+
+	q->mode = mode;
+	q->pattern = g_strdup(pattern);
+
+	switch (mode) {
+	case MATCH_GLOB:
+		q->patt = g_pattern_spec_new(pattern);
+		q->literals = glob_literals(pattern);
+		q->prefix_len = strcspn(pattern, "*?");
+		break;
+	case MATCH_REGEX:
+		q->regex = g_regex_new(pattern, G_REGEX_OPTIMIZE, 0, NULL);
+		if (q->regex == NULL) {
+			name_query_free(q);
+			return NULL;
+		}
+		q->literals = regex_literals(pattern);
+		break;
+	case MATCH_FUZZY:
+		q->literals = g_new0(gchar *, 1);
+		q->mask = name_char_mask(pattern);
+		break;
+	}
+	return q;
+}
+
+void name_query_free(struct name_query *q)
+{
+	if (q->patt)
+		g_pattern_spec_free(q->patt);
+	if (q->regex)
+		g_regex_unref(q->regex);
+	g_strfreev(q->literals);
+	g_free(q->pattern);
+	g_free(q);
+}
+
+int name_query_mode(struct name_query *q)
+{
+	return q->mode;
+}
+
+/* returns the length of the literal prefix which all matching names have */
+size_t name_query_prefix(struct name_query *q, const char **prefix)
+{
+	*prefix = q->pattern;
+	return q->prefix_len;
+}
+
+/* returns literal strings (NULL-terminated) which all matching names have */
+gchar **name_query_literals(struct name_query *q)
+{
+	return q->literals;
+}
+
+/* matching names should have all characters in the mask */
+guint64 name_query_mask(struct name_query *q)
+{
+	return q->mask;
+}
+
+static bool is_boundary(const char *name, const char *p)
+{
+	if (p == name)
+		return true;
+
+	/* after a separator or at a camelCase hump */
+	return !g_ascii_isalnum(p[-1]) ||
+		(g_ascii_islower(p[-1]) && g_ascii_isupper(p[0]));
+}
+
+static int fuzzy_score(const char *pattern, const char *name)
+{
+	const char *start, *end, *p, *q;
+	int score = 0;
+	int run = 0;
+
+	/* find the first window which has all the pattern characters */
+	for (p = pattern, q = name; *p && *q; q++) {
+		if (g_ascii_tolower(*p) == g_ascii_tolower(*q))
+			p++;
+	}
+	if (*p)
+		return -1;
+	end = q;
+
+	/* then shrink it from the end, as fzf does */
+	p = pattern + strlen(pattern);
+	for (q = end; p > pattern; ) {
+		q--;
+		if (g_ascii_tolower(p[-1]) == g_ascii_tolower(*q))
+			p--;
+	}
+	start = q;
+
+	for (p = pattern, q = start; *p; q++) {
+		if (g_ascii_tolower(*p) != g_ascii_tolower(*q)) {
+			score += SCORE_GAP;
+			run = 0;
+			continue;
+		}
+
+		score += SCORE_MATCH + run * SCORE_CONSECUTIVE;
+		if (is_boundary(name, q))
+			score += SCORE_BOUNDARY;
+
+		run++;
+		p++;
+	}
+
+	/* prefer shorter names */
+	return MAX(score - (int)strlen(name) / 8, 0);
+}
+
+/* returns -1 if @name doesn't match, otherwise the score (0 if not ranked) */
+int name_query_score(struct name_query *q, const char *name)
+{
+	switch (q->mode) {
+	case MATCH_GLOB:
+		return g_pattern_match_string(q->patt, name) ? 0 : -1;
+	case MATCH_REGEX:
+		return g_regex_match(q->regex, name, 0, NULL) ? 0 : -1;
+	case MATCH_FUZZY:
+		return fuzzy_score(q->pattern, name);
+	default:
+		return -1;
+	}
+}
+
+bool name_query_match(struct name_query *q, const char *name)
+{
+	return name_query_score(q, name) >= 0;
+}
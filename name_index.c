@@ -0,0 +1,540 @@
+/*
+ * dwarview - DWARF debug info viewer
+ *
+ * Copyright (C) 2016  Namhyung Kim <namhyung@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 or later of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * Name index for glob search.
+ *
+ * Search items are sorted by name and items with the same name (e.g.
+ * inlined instances of a function) form a group.  A pattern with a
+ * literal prefix is resolved by binary search.  Otherwise a trigram
+ * index of the group names gives the candidates which contain all the
+ * literal parts of the pattern.  Only patterns without any literal of
+ * 3 or more characters need to check every name.
+ *
+ * Regex queries use the trigram index the same way with the literals
+ * extracted from the pattern.  Fuzzy queries check a mask of the
+ * characters in each name before scoring it, and only the best
+ * NAME_TOP_K names are kept in a bounded heap.
+ *
+ * When many names should be checked, they are split into shards which
+ * are matched in parallel by a thread pool.  Shards are contiguous
+ * ranges of sorted names, so concatenating their results in order
+ * keeps them sorted.  A search can be canceled by setting @cancel.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "dwarview.h"
+
+/* the number of trigram buckets follows the number of names */
+#define TRIGRAM_MIN_BITS  10
+#define TRIGRAM_MAX_BITS  20
+#define NAMES_PER_BUCKET  4
+
+#define SHARD_MIN     16384  /* names to check in a shard */
+#define CANCEL_CHECK  1024   /* check cancellation every this many names */
+
+struct name_index {
+	struct search_item **items;	/* sorted by name */
+	guint32 nr_item;
+
+	guint32 *groups;		/* first item of each name */
+	guint32 nr_group;
+	guint64 *masks;			/* name_char_mask() of each name */
+
+	/* postings of bucket b are in postings[bucket_start[b] .. bucket_start[b+1]) */
+	guint32 bucket_bits;
+	guint32 nr_bucket;
+	guint32 *bucket_start;
+	guint32 *postings;
+};
+
+static int cmp_item(const void *a, const void *b)
+{
+	const struct search_item *item_a = *(const struct search_item **)a;
+	const struct search_item *item_b = *(const struct search_item **)b;
+
+	return strcmp(item_a->name, item_b->name);
+}
+
+static inline const char *group_name(struct name_index *idx, guint32 g)
+{
+	return idx->items[idx->groups[g]]->name;
+}
+
+static inline guint32 group_end(struct name_index *idx, guint32 g)
+{
+	return g + 1 < idx->nr_group ? idx->groups[g + 1] : idx->nr_item;
+}
+
+/* different trigrams can share a bucket, candidates are checked anyway */
+static inline guint32 trigram_bucket(struct name_index *idx, const char *s)
+{
+	guint32 t = (guint8)s[0] | (guint8)s[1] << 8 | (guint8)s[2] << 16;
+
+	return (t * 0x9E3779B1U) >> (32 - idx->bucket_bits);
+}
+
+static void build_trigrams(struct name_index *idx)
+{
+	guint32 *last;
+	guint32 *pos;
+	guint32 b, g;
+
+	idx->bucket_bits = TRIGRAM_MIN_BITS;
+	while (idx->bucket_bits < TRIGRAM_MAX_BITS &&
+	       (1U << idx->bucket_bits) < idx->nr_group / NAMES_PER_BUCKET)
+		idx->bucket_bits++;
+	idx->nr_bucket = 1U << idx->bucket_bits;
+
+	idx->bucket_start = g_malloc0((idx->nr_bucket + 1) * sizeof(*idx->bucket_start));
+	last = g_malloc(idx->nr_bucket * sizeof(*last));
+
+	/* count postings, a name is added once for each bucket */
+	memset(last, 0xff, idx->nr_bucket * sizeof(*last));
+	for (g = 0; g < idx->nr_group; g++) {
+		const char *s;
+
+		for (s = group_name(idx, g); s[0] && s[1] && s[2]; s++) {
+			b = trigram_bucket(idx, s);
+			if (last[b] == g)
+				continue;
+
+			last[b] = g;
+			idx->bucket_start[b + 1]++;
+		}
+	}
+
+	for (b = 0; b < idx->nr_bucket; b++)
+		idx->bucket_start[b + 1] += idx->bucket_start[b];
+
+	idx->postings = g_malloc(idx->bucket_start[idx->nr_bucket] * sizeof(*idx->postings));
+	pos = g_memdup2(idx->bucket_start, idx->nr_bucket * sizeof(*pos));
+
+	/* fill postings, they are sorted by group as we add them in order */
+	memset(last, 0xff, idx->nr_bucket * sizeof(*last));
+	for (g = 0; g < idx->nr_group; g++) {
+		const char *s;
+
+		for (s = group_name(idx, g); s[0] && s[1] && s[2]; s++) {
+			b = trigram_bucket(idx, s);
+			if (last[b] == g)
+				continue;
+
+			last[b] = g;
+			idx->postings[pos[b]++] = g;
+		}
+	}
+
+	g_free(pos);
+	g_free(last);
+}
+
+/* takes ownership of @items (array of struct search_item pointers) */
+struct name_index *name_index_new(GPtrArray *items)
+{
+	struct name_index *idx = g_malloc0(sizeof(*idx));
+	GArray *groups = g_array_new(FALSE, FALSE, sizeof(guint32));
+	guint32 i;
+
+	idx->nr_item = items->len;
+	idx->items = (struct search_item **)g_ptr_array_free(items, FALSE);
+
+	qsort(idx->items, idx->nr_item, sizeof(*idx->items), cmp_item);
+
+	for (i = 0; i < idx->nr_item; i++) {
+		if (i == 0 || strcmp(idx->items[i - 1]->name, idx->items[i]->name))
+			g_array_append_val(groups, i);
+	}
+	idx->nr_group = groups->len;
+	idx->groups = (guint32 *)g_array_free(groups, FALSE);
+
+	idx->masks = g_malloc(idx->nr_group * sizeof(*idx->masks));
+	for (i = 0; i < idx->nr_group; i++)
+		idx->masks[i] = name_char_mask(group_name(idx, i));
+
+	build_trigrams(idx);
+
+	pr_dbg("name index: %u items, %u names, %u buckets, %u postings\n", idx->nr_item,
+	       idx->nr_group, idx->nr_bucket, idx->bucket_start[idx->nr_bucket]);
+	return idx;
+}
+
+void name_index_free(struct name_index *idx)
+{
+	g_free(idx->items);
+	g_free(idx->groups);
+	g_free(idx->masks);
+	g_free(idx->bucket_start);
+	g_free(idx->postings);
+	g_free(idx);
+}
+
+static void add_group(struct name_index *idx, guint32 g, GPtrArray *result)
+{
+	guint32 i;
+
+	for (i = idx->groups[g]; i < group_end(idx, g); i++)
+		g_ptr_array_add(result, idx->items[i]);
+}
+
+/* first group whose name is not less than @prefix (compared up to @len) */
+static guint32 lower_bound(struct name_index *idx, const char *prefix, size_t len)
+{
+	guint32 lo = 0;
+	guint32 hi = idx->nr_group;
+
+	while (lo < hi) {
+		guint32 mid = (lo + hi) / 2;
+
+		if (strncmp(group_name(idx, mid), prefix, len) < 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+/* first group whose name is greater than @prefix (compared up to @len) */
+static guint32 upper_bound(struct name_index *idx, const char *prefix, size_t len)
+{
+	guint32 lo = 0;
+	guint32 hi = idx->nr_group;
+
+	while (lo < hi) {
+		guint32 mid = (lo + hi) / 2;
+
+		if (strncmp(group_name(idx, mid), prefix, len) <= 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+struct ranked {
+	int score;
+	guint32 group;
+};
+
+/* a min-heap of the best results, the worst one is at the top */
+struct top_k {
+	struct ranked heap[NAME_TOP_K];
+	guint nr;
+};
+
+/* lower score, or the same score but later in the order */
+static inline bool worse(const struct ranked *a, const struct ranked *b)
+{
+	return a->score < b->score || (a->score == b->score && a->group > b->group);
+}
+
+static void top_k_add(struct top_k *top, int score, guint32 group)
+{
+	struct ranked r = {
+		.score = score,
+		.group = group,
+	};
+	guint i, c;
+
+	if (top->nr < NAME_TOP_K) {
+		for (i = top->nr++; i > 0 && worse(&r, &top->heap[(i - 1) / 2]); i = (i - 1) / 2)
+			top->heap[i] = top->heap[(i - 1) / 2];
+		top->heap[i] = r;
+		return;
+	}
+
+	if (!worse(&top->heap[0], &r))
+		return;
+
+	/* replace the worst one */
+	for (i = 0; (c = 2 * i + 1) < NAME_TOP_K; i = c) {
+		if (c + 1 < NAME_TOP_K && worse(&top->heap[c + 1], &top->heap[c]))
+			c++;
+		if (!worse(&top->heap[c], &r))
+			break;
+		top->heap[i] = top->heap[c];
+	}
+	top->heap[i] = r;
+}
+
+static int cmp_ranked(const void *a, const void *b)
+{
+	/* the best first */
+	if (worse(a, b))
+		return 1;
+	if (worse(b, a))
+		return -1;
+	return 0;
+}
+
+/* same as add_group() and also gives the score of each item */
+static void add_ranked(struct name_index *idx, struct ranked *r, GPtrArray *result,
+		       GArray *scores)
+{
+	guint32 i;
+
+	for (i = idx->groups[r->group]; i < group_end(idx, r->group); i++) {
+		g_ptr_array_add(result, idx->items[i]);
+		if (scores)
+			g_array_append_val(scores, r->score);
+	}
+}
+
+struct match_shard {
+	struct name_index *idx;
+	struct name_query *query;
+	const guint32 *cands;	/* groups to check, NULL for all */
+	guint32 start;		/* range in @cands (or groups) */
+	guint32 end;
+	const gint *cancel;
+	GPtrArray *result;
+	struct top_k *top;	/* for ranked search instead of @result */
+
+	/* to wait for the shards in the pool */
+	GMutex *lock;
+	GCond *cond;
+	int *pending;
+};
+
+static GThreadPool *match_pool;
+
+static inline bool canceled(const gint *cancel)
+{
+	return cancel && g_atomic_int_get(cancel);
+}
+
+static void match_shard(struct match_shard *sh)
+{
+	guint64 mask = name_query_mask(sh->query);
+	guint32 i;
+
+	for (i = sh->start; i < sh->end; i++) {
+		guint32 g = sh->cands ? sh->cands[i] : i;
+		int score;
+
+		if ((i % CANCEL_CHECK) == 0 && canceled(sh->cancel))
+			break;
+
+		if ((sh->idx->masks[g] & mask) != mask)
+			continue;
+
+		score = name_query_score(sh->query, group_name(sh->idx, g));
+		if (score < 0)
+			continue;
+
+		if (sh->top)
+			top_k_add(sh->top, score, g);
+		else
+			add_group(sh->idx, g, sh->result);
+	}
+}
+
+static void shard_worker(gpointer data, gpointer unused)
+{
+	struct match_shard *sh = data;
+
+	match_shard(sh);
+
+	g_mutex_lock(sh->lock);
+	if (--*sh->pending == 0)
+		g_cond_signal(sh->cond);
+	g_mutex_unlock(sh->lock);
+}
+
+/* check groups in [@first, @last) of @cands (or the groups if NULL) */
+static void match_groups(struct name_index *idx, struct name_query *query,
+			 const guint32 *cands, guint32 first, guint32 last,
+			 const gint *cancel, GPtrArray *result, GArray *scores)
+{
+	guint32 nr = last - first;
+	struct match_shard *shards;
+	guint nr_shard = MAX(MIN(g_get_num_processors(), nr / SHARD_MIN), 1);
+	bool ranked = name_query_mode(query) == MATCH_FUZZY;
+	GMutex lock;
+	GCond cond;
+	int pending = nr_shard - 1;
+	guint i, k;
+
+	if (nr_shard > 1 && match_pool == NULL)
+		match_pool = g_thread_pool_new(shard_worker, NULL, g_get_num_processors(),
+					       FALSE, NULL);
+
+	g_mutex_init(&lock);
+	g_cond_init(&cond);
+
+	shards = g_malloc0(nr_shard * sizeof(*shards));
+	for (i = 0; i < nr_shard; i++) {
+		struct match_shard *sh = &shards[i];
+
+		sh->idx = idx;
+		sh->query = query;
+		sh->cands = cands;
+		sh->start = first + (guint64)nr * i / nr_shard;
+		sh->end = first + (guint64)nr * (i + 1) / nr_shard;
+		sh->cancel = cancel;
+		sh->result = i ? g_ptr_array_new() : result;
+		sh->top = ranked ? g_malloc0(sizeof(*sh->top)) : NULL;
+		sh->lock = &lock;
+		sh->cond = &cond;
+		sh->pending = &pending;
+
+		/* the current thread takes the first one */
+		if (i)
+			g_thread_pool_push(match_pool, sh, NULL);
+	}
+
+	match_shard(&shards[0]);
+
+	g_mutex_lock(&lock);
+	while (pending > 0)
+		g_cond_wait(&cond, &lock);
+	g_mutex_unlock(&lock);
+
+	for (i = 1; i < nr_shard; i++) {
+		GPtrArray *part = shards[i].result;
+
+		for (k = 0; k < part->len; k++)
+			g_ptr_array_add(result, g_ptr_array_index(part, k));
+		g_ptr_array_free(part, TRUE);
+
+		if (ranked) {
+			for (k = 0; k < shards[i].top->nr; k++)
+				top_k_add(shards[0].top, shards[i].top->heap[k].score,
+					  shards[i].top->heap[k].group);
+			g_free(shards[i].top);
+		}
+	}
+
+	if (ranked) {
+		struct top_k *top = shards[0].top;
+
+		qsort(top->heap, top->nr, sizeof(*top->heap), cmp_ranked);
+		for (k = 0; k < top->nr; k++)
+			add_ranked(idx, &top->heap[k], result, scores);
+		g_free(top);
+	}
+
+	g_free(shards);
+	g_mutex_clear(&lock);
+	g_cond_clear(&cond);
+}
+
+/* names with the prefix are contiguous, check them like the others */
+static void search_prefix(struct name_index *idx, const char *prefix, size_t len,
+			  struct name_query *query, const gint *cancel, GPtrArray *result,
+			  GArray *scores)
+{
+	guint32 first = lower_bound(idx, prefix, len);
+	guint32 last = upper_bound(idx, prefix, len);
+
+	pr_dbg("name index: %u names with the prefix\n", last - first);
+
+	match_groups(idx, query, NULL, first, last, cancel, result, scores);
+}
+
+/* keep the elements in @cands which are also in the postings of @b */
+static void intersect(GArray *cands, guint32 b, struct name_index *idx)
+{
+	guint32 *list = idx->postings + idx->bucket_start[b];
+	guint32 nr = idx->bucket_start[b + 1] - idx->bucket_start[b];
+	guint32 i = 0, k = 0, n = 0;
+
+	while (i < cands->len && k < nr) {
+		guint32 c = g_array_index(cands, guint32, i);
+
+		if (c < list[k])
+			i++;
+		else if (c > list[k])
+			k++;
+		else {
+			g_array_index(cands, guint32, n++) = c;
+			i++;
+			k++;
+		}
+	}
+	g_array_set_size(cands, n);
+}
+
+/* returns false if the query has no literal to build trigrams from */
+static bool search_trigram(struct name_index *idx, struct name_query *query,
+			   const gint *cancel, GPtrArray *result, GArray *scores)
+{
+	gchar **literals = name_query_literals(query);
+	GArray *cands = NULL;
+	int i;
+
+	for (i = 0; literals[i]; i++) {
+		const char *p = literals[i];
+		size_t len = strlen(p);
+		size_t k;
+
+		for (k = 0; k + 3 <= len; k++) {
+			guint32 b = trigram_bucket(idx, p + k);
+
+			if (cands == NULL) {
+				guint32 start = idx->bucket_start[b];
+				guint32 nr = idx->bucket_start[b + 1] - start;
+
+				cands = g_array_sized_new(FALSE, FALSE, sizeof(guint32), nr);
+				g_array_append_vals(cands, idx->postings + start, nr);
+			}
+			else
+				intersect(cands, b, idx);
+		}
+	}
+
+	if (cands == NULL)
+		return false;
+
+	pr_dbg("name index: %u candidates\n", cands->len);
+
+	match_groups(idx, query, (guint32 *)cands->data, 0, cands->len, cancel,
+		     result, scores);
+
+	g_array_free(cands, TRUE);
+	return true;
+}
+
+/*
+ * returns search items matching @query, sorted by name (or by score for
+ * ranked queries).  The result is incomplete if @cancel (can be NULL)
+ * was set during the search.  For ranked queries, the score of each
+ * item is appended to @scores if it's not NULL.
+ */
+GPtrArray *name_index_search(struct name_index *idx, struct name_query *query,
+			     const gint *cancel, GArray *scores)
+{
+	GPtrArray *result = g_ptr_array_new();
+	const char *prefix;
+	size_t len = name_query_prefix(query, &prefix);
+
+	if (len > 0) {
+		search_prefix(idx, prefix, len, query, cancel, result, scores);
+		return result;
+	}
+
+	if (search_trigram(idx, query, cancel, result, scores))
+		return result;
+
+	/* no usable literal, check all names */
+	match_groups(idx, query, NULL, 0, idx->nr_group, cancel, result, scores);
+	return result;
+}
@@ -0,0 +1,148 @@
+/*
+ * dwarview - DWARF debug info viewer
+ *
+ * Copyright (C) 2016  Namhyung Kim <namhyung@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 or later of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+/*
+ * Deduplicated type index.
+ *
+ * The same type is usually defined in many CUs.  Type definitions with
+ * the same name and signature (see type_signature()) are merged into a
+ * single entry which keeps the offsets of all the copies.  The one at
+ * the lowest offset is used as the canonical DIE, so that it doesn't
+ * depend on the order the loader threads find them.
+ */
+
+#include <string.h>
+
+#include "dwarview.h"
+
+struct type_entry {
+	struct search_item item;	/* should be the first */
+	guint64 sig;
+	GArray *offs;			/* Dwarf_Off of all copies */
+};
+
+struct type_index {
+	GHashTable *types;
+	guint nr_copy;
+};
+
+static guint hash_type(gconstpointer key)
+{
+	const struct type_entry *type = key;
+
+	return g_str_hash(type->item.name) ^ (guint)type->sig ^ (guint)(type->sig >> 32);
+}
+
+static gboolean equal_type(gconstpointer a, gconstpointer b)
+{
+	const struct type_entry *type_a = a;
+	const struct type_entry *type_b = b;
+
+	return type_a->sig == type_b->sig && !strcmp(type_a->item.name, type_b->item.name);
+}
+
+static void free_type(gpointer data)
+{
+	struct type_entry *type = data;
+
+	g_array_free(type->offs, TRUE);
+	g_free(type);
+}
+
+struct type_index *type_index_new(void)
+{
+	struct type_index *idx = g_malloc0(sizeof(*idx));
+
+	idx->types = g_hash_table_new_full(hash_type, equal_type, free_type, NULL);
+	return idx;
+}
+
+void type_index_free(struct type_index *idx)
+{
+	pr_dbg("type index: %u types for %u definitions\n",
+	       g_hash_table_size(idx->types), idx->nr_copy);
+
+	g_hash_table_destroy(idx->types);
+	g_free(idx);
+}
+
+/* @name is not copied, it should be valid until the index is freed */
+void type_index_add(struct type_index *idx, const char *name, guint64 sig, Dwarf_Off off)
+{
+	struct type_entry key = {
+		.item.name = name,
+		.sig = sig,
+	};
+	struct type_entry *type;
+
+	type = g_hash_table_lookup(idx->types, &key);
+	if (type == NULL) {
+		type = g_malloc(sizeof(*type));
+		type->item.name = name;
+		type->item.off = off;
+		type->sig = sig;
+		type->offs = g_array_sized_new(FALSE, FALSE, sizeof(Dwarf_Off), 1);
+
+		g_hash_table_add(idx->types, type);
+	}
+	else if (off < type->item.off)
+		type->item.off = off;
+
+	g_array_append_val(type->offs, off);
+	idx->nr_copy++;
+}
+
+/* returns an array of the canonical search items */
+GPtrArray *type_index_items(struct type_index *idx)
+{
+	GPtrArray *items = g_ptr_array_sized_new(g_hash_table_size(idx->types));
+	GHashTableIter iter;
+	gpointer key;
+
+	g_hash_table_iter_init(&iter, idx->types);
+	while (g_hash_table_iter_next(&iter, &key, NULL))
+		g_ptr_array_add(items, key);
+
+	return items;
+}
+
+/* @item should be the one returned by type_index_items() */
+GArray *type_index_copies(struct search_item *item)
+{
+	return ((struct type_entry *)item)->offs;
+}
+
+/* call @fn for all type definitions, used to save them */
+void type_index_foreach(struct type_index *idx,
+			void (*fn)(const char *name, guint64 sig, Dwarf_Off off, void *arg),
+			void *arg)
+{
+	GHashTableIter iter;
+	gpointer key;
+	guint i;
+
+	g_hash_table_iter_init(&iter, idx->types);
+	while (g_hash_table_iter_next(&iter, &key, NULL)) {
+		struct type_entry *type = key;
+
+		for (i = 0; i < type->offs->len; i++)
+			fn(type->item.name, type->sig, g_array_index(type->offs, Dwarf_Off, i), arg);
+	}
+}
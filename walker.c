@@ -0,0 +1,83 @@
+/*
+ * dwarview - DWARF debug info viewer
+ *
+ * Copyright (C) 2016  Namhyung Kim <namhyung@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 or later of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+/*
+ * DIE tree walker.
+ *
+ * It visits DIEs in pre-order (the same order as they are in the file)
+ * using an explicit stack of parent DIEs, so the depth of the C stack
+ * doesn't depend on the number of siblings or the nesting level.
+ */
+
+#include "dwarview.h"
+
+#define WALK_STACK_SIZE  64
+
+/* returns false if @visit stopped the walk */
+bool die_walk(Dwarf_Die *parent, die_visit_fn visit, void *arg)
+{
+	Dwarf_Die stack_buf[WALK_STACK_SIZE];
+	Dwarf_Die *stack = stack_buf;
+	int stack_size = WALK_STACK_SIZE;
+	int depth = 1;
+	bool ret = true;
+	Dwarf_Die die;
+
+	if (dwarf_child(parent, &die) != 0)
+		return true;
+
+	while (true) {
+		int action = visit(&die, depth, arg);
+
+		if (action == WALK_STOP) {
+			ret = false;
+			break;
+		}
+
+		if (action != WALK_SKIP && dwarf_haschildren(&die)) {
+			Dwarf_Die child;
+
+			if (dwarf_child(&die, &child) == 0) {
+				/* keep the parent to get its sibling later */
+				if (depth > stack_size) {
+					stack_size *= 2;
+					if (stack == stack_buf)
+						stack = g_memdup2(stack_buf, sizeof(stack_buf));
+					stack = g_realloc(stack, stack_size * sizeof(*stack));
+				}
+				stack[depth++ - 1] = die;
+				die = child;
+				continue;
+			}
+		}
+
+		/* no more siblings, go up to the parent's sibling */
+		while (dwarf_siblingof(&die, &die) != 0) {
+			if (--depth == 0)
+				goto out;
+			die = stack[depth - 1];
+		}
+	}
+
+out:
+	if (stack != stack_buf)
+		g_free(stack);
+	return ret;
+}